@@ -23,12 +23,23 @@
 #include "global_schedule.h"
 
 gttcan_t gttcan; // G-TTCAN protocol state
+const uint16_t subscribed_data_ids[] = {GENERIC_DATA_ID}; // Data this node consumes, in ascending order
+
+#ifndef APP_NODE_ID
+#define APP_NODE_ID 1 // Each node of the network is built with its own ID
+#endif
+
+#define CAN_FIRST_FILTER_BANK 14 // Banks 14-27 belong to CAN2
+#define CAN_FILTER_BANK_COUNT 14
+volatile uint32_t timer_epoch = 0; // Local time elapsed before the current TIM2 period
 
 // Forward declarations of G-TTCAN callback functions
 void set_timer_int(uint32_t time);
 void transmit_frame(uint32_t can_frame_id_field, uint64_t data);
 uint64_t read_value(uint16_t data_id);
 void write_value(uint16_t data_id, uint64_t value);
+uint32_t get_local_time(void);
+void configure_can_filter(uint32_t filter_bank, const gttcan_filter_t *filter);
 
 int main(void)
 {
@@ -46,29 +57,26 @@ int main(void)
     MX_TIM1_Init();
     MX_SPI_Init();
 
-    // Configure CAN filter to accept all messages
-    CAN_FilterTypeDef canFilter;
-    canFilter.FilterMode = CAN_FILTERMODE_IDMASK;
-    canFilter.FilterScale = CAN_FILTERSCALE_32BIT;
-    canFilter.FilterIdHigh = 0x0000;
-    canFilter.FilterIdLow = 0x0000;
-    canFilter.FilterMaskIdHigh = 0x0000;
-    canFilter.FilterMaskIdLow = 0x0000;
-    canFilter.FilterFIFOAssignment = CAN_RX_FIFO0;
-    canFilter.FilterActivation = ENABLE;
-    canFilter.SlaveStartFilterBank = 0;
-    canFilter.FilterBank = 14;
+    // Initialize G-TTCAN with node-specific parameters and callbacks
+    gttcan_init(&gttcan, APP_NODE_ID, global_schedule, GLOBAL_SCHEDULE_LENGTH, 300, 7,
+                transmit_frame, set_timer_int, read_value, write_value, true);
+    gttcan_set_local_time_callback(&gttcan, get_local_time); // Enable the network time base
+    gttcan_set_subscriptions(&gttcan, subscribed_data_ids, sizeof(subscribed_data_ids) / sizeof(subscribed_data_ids[0]));
+
+    // Configure CAN filter banks 14-27 (CAN2) to accept only the frames this node needs
+    gttcan_filter_t filters[CAN_FILTER_BANK_COUNT];
+    uint8_t filter_count = gttcan_get_acceptance_filters(&gttcan, filters, CAN_FILTER_BANK_COUNT);
+    for (uint8_t i = 0; i < filter_count; i++)
+    {
+        configure_can_filter(CAN_FIRST_FILTER_BANK + i, &filters[i]);
+    }
 
     // Start CAN peripheral and enable RX/TX interrupts
-    HAL_CAN_ConfigFilter(&hcan2, &canFilter);
     HAL_CAN_Start(&hcan2);
-    HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY);
-
-    // Initialize G-TTCAN with node-specific parameters and callbacks
-    gttcan_init(&gttcan, 1, global_schedule, MAX_GLOBAL_SCHEDULE_LENGTH, 300, 7,
-                transmit_frame, set_timer_int, read_value, write_value);
+    HAL_CAN_ActivateNotification(&hcan2, CAN_IT_RX_FIFO0_MSG_PENDING | CAN_IT_TX_MAILBOX_EMPTY |
+                                         CAN_IT_RX_FIFO0_OVERRUN | CAN_IT_BUSOFF | CAN_IT_ERROR);
 
-    gttcan_start(&gttcan); // Start protocol after optional wait
+    gttcan_join(&gttcan); // Join a running network, or cold-start if the bus is silent
 
     HAL_TIM_Base_Start_IT(&htim2); // Start timer with interrupt enabled
 
@@ -83,6 +91,7 @@ int main(void)
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
     if (htim->Instance == TIM2) {
+        timer_epoch += __HAL_TIM_GET_AUTORELOAD(&htim2) + 1; // Counter wrapped at the end of the period
         gttcan_transmit_next_frame(&gttcan); // Schedule and transmit next frame if it's our turn
     }
 }
@@ -96,16 +105,39 @@ void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
 
     HAL_CAN_GetRxMessage(hcan, CAN_RX_FIFO0, &rx_header, rx_data);
 
+    const uint64_t *dataptr = (const uint64_t *)rx_data;
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    if (rx_header.IDE == CAN_ID_STD) {
+        gttcan_process_frame(&gttcan, rx_header.StdId, *dataptr); // Forward to G-TTCAN logic
+    }
+#else
     if (rx_header.IDE == CAN_ID_EXT) {
-        const uint64_t *dataptr = (const uint64_t *)rx_data;
         gttcan_process_frame(&gttcan, rx_header.ExtId, *dataptr); // Forward to G-TTCAN logic
     }
+#endif
+}
+
+// CAN error interrupt callback: G-TTCAN stays off the bus until it has found its place again
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
+{
+    uint32_t error_code = hcan->ErrorCode;
+    if (error_code & HAL_CAN_ERROR_BOF) {
+        gttcan_report_error(&gttcan, GTTCAN_ERROR_BUS_OFF);
+    }
+    if (error_code & (HAL_CAN_ERROR_TX_TERR0 | HAL_CAN_ERROR_TX_TERR1 | HAL_CAN_ERROR_TX_TERR2)) {
+        gttcan_report_error(&gttcan, GTTCAN_ERROR_TX);
+    }
+    if (error_code & HAL_CAN_ERROR_RX_FOV0) {
+        gttcan_report_error(&gttcan, GTTCAN_ERROR_RX_OVERRUN);
+    }
+    HAL_CAN_ResetError(hcan);
 }
 
 // Set a timer interrupt after a specific time (used by G-TTCAN to wait between slots)
 void set_timer_int(uint32_t time)
 {
     __HAL_TIM_DISABLE(&htim2);                       // Stop timer temporarily
+    timer_epoch += __HAL_TIM_GET_COUNTER(&htim2);    // Keep local time running across the reload
     __HAL_TIM_SET_AUTORELOAD(&htim2, time);          // Set new auto-reload value
     __HAL_TIM_SET_COUNTER(&htim2, 0);                // Reset counter
     __HAL_TIM_CLEAR_FLAG(&htim2, TIM_FLAG_UPDATE);   // Clear update flag
@@ -113,14 +145,19 @@ void set_timer_int(uint32_t time)
     __HAL_TIM_ENABLE(&htim2);                        // Start timer again
 }
 
-// Sends a CAN frame with extended ID and 64-bit data
+// Sends a CAN frame with extended (or standard) ID and 64-bit data
 void transmit_frame(uint32_t can_frame_id, uint64_t data)
 {
     CAN_TxHeaderTypeDef tx_header;
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    tx_header.IDE = CAN_ID_STD;
+    tx_header.StdId = can_frame_id;
+#else
     tx_header.IDE = CAN_ID_EXT;
     tx_header.ExtId = can_frame_id;
+#endif
     tx_header.RTR = CAN_RTR_DATA;
-    tx_header.DLC = 8; // 8 bytes
+    tx_header.DLC = gttcan_get_transmit_dlc(&gttcan); // 8 bytes unless the schedule entry says otherwise
     tx_header.TransmitGlobalTime = DISABLE;
 
     uint32_t tx_mbox = 0;
@@ -129,14 +166,18 @@ void transmit_frame(uint32_t can_frame_id, uint64_t data)
     HAL_GPIO_TogglePin(LD1_GPIO_Port, LD1_Pin); // Toggle LED to indicate activity
 }
 
-// Return a data value requested by G-TTCAN, e.g., current time for reference frame
+// Return a data value requested by G-TTCAN (reference frame payloads are built by G-TTCAN itself)
 uint64_t read_value(uint16_t data_id)
 {
-    if (data_id == REFERENCE_FRAME_DATA_ID) {
-        return __HAL_TIM_GET_COUNTER(&htim2); // Timestamp based on hardware timer
-    } else {
-        return 1; // Dummy data
-    }
+    (void)data_id;
+    return 1; // Dummy data
+}
+
+// Free-running local time in TIM2 ticks, used by G-TTCAN for the network time base
+// (gttcan_get_global_time() converts it into network time, e.g. to timestamp samples)
+uint32_t get_local_time(void)
+{
+    return timer_epoch + __HAL_TIM_GET_COUNTER(&htim2);
 }
 
 // Receive data value from a frame (not used in this example, but defined for extensibility)
@@ -144,3 +185,28 @@ void write_value(uint16_t data_id, uint64_t value)
 {
     // Placeholder: Implement custom behavior for received data if needed
 }
+
+// Load a G-TTCAN acceptance filter into a 32-bit identifier/mask filter bank
+void configure_can_filter(uint32_t filter_bank, const gttcan_filter_t *filter)
+{
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    uint32_t filter_id = filter->id << 21;                    // STID[10:0] in bits 31-21, IDE clear
+    uint32_t filter_mask = (filter->mask << 21) | CAN_ID_EXT; // Only match standard frames
+#else
+    uint32_t filter_id = (filter->id << 3) | CAN_ID_EXT;      // EXID[28:0] in bits 31-3, IDE set
+    uint32_t filter_mask = (filter->mask << 3) | CAN_ID_EXT;  // Only match extended frames
+#endif
+
+    CAN_FilterTypeDef canFilter;
+    canFilter.FilterMode = CAN_FILTERMODE_IDMASK;
+    canFilter.FilterScale = CAN_FILTERSCALE_32BIT;
+    canFilter.FilterIdHigh = filter_id >> 16;
+    canFilter.FilterIdLow = filter_id & 0xFFFF;
+    canFilter.FilterMaskIdHigh = filter_mask >> 16;
+    canFilter.FilterMaskIdLow = filter_mask & 0xFFFF;
+    canFilter.FilterFIFOAssignment = CAN_RX_FIFO0;
+    canFilter.FilterActivation = ENABLE;
+    canFilter.SlaveStartFilterBank = CAN_FIRST_FILTER_BANK;
+    canFilter.FilterBank = filter_bank;
+    HAL_CAN_ConfigFilter(&hcan2, &canFilter);
+}
@@ -1,4 +1,15 @@
 #include "gttcan.h"
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+// The same 512 slot round as runs: each half is a reference frame, then nodes 2, 3, 1 in turn
+const gttcan_schedule_run_t global_schedule[] = {
+    {0, 1, REFERENCE_FRAME_DATA_ID, 1, {1}},
+    {1, 255, GENERIC_DATA_ID, 3, {2, 3, 1}},
+    {256, 1, REFERENCE_FRAME_DATA_ID, 1, {1}},
+    {257, 255, GENERIC_DATA_ID, 3, {2, 3, 1}},
+};
+#define GLOBAL_SCHEDULE_LENGTH (sizeof(global_schedule) / sizeof(global_schedule[0]))
+#else
+#define GLOBAL_SCHEDULE_LENGTH MAX_GLOBAL_SCHEDULE_LENGTH
 global_schedule_entry_t global_schedule[MAX_GLOBAL_SCHEDULE_LENGTH] = {
     {1, 0, REFERENCE_FRAME_DATA_ID},
     {2, 1, GENERIC_DATA_ID},
@@ -517,4 +528,4 @@ global_schedule_entry_t global_schedule[MAX_GLOBAL_SCHEDULE_LENGTH] = {
     {3, 510, GENERIC_DATA_ID},
     {1, 511, GENERIC_DATA_ID},
 };
-
+#endif
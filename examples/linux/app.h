@@ -0,0 +1,14 @@
+/*
+ * app.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef APP_H
+#define APP_H
+
+#include "hal.h"
+
+// Nothing application specific on the host
+
+#endif
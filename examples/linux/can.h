@@ -0,0 +1,16 @@
+/*
+ * can.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef CAN_H
+#define CAN_H
+
+#include "hal.h"
+
+extern CAN_HandleTypeDef hcan2;
+
+void MX_CAN_Init(void);
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * dma.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef DMA_H
+#define DMA_H
+
+#include "hal.h"
+
+void MX_DMA_Init(void);
+
+#endif
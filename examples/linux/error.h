@@ -0,0 +1,14 @@
+/*
+ * error.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef ERROR_H
+#define ERROR_H
+
+#include "hal.h"
+
+void Error_Handler(void);
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ * gpio.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef GPIO_H
+#define GPIO_H
+
+#include "hal.h"
+
+extern GPIO_TypeDef hal_emu_gpiob;
+#define LD1_GPIO_Port (&hal_emu_gpiob)
+#define LD1_Pin 0x0001U
+
+void MX_GPIO_Init(void);
+
+#endif
@@ -0,0 +1,161 @@
+/*
+ * hal.h
+ *
+ *  Linux emulation of the parts of the STM32 HAL used by examples/app.c: TIM2 with its
+ *  update interrupt, CAN2 with three transmit mailboxes, 32-bit mask filter banks and
+ *  RX FIFO0, and the LED. See hal_emu.c for how it is built and run.
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+typedef enum
+{
+    HAL_OK = 0x00U,
+    HAL_ERROR = 0x01U,
+    HAL_BUSY = 0x02U,
+    HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+typedef enum
+{
+    DISABLE = 0U,
+    ENABLE = !DISABLE
+} FunctionalState;
+
+// Timer
+
+typedef struct
+{
+    uint32_t is_enabled;        // CR1.CEN
+    uint32_t is_update_it;      // DIER.UIE
+    uint32_t is_update_flag;    // SR.UIF
+    uint32_t auto_reload;       // ARR
+    uint32_t counter;           // CNT while stopped
+    int64_t period_start_ns;    // Host time CNT was last 0, while running
+    int64_t stopped_ns;         // Host time the counter was stopped
+} TIM_TypeDef;
+
+typedef struct
+{
+    TIM_TypeDef *Instance;
+} TIM_HandleTypeDef;
+
+extern TIM_TypeDef hal_emu_tim2;
+#define TIM2 (&hal_emu_tim2)
+
+#define TIM_FLAG_UPDATE 0x1U
+#define TIM_IT_UPDATE 0x1U
+
+uint32_t hal_emu_tim_get_counter(TIM_TypeDef *tim);
+void hal_emu_tim_set_counter(TIM_TypeDef *tim, uint32_t counter);
+void hal_emu_tim_set_auto_reload(TIM_TypeDef *tim, uint32_t auto_reload);
+void hal_emu_tim_enable(TIM_TypeDef *tim, uint32_t is_enabled);
+void hal_emu_tim_enable_it(TIM_TypeDef *tim, uint32_t interrupt, uint32_t is_enabled);
+void hal_emu_tim_clear_flag(TIM_TypeDef *tim, uint32_t flag);
+
+#define __HAL_TIM_GET_COUNTER(handle) hal_emu_tim_get_counter((handle)->Instance)
+#define __HAL_TIM_SET_COUNTER(handle, counter) hal_emu_tim_set_counter((handle)->Instance, (counter))
+#define __HAL_TIM_GET_AUTORELOAD(handle) ((handle)->Instance->auto_reload)
+#define __HAL_TIM_SET_AUTORELOAD(handle, auto_reload) hal_emu_tim_set_auto_reload((handle)->Instance, (auto_reload))
+#define __HAL_TIM_ENABLE(handle) hal_emu_tim_enable((handle)->Instance, 1)
+#define __HAL_TIM_DISABLE(handle) hal_emu_tim_enable((handle)->Instance, 0)
+#define __HAL_TIM_ENABLE_IT(handle, interrupt) hal_emu_tim_enable_it((handle)->Instance, (interrupt), 1)
+#define __HAL_TIM_DISABLE_IT(handle, interrupt) hal_emu_tim_enable_it((handle)->Instance, (interrupt), 0)
+#define __HAL_TIM_CLEAR_FLAG(handle, flag) hal_emu_tim_clear_flag((handle)->Instance, (flag))
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim);
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
+
+// CAN
+
+typedef struct
+{
+    uint32_t index;
+} CAN_TypeDef;
+
+typedef struct
+{
+    CAN_TypeDef *Instance;
+    volatile uint32_t ErrorCode;    // HAL_CAN_ERROR_ bits, until HAL_CAN_ResetError()
+} CAN_HandleTypeDef;
+
+typedef struct
+{
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    FunctionalState TransmitGlobalTime;
+} CAN_TxHeaderTypeDef;
+
+typedef struct
+{
+    uint32_t StdId;
+    uint32_t ExtId;
+    uint32_t IDE;
+    uint32_t RTR;
+    uint32_t DLC;
+    uint32_t Timestamp;         // Local time of the end of the frame, in timer ticks
+    uint32_t FilterMatchIndex;
+} CAN_RxHeaderTypeDef;
+
+typedef struct
+{
+    uint32_t FilterIdHigh;
+    uint32_t FilterIdLow;
+    uint32_t FilterMaskIdHigh;
+    uint32_t FilterMaskIdLow;
+    uint32_t FilterFIFOAssignment;
+    uint32_t FilterBank;
+    uint32_t FilterMode;
+    uint32_t FilterScale;
+    uint32_t FilterActivation;
+    uint32_t SlaveStartFilterBank;
+} CAN_FilterTypeDef;
+
+#define CAN_ID_STD 0x00000000U
+#define CAN_ID_EXT 0x00000004U
+#define CAN_RTR_DATA 0x00000000U
+#define CAN_RX_FIFO0 0x00000000U
+#define CAN_FILTERMODE_IDMASK 0x00000000U
+#define CAN_FILTERSCALE_32BIT 0x00000001U
+#define CAN_IT_TX_MAILBOX_EMPTY 0x00000001U
+#define CAN_IT_RX_FIFO0_MSG_PENDING 0x00000002U
+#define CAN_IT_RX_FIFO0_OVERRUN 0x00000004U
+#define CAN_IT_BUSOFF 0x00000008U
+#define CAN_IT_ERROR 0x00000010U
+#define HAL_CAN_ERROR_NONE 0x00000000U
+#define HAL_CAN_ERROR_BOF 0x00000004U
+#define HAL_CAN_ERROR_RX_FOV0 0x00000200U
+#define HAL_CAN_ERROR_TX_TERR0 0x00001000U
+#define HAL_CAN_ERROR_TX_TERR1 0x00004000U
+#define HAL_CAN_ERROR_TX_TERR2 0x00010000U
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig);
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan);
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs);
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[], uint32_t *pTxMailbox);
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[]);
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan);
+void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan);
+void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan);
+
+// GPIO
+
+typedef struct
+{
+    uint32_t toggle_count;
+} GPIO_TypeDef;
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+// System
+
+HAL_StatusTypeDef HAL_Init(void);
+void SystemClock_Config(void);
+
+#endif
@@ -0,0 +1,841 @@
+/*
+ * hal_emu.c
+ *
+ *  Linux emulation of the STM32 HAL used by examples/app.c, so that the unmodified example
+ *  application, with its set_timer_int reload sequence and its two interrupt callbacks, runs
+ *  as a host process. Each process is one node; nodes share an emulated CAN bus.
+ *
+ *  TIM2 counts host time (CLOCK_MONOTONIC) in ticks of HAL_EMU_TICK_NS, wraps at the
+ *  auto-reload value and raises its update interrupt, and stops counting while disabled, so
+ *  the ticks set_timer_int loses on every reload are lost here too. CAN2 has three transmit
+ *  mailboxes that stay busy for the frame time, the 32-bit mask filter banks of CAN2 and a
+ *  three deep RX FIFO0 that overruns like the hardware one, reporting HAL_CAN_ERROR_RX_FOV0 to
+ *  HAL_CAN_ErrorCallback() when CAN_IT_RX_FIFO0_OVERRUN is enabled. A frame reaches the other nodes
+ *  at the end of its transmission; arbitration and error frames are not emulated.
+ *
+ *  Interrupts run on a separate interrupt thread, one at a time in the order they become
+ *  due, with TIM2 first on a tie, as two interrupts of equal priority would on the target.
+ *  The spinning main loop is moved to SCHED_IDLE so that it only uses otherwise idle CPU time.
+ *
+ *  Build one node (from the repository root):
+ *      cc -O2 -Iexamples/linux -Isrc/include -DAPP_NODE_ID=1 -o app_node1 \
+ *          examples/app.c examples/linux/hal_emu.c src/gttcan.c -lpthread
+ *
+ *  Usage:
+ *      app_node1
+ *  Environment:
+ *      HAL_EMU_TICK_NS     Length of a TIM2 tick in ns (default 1000, a 1 MHz timer)
+ *      HAL_EMU_BITRATE     CAN bitrate in bit/s, for the frame time (default 1000000)
+ *      HAL_EMU_SECONDS     Exit after this many seconds (default 0, run until interrupted)
+ *      HAL_EMU_CAN_IF      SocketCAN interface to use as the bus, e.g. vcan0
+ *      HAL_EMU_BUS_PORT    Otherwise, UDP port of the loopback multicast bus (default 47000)
+ *  On exit each node prints interrupt latencies, interrupt durations, the time TIM2 spent
+ *  stopped inside set_timer_int and its CAN frame counts to stderr.
+ */
+
+#define _GNU_SOURCE
+
+#include "hal.h"
+#include "can.h"
+#include "dma.h"
+#include "error.h"
+#include "gpio.h"
+#include "spi.h"
+#include "timer.h"
+#include "uart.h"
+#include "usb.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/can.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HAL_EMU_TX_MAILBOXES 3
+#define HAL_EMU_RX_FIFO_DEPTH 3
+#define HAL_EMU_FILTER_BANKS 28
+#define HAL_EMU_BUS_QUEUE_LENGTH 64         // Frames on their way over the bus
+#define HAL_EMU_BUS_GROUP "239.255.0.42"
+#define HAL_EMU_IDLE_WAIT_NS 100000000LL    // Longest sleep of the interrupt thread
+#define HAL_EMU_RTR_BIT 0x00000002U         // RTR bit of the identifier register
+
+typedef struct
+{
+    uint32_t identifier;    // In the layout of the identifier and filter registers
+    uint8_t dlc;
+    uint8_t data[8];
+    int64_t end_ns;         // Host time the frame ends on the bus
+} hal_emu_frame_t;
+
+typedef struct
+{
+    uint32_t sender;
+    uint32_t identifier;
+    int64_t end_ns;
+    uint8_t dlc;
+    uint8_t data[8];
+} hal_emu_datagram_t;
+
+typedef struct
+{
+    uint32_t is_active;
+    uint32_t id;
+    uint32_t mask;
+    uint32_t fifo;
+} hal_emu_filter_bank_t;
+
+typedef struct
+{
+    uint64_t count;
+    int64_t total_ns;
+    int64_t max_ns;
+} hal_emu_stat_t;
+
+TIM_TypeDef hal_emu_tim2 = {.auto_reload = 0xFFFFFFFFU};
+static TIM_TypeDef hal_emu_tim1 = {.auto_reload = 0xFFFFU};
+static CAN_TypeDef hal_emu_can2 = {.index = 2};
+GPIO_TypeDef hal_emu_gpiob;
+
+TIM_HandleTypeDef htim1;
+TIM_HandleTypeDef htim2;
+CAN_HandleTypeDef hcan2;
+
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t interrupt_thread;
+static volatile sig_atomic_t is_stop_requested = 0;
+
+static int64_t tick_ns = 1000;
+static int64_t bit_ns = 1000;
+static int64_t start_ns;
+static int64_t stop_ns = 0;
+static int bus_fd = -1;
+static int wake_fd = -1;
+static bool is_socketcan = false;
+static struct sockaddr_in bus_address;
+static uint32_t sender_token;
+
+static int64_t tim2_update_ns;          // Period boundary of the pending update interrupt
+
+static bool is_can_started = false;
+static uint32_t can_active_its = 0;
+static int64_t mailbox_free_ns[HAL_EMU_TX_MAILBOXES];
+static int64_t bus_free_ns = 0;         // End of this node's last frame on the bus
+static uint32_t slave_start_filter_bank = 14;
+static hal_emu_filter_bank_t filter_banks[HAL_EMU_FILTER_BANKS];
+static hal_emu_frame_t bus_queue[HAL_EMU_BUS_QUEUE_LENGTH];
+static uint32_t bus_queue_head = 0;
+static uint32_t bus_queue_count = 0;
+static hal_emu_frame_t rx_fifo[HAL_EMU_RX_FIFO_DEPTH];
+static uint32_t rx_fifo_head = 0;
+static uint32_t rx_fifo_count = 0;
+static bool is_rx_overrun_pending = false;
+
+static hal_emu_stat_t tim2_latency, tim2_isr, rx_latency, rx_isr, tim2_stopped;
+static uint64_t tx_frames = 0, tx_mailbox_full = 0;
+static uint64_t rx_frames = 0, rx_filtered = 0, rx_overruns = 0, bus_queue_overruns = 0;
+
+static int64_t hal_emu_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static int64_t hal_emu_env(const char *name, int64_t default_value)
+{
+    const char *value = getenv(name);
+    return (value != NULL && *value != '\0') ? strtoll(value, NULL, 0) : default_value;
+}
+
+static void hal_emu_record(hal_emu_stat_t *stat, int64_t ns)
+{
+    stat->count++;
+    stat->total_ns += ns;
+    if (ns > stat->max_ns)
+    {
+        stat->max_ns = ns;
+    }
+}
+
+// Wake the interrupt thread when another thread changed what it is waiting for
+static void hal_emu_wake(void)
+{
+    if (wake_fd >= 0 && !pthread_equal(pthread_self(), interrupt_thread))
+    {
+        uint64_t one = 1;
+        ssize_t written = write(wake_fd, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+static int64_t hal_emu_tim_period_ns(const TIM_TypeDef *tim)
+{
+    return ((int64_t)tim->auto_reload + 1) * tick_ns;
+}
+
+static uint32_t hal_emu_tim_counter_locked(const TIM_TypeDef *tim, int64_t now)
+{
+    if (!tim->is_enabled)
+    {
+        return tim->counter;
+    }
+    int64_t ticks = (now - tim->period_start_ns) / tick_ns;
+    return (uint32_t)(ticks % ((int64_t)tim->auto_reload + 1));
+}
+
+uint32_t hal_emu_tim_get_counter(TIM_TypeDef *tim)
+{
+    pthread_mutex_lock(&emu_lock);
+    uint32_t counter = hal_emu_tim_counter_locked(tim, hal_emu_now());
+    pthread_mutex_unlock(&emu_lock);
+    return counter;
+}
+
+void hal_emu_tim_set_counter(TIM_TypeDef *tim, uint32_t counter)
+{
+    pthread_mutex_lock(&emu_lock);
+    if (tim->is_enabled)
+    {
+        tim->period_start_ns = hal_emu_now() - (int64_t)counter * tick_ns;
+    }
+    else
+    {
+        tim->counter = counter;
+    }
+    pthread_mutex_unlock(&emu_lock);
+    hal_emu_wake();
+}
+
+void hal_emu_tim_set_auto_reload(TIM_TypeDef *tim, uint32_t auto_reload)
+{
+    pthread_mutex_lock(&emu_lock);
+    if (tim->is_enabled)
+    {
+        int64_t now = hal_emu_now();
+        uint32_t counter = hal_emu_tim_counter_locked(tim, now);
+        tim->auto_reload = auto_reload;
+        tim->period_start_ns = now - (int64_t)counter * tick_ns;
+    }
+    else
+    {
+        tim->auto_reload = auto_reload;
+    }
+    pthread_mutex_unlock(&emu_lock);
+    hal_emu_wake();
+}
+
+void hal_emu_tim_enable(TIM_TypeDef *tim, uint32_t is_enabled)
+{
+    pthread_mutex_lock(&emu_lock);
+    int64_t now = hal_emu_now();
+    if (is_enabled && !tim->is_enabled)
+    {
+        tim->period_start_ns = now - (int64_t)tim->counter * tick_ns;
+        tim->is_enabled = 1;
+        if (tim->stopped_ns != 0)
+        {
+            hal_emu_record(&tim2_stopped, now - tim->stopped_ns);
+            tim->stopped_ns = 0;
+        }
+    }
+    else if (!is_enabled && tim->is_enabled)
+    {
+        tim->counter = hal_emu_tim_counter_locked(tim, now);
+        tim->is_enabled = 0;
+        tim->stopped_ns = now;
+    }
+    pthread_mutex_unlock(&emu_lock);
+    hal_emu_wake();
+}
+
+void hal_emu_tim_enable_it(TIM_TypeDef *tim, uint32_t interrupt, uint32_t is_enabled)
+{
+    pthread_mutex_lock(&emu_lock);
+    if (interrupt & TIM_IT_UPDATE)
+    {
+        tim->is_update_it = is_enabled;
+    }
+    pthread_mutex_unlock(&emu_lock);
+    hal_emu_wake();
+}
+
+void hal_emu_tim_clear_flag(TIM_TypeDef *tim, uint32_t flag)
+{
+    pthread_mutex_lock(&emu_lock);
+    if (flag & TIM_FLAG_UPDATE)
+    {
+        tim->is_update_flag = 0;
+    }
+    pthread_mutex_unlock(&emu_lock);
+}
+
+// Set the update flag if TIM2 wrapped since it was last looked at
+static void hal_emu_tim2_advance_locked(int64_t now)
+{
+    TIM_TypeDef *tim = &hal_emu_tim2;
+    if (!tim->is_enabled)
+    {
+        return;
+    }
+    int64_t period_ns = hal_emu_tim_period_ns(tim);
+    if (now >= tim->period_start_ns + period_ns)
+    {
+        int64_t periods = (now - tim->period_start_ns) / period_ns;
+        tim->period_start_ns += periods * period_ns;
+        tim->is_update_flag = 1; // Several missed periods still raise one interrupt
+        tim2_update_ns = tim->period_start_ns;
+    }
+}
+
+static int64_t hal_emu_frame_ns(uint32_t identifier, uint8_t dlc)
+{
+    int64_t bits = ((identifier & CAN_ID_EXT) ? 67 : 47) + 8 * (int64_t)dlc; // Without stuff bits
+    return bits * bit_ns;
+}
+
+// Pass a frame that ended on the bus through the CAN2 filter banks into RX FIFO0
+static void hal_emu_receive_locked(const hal_emu_frame_t *frame)
+{
+    for (uint32_t bank = slave_start_filter_bank; bank < HAL_EMU_FILTER_BANKS; bank++)
+    {
+        const hal_emu_filter_bank_t *filter = &filter_banks[bank];
+        if (!filter->is_active || filter->fifo != CAN_RX_FIFO0 || ((frame->identifier ^ filter->id) & filter->mask) != 0)
+        {
+            continue;
+        }
+        if (rx_fifo_count == HAL_EMU_RX_FIFO_DEPTH)
+        {
+            rx_overruns++; // New frames are lost while the FIFO is full
+            is_rx_overrun_pending = (can_active_its & CAN_IT_RX_FIFO0_OVERRUN) != 0;
+            return;
+        }
+        rx_fifo[(rx_fifo_head + rx_fifo_count) % HAL_EMU_RX_FIFO_DEPTH] = *frame;
+        rx_fifo_count++;
+        rx_frames++;
+        return;
+    }
+    rx_filtered++;
+}
+
+// What HAL_CAN_IRQHandler does for the FIFO overrun flag, on the interrupt thread
+static void hal_emu_report_rx_overrun(void)
+{
+    pthread_mutex_lock(&emu_lock);
+    is_rx_overrun_pending = false;
+    pthread_mutex_unlock(&emu_lock);
+    hcan2.ErrorCode |= HAL_CAN_ERROR_RX_FOV0;
+    HAL_CAN_ErrorCallback(&hcan2);
+}
+
+static void hal_emu_bus_queue_push(const hal_emu_frame_t *frame)
+{
+    pthread_mutex_lock(&emu_lock);
+    if (bus_queue_count == HAL_EMU_BUS_QUEUE_LENGTH)
+    {
+        bus_queue_overruns++;
+    }
+    else
+    {
+        bus_queue[(bus_queue_head + bus_queue_count) % HAL_EMU_BUS_QUEUE_LENGTH] = *frame;
+        bus_queue_count++;
+    }
+    pthread_mutex_unlock(&emu_lock);
+}
+
+static void hal_emu_bus_read(void)
+{
+    for (;;)
+    {
+        hal_emu_frame_t frame;
+        if (is_socketcan)
+        {
+            struct can_frame can_frame;
+            if (read(bus_fd, &can_frame, sizeof(can_frame)) != (ssize_t)sizeof(can_frame))
+            {
+                return;
+            }
+            if (can_frame.can_id & CAN_EFF_FLAG)
+            {
+                frame.identifier = ((can_frame.can_id & CAN_EFF_MASK) << 3) | CAN_ID_EXT;
+            }
+            else
+            {
+                frame.identifier = (can_frame.can_id & CAN_SFF_MASK) << 21;
+            }
+            if (can_frame.can_id & CAN_RTR_FLAG)
+            {
+                frame.identifier |= HAL_EMU_RTR_BIT;
+            }
+            frame.dlc = can_frame.can_dlc;
+            memcpy(frame.data, can_frame.data, sizeof(frame.data));
+            frame.end_ns = hal_emu_now(); // The kernel delivers frames once they have ended
+        }
+        else
+        {
+            hal_emu_datagram_t datagram;
+            if (recv(bus_fd, &datagram, sizeof(datagram), 0) != (ssize_t)sizeof(datagram))
+            {
+                return;
+            }
+            if (datagram.sender == sender_token)
+            {
+                continue; // A controller does not receive its own frames
+            }
+            frame.identifier = datagram.identifier;
+            frame.dlc = datagram.dlc;
+            memcpy(frame.data, datagram.data, sizeof(frame.data));
+            frame.end_ns = datagram.end_ns;
+        }
+        hal_emu_bus_queue_push(&frame);
+    }
+}
+
+static void hal_emu_bus_write(const hal_emu_frame_t *frame)
+{
+    if (is_socketcan)
+    {
+        struct can_frame can_frame;
+        memset(&can_frame, 0, sizeof(can_frame));
+        if (frame->identifier & CAN_ID_EXT)
+        {
+            can_frame.can_id = (frame->identifier >> 3) | CAN_EFF_FLAG;
+        }
+        else
+        {
+            can_frame.can_id = frame->identifier >> 21;
+        }
+        can_frame.can_dlc = frame->dlc;
+        memcpy(can_frame.data, frame->data, sizeof(can_frame.data));
+        ssize_t written = write(bus_fd, &can_frame, sizeof(can_frame));
+        (void)written;
+    }
+    else
+    {
+        hal_emu_datagram_t datagram;
+        memset(&datagram, 0, sizeof(datagram));
+        datagram.sender = sender_token;
+        datagram.identifier = frame->identifier;
+        datagram.end_ns = frame->end_ns;
+        datagram.dlc = frame->dlc;
+        memcpy(datagram.data, frame->data, sizeof(datagram.data));
+        sendto(bus_fd, &datagram, sizeof(datagram), 0, (const struct sockaddr *)&bus_address, sizeof(bus_address));
+    }
+}
+
+static int hal_emu_bus_open(void)
+{
+    const char *interface = getenv("HAL_EMU_CAN_IF");
+    if (interface != NULL && *interface != '\0')
+    {
+        int fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+        struct sockaddr_can address;
+        memset(&address, 0, sizeof(address));
+        address.can_family = AF_CAN;
+        address.can_ifindex = (int)if_nametoindex(interface);
+        if (fd < 0 || address.can_ifindex == 0 || bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+        {
+            perror("hal_emu: SocketCAN");
+            return -1;
+        }
+        is_socketcan = true;
+        return fd;
+    }
+
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    unsigned char loop = 1;
+    struct ip_mreq membership;
+    memset(&bus_address, 0, sizeof(bus_address));
+    bus_address.sin_family = AF_INET;
+    bus_address.sin_port = htons((uint16_t)hal_emu_env("HAL_EMU_BUS_PORT", 47000));
+    bus_address.sin_addr.s_addr = htonl(INADDR_ANY);
+    membership.imr_multiaddr.s_addr = inet_addr(HAL_EMU_BUS_GROUP);
+    membership.imr_interface.s_addr = htonl(INADDR_LOOPBACK);
+    struct in_addr interface_address = {.s_addr = htonl(INADDR_LOOPBACK)};
+    if (fd < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+        bind(fd, (struct sockaddr *)&bus_address, sizeof(bus_address)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &interface_address, sizeof(interface_address)) < 0 ||
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0)
+    {
+        perror("hal_emu: multicast bus");
+        return -1;
+    }
+    bus_address.sin_addr.s_addr = membership.imr_multiaddr.s_addr;
+    return fd;
+}
+
+static void hal_emu_print_stat(const char *name, const hal_emu_stat_t *stat)
+{
+    double mean_us = stat->count ? (double)stat->total_ns / (double)stat->count / 1000.0 : 0.0;
+    fprintf(stderr, "  %-26s %10llu %12.2f %12.2f\n", name, (unsigned long long)stat->count, mean_us, (double)stat->max_ns / 1000.0);
+}
+
+static void hal_emu_report(void)
+{
+    fprintf(stderr, "%s: %.1f s, tick %lld ns, %lld bit/s\n", program_invocation_short_name,
+            (double)(hal_emu_now() - start_ns) / 1e9, (long long)tick_ns, (long long)(1000000000LL / bit_ns));
+    fprintf(stderr, "  %-26s %10s %12s %12s\n", "", "count", "mean us", "max us");
+    hal_emu_print_stat("TIM2 update latency", &tim2_latency);
+    hal_emu_print_stat("TIM2 update callback", &tim2_isr);
+    hal_emu_print_stat("TIM2 stopped for reload", &tim2_stopped);
+    hal_emu_print_stat("CAN RX FIFO0 latency", &rx_latency);
+    hal_emu_print_stat("CAN RX FIFO0 callback", &rx_isr);
+    fprintf(stderr, "  CAN TX frames %llu, mailboxes full %llu\n", (unsigned long long)tx_frames, (unsigned long long)tx_mailbox_full);
+    fprintf(stderr, "  CAN RX frames %llu, filtered %llu, FIFO0 overruns %llu, bus queue overruns %llu\n",
+            (unsigned long long)rx_frames, (unsigned long long)rx_filtered, (unsigned long long)rx_overruns,
+            (unsigned long long)bus_queue_overruns);
+    fprintf(stderr, "  LD1 toggles %u\n", hal_emu_gpiob.toggle_count);
+}
+
+static void hal_emu_stop(int signal_number)
+{
+    (void)signal_number;
+    is_stop_requested = 1;
+}
+
+// Raise the interrupts that are due, one at a time, and sleep until the next one
+static void *hal_emu_interrupt_main(void *arg)
+{
+    (void)arg;
+    prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&emu_lock);
+        int64_t now = hal_emu_now();
+        hal_emu_tim2_advance_locked(now);
+        while (bus_queue_count > 0 && bus_queue[bus_queue_head].end_ns <= now)
+        {
+            if (is_can_started)
+            {
+                hal_emu_receive_locked(&bus_queue[bus_queue_head]);
+            }
+            bus_queue_head = (bus_queue_head + 1) % HAL_EMU_BUS_QUEUE_LENGTH;
+            bus_queue_count--;
+        }
+
+        bool is_tim2_pending = hal_emu_tim2.is_update_it && hal_emu_tim2.is_update_flag;
+        bool is_rx_pending = (can_active_its & CAN_IT_RX_FIFO0_MSG_PENDING) && rx_fifo_count > 0;
+        bool is_error_pending = is_rx_overrun_pending;
+        int64_t tim2_due_ns = tim2_update_ns;
+        int64_t rx_due_ns = rx_fifo_count > 0 ? rx_fifo[rx_fifo_head].end_ns : 0;
+        if (is_tim2_pending)
+        {
+            hal_emu_tim2.is_update_flag = 0; // Cleared by HAL_TIM_IRQHandler before the callback
+        }
+
+        int64_t wake_ns = now + HAL_EMU_IDLE_WAIT_NS;
+        if (hal_emu_tim2.is_enabled && hal_emu_tim2.period_start_ns + hal_emu_tim_period_ns(&hal_emu_tim2) < wake_ns)
+        {
+            wake_ns = hal_emu_tim2.period_start_ns + hal_emu_tim_period_ns(&hal_emu_tim2);
+        }
+        if (bus_queue_count > 0 && bus_queue[bus_queue_head].end_ns < wake_ns)
+        {
+            wake_ns = bus_queue[bus_queue_head].end_ns;
+        }
+        pthread_mutex_unlock(&emu_lock);
+
+        if (is_stop_requested || (stop_ns != 0 && now >= stop_ns))
+        {
+            exit(0);
+        }
+
+        // Equal priority: TIM2 (IRQ 28) is taken before CAN2 RX0 (IRQ 64)
+        if (is_tim2_pending)
+        {
+            int64_t entry_ns = hal_emu_now();
+            HAL_TIM_PeriodElapsedCallback(&htim2);
+            hal_emu_record(&tim2_latency, entry_ns - tim2_due_ns);
+            hal_emu_record(&tim2_isr, hal_emu_now() - entry_ns);
+            continue;
+        }
+        if (is_rx_pending)
+        {
+            int64_t entry_ns = hal_emu_now();
+            HAL_CAN_RxFifo0MsgPendingCallback(&hcan2);
+            hal_emu_record(&rx_latency, entry_ns - rx_due_ns);
+            hal_emu_record(&rx_isr, hal_emu_now() - entry_ns);
+            if (is_error_pending)
+            {
+                hal_emu_report_rx_overrun(); // The same CAN2 RX0 interrupt, after the FIFO is served
+            }
+            continue;
+        }
+        if (is_error_pending)
+        {
+            hal_emu_report_rx_overrun();
+            continue;
+        }
+
+        if (stop_ns != 0 && stop_ns < wake_ns)
+        {
+            wake_ns = stop_ns;
+        }
+        int64_t wait_ns = wake_ns > now ? wake_ns - now : 0;
+        struct timespec timeout = {.tv_sec = wait_ns / 1000000000LL, .tv_nsec = wait_ns % 1000000000LL};
+        struct pollfd fds[2] = {{.fd = bus_fd, .events = POLLIN}, {.fd = wake_fd, .events = POLLIN}};
+        if (ppoll(fds, 2, &timeout, NULL) > 0)
+        {
+            if (fds[1].revents & POLLIN)
+            {
+                uint64_t count;
+                ssize_t bytes = read(wake_fd, &count, sizeof(count));
+                (void)bytes;
+            }
+            if (fds[0].revents & POLLIN)
+            {
+                hal_emu_bus_read();
+            }
+        }
+    }
+    return NULL;
+}
+
+HAL_StatusTypeDef HAL_Init(void)
+{
+    start_ns = hal_emu_now();
+    tick_ns = hal_emu_env("HAL_EMU_TICK_NS", 1000);
+    int64_t bitrate = hal_emu_env("HAL_EMU_BITRATE", 1000000);
+    int64_t seconds = hal_emu_env("HAL_EMU_SECONDS", 0);
+    if (tick_ns <= 0 || bitrate <= 0 || bitrate > 1000000000LL)
+    {
+        fprintf(stderr, "hal_emu: invalid HAL_EMU_TICK_NS or HAL_EMU_BITRATE\n");
+        exit(2);
+    }
+    bit_ns = 1000000000LL / bitrate;
+    stop_ns = seconds > 0 ? start_ns + seconds * 1000000000LL : 0;
+    sender_token = (uint32_t)getpid();
+
+    bus_fd = hal_emu_bus_open();
+    wake_fd = eventfd(0, EFD_NONBLOCK);
+    if (bus_fd < 0 || wake_fd < 0)
+    {
+        exit(2);
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = hal_emu_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    atexit(hal_emu_report);
+
+    // The interrupt thread keeps the normal policy, the main loop only runs when the CPU is idle
+    pthread_attr_t attributes;
+    struct sched_param parameters = {.sched_priority = 0};
+    pthread_attr_init(&attributes);
+    pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attributes, SCHED_OTHER);
+    pthread_attr_setschedparam(&attributes, &parameters);
+    if (pthread_create(&interrupt_thread, &attributes, hal_emu_interrupt_main, NULL) != 0)
+    {
+        perror("hal_emu: interrupt thread");
+        exit(2);
+    }
+    pthread_attr_destroy(&attributes);
+    sched_setscheduler(0, SCHED_IDLE, &parameters);
+    return HAL_OK;
+}
+
+void SystemClock_Config(void)
+{
+}
+
+void MX_GPIO_Init(void)
+{
+}
+
+void MX_TIM1_Init(void)
+{
+    htim1.Instance = &hal_emu_tim1;
+}
+
+void MX_TIM2_Init(void)
+{
+    htim2.Instance = TIM2;
+}
+
+void MX_DMA_Init(void)
+{
+}
+
+void MX_CAN_Init(void)
+{
+    hcan2.Instance = &hal_emu_can2;
+}
+
+void MX_USART3_UART_Init(void)
+{
+}
+
+void MX_USB_OTG_FS_PCD_Init(void)
+{
+}
+
+void MX_SPI_Init(void)
+{
+}
+
+void Error_Handler(void)
+{
+    fprintf(stderr, "hal_emu: Error_Handler called\n");
+    abort();
+}
+
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim)
+{
+    hal_emu_tim_enable_it(htim->Instance, TIM_IT_UPDATE, 1);
+    hal_emu_tim_enable(htim->Instance, 1);
+    return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+{
+    (void)htim;
+}
+
+HAL_StatusTypeDef HAL_CAN_ConfigFilter(CAN_HandleTypeDef *hcan, CAN_FilterTypeDef *sFilterConfig)
+{
+    (void)hcan;
+    if (sFilterConfig->FilterBank >= HAL_EMU_FILTER_BANKS || sFilterConfig->FilterMode != CAN_FILTERMODE_IDMASK ||
+        sFilterConfig->FilterScale != CAN_FILTERSCALE_32BIT)
+    {
+        return HAL_ERROR; // Only 32-bit mask mode is emulated
+    }
+
+    pthread_mutex_lock(&emu_lock);
+    hal_emu_filter_bank_t *filter = &filter_banks[sFilterConfig->FilterBank];
+    filter->id = (sFilterConfig->FilterIdHigh << 16) | (sFilterConfig->FilterIdLow & 0xFFFFU);
+    filter->mask = (sFilterConfig->FilterMaskIdHigh << 16) | (sFilterConfig->FilterMaskIdLow & 0xFFFFU);
+    filter->fifo = sFilterConfig->FilterFIFOAssignment;
+    filter->is_active = (sFilterConfig->FilterActivation == ENABLE);
+    slave_start_filter_bank = sFilterConfig->SlaveStartFilterBank;
+    pthread_mutex_unlock(&emu_lock);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_Start(CAN_HandleTypeDef *hcan)
+{
+    (void)hcan;
+    pthread_mutex_lock(&emu_lock);
+    is_can_started = true;
+    pthread_mutex_unlock(&emu_lock);
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_ActivateNotification(CAN_HandleTypeDef *hcan, uint32_t ActiveITs)
+{
+    (void)hcan;
+    pthread_mutex_lock(&emu_lock);
+    can_active_its |= ActiveITs;
+    pthread_mutex_unlock(&emu_lock);
+    hal_emu_wake();
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_AddTxMessage(CAN_HandleTypeDef *hcan, CAN_TxHeaderTypeDef *pHeader, uint8_t aData[], uint32_t *pTxMailbox)
+{
+    (void)hcan;
+    hal_emu_frame_t frame;
+    if (pHeader->IDE == CAN_ID_EXT)
+    {
+        frame.identifier = (pHeader->ExtId << 3) | CAN_ID_EXT;
+    }
+    else
+    {
+        frame.identifier = pHeader->StdId << 21;
+    }
+    frame.identifier |= (pHeader->RTR != CAN_RTR_DATA) ? HAL_EMU_RTR_BIT : 0;
+    frame.dlc = (uint8_t)(pHeader->DLC > 8 ? 8 : pHeader->DLC);
+    memset(frame.data, 0, sizeof(frame.data));
+    memcpy(frame.data, aData, frame.dlc);
+
+    pthread_mutex_lock(&emu_lock);
+    int64_t now = hal_emu_now();
+    int mailbox = -1;
+    for (int i = 0; i < HAL_EMU_TX_MAILBOXES && is_can_started; i++)
+    {
+        if (mailbox_free_ns[i] <= now)
+        {
+            mailbox = i;
+            break;
+        }
+    }
+    if (mailbox < 0)
+    {
+        tx_mailbox_full++;
+        pthread_mutex_unlock(&emu_lock);
+        return HAL_ERROR;
+    }
+    bus_free_ns = (bus_free_ns > now ? bus_free_ns : now) + hal_emu_frame_ns(frame.identifier, frame.dlc);
+    frame.end_ns = bus_free_ns;
+    mailbox_free_ns[mailbox] = frame.end_ns;
+    tx_frames++;
+    pthread_mutex_unlock(&emu_lock);
+
+    hal_emu_bus_write(&frame);
+    *pTxMailbox = 1U << mailbox;
+    return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_CAN_GetRxMessage(CAN_HandleTypeDef *hcan, uint32_t RxFifo, CAN_RxHeaderTypeDef *pHeader, uint8_t aData[])
+{
+    (void)hcan;
+    pthread_mutex_lock(&emu_lock);
+    if (RxFifo != CAN_RX_FIFO0 || rx_fifo_count == 0)
+    {
+        pthread_mutex_unlock(&emu_lock);
+        return HAL_ERROR;
+    }
+    hal_emu_frame_t frame = rx_fifo[rx_fifo_head];
+    rx_fifo_head = (rx_fifo_head + 1) % HAL_EMU_RX_FIFO_DEPTH;
+    rx_fifo_count--;
+    pthread_mutex_unlock(&emu_lock);
+
+    pHeader->IDE = frame.identifier & CAN_ID_EXT;
+    pHeader->StdId = (frame.identifier & CAN_ID_EXT) ? 0 : frame.identifier >> 21;
+    pHeader->ExtId = (frame.identifier & CAN_ID_EXT) ? frame.identifier >> 3 : 0;
+    pHeader->RTR = frame.identifier & HAL_EMU_RTR_BIT;
+    pHeader->DLC = frame.dlc;
+    pHeader->Timestamp = (uint32_t)(((frame.end_ns - start_ns) / tick_ns) & 0xFFFFU);
+    pHeader->FilterMatchIndex = 0;
+    memcpy(aData, frame.data, frame.dlc);
+    return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_CAN_RxFifo0MsgPendingCallback(CAN_HandleTypeDef *hcan)
+{
+    (void)hcan;
+}
+
+HAL_StatusTypeDef HAL_CAN_ResetError(CAN_HandleTypeDef *hcan)
+{
+    hcan->ErrorCode = HAL_CAN_ERROR_NONE;
+    return HAL_OK;
+}
+
+__attribute__((weak)) void HAL_CAN_ErrorCallback(CAN_HandleTypeDef *hcan)
+{
+    (void)hcan;
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+    (void)GPIO_Pin;
+    GPIOx->toggle_count++;
+}
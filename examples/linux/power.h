@@ -0,0 +1,14 @@
+/*
+ * power.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef POWER_H
+#define POWER_H
+
+#include "hal.h"
+
+// No power management on the host
+
+#endif
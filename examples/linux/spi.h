@@ -0,0 +1,14 @@
+/*
+ * spi.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef SPI_H
+#define SPI_H
+
+#include "hal.h"
+
+void MX_SPI_Init(void);
+
+#endif
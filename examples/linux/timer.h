@@ -0,0 +1,18 @@
+/*
+ * timer.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "hal.h"
+
+extern TIM_HandleTypeDef htim1;
+extern TIM_HandleTypeDef htim2;
+
+void MX_TIM1_Init(void);
+void MX_TIM2_Init(void);
+
+#endif
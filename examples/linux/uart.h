@@ -0,0 +1,14 @@
+/*
+ * uart.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef UART_H
+#define UART_H
+
+#include "hal.h"
+
+void MX_USART3_UART_Init(void);
+
+#endif
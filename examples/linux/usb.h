@@ -0,0 +1,14 @@
+/*
+ * usb.h
+ *
+ *  Linux emulation, see hal_emu.c.
+ */
+
+#ifndef USB_H
+#define USB_H
+
+#include "hal.h"
+
+void MX_USB_OTG_FS_PCD_Init(void);
+
+#endif
@@ -1,6 +1,110 @@
 #include <stdio.h>
 #include "gttcan.h"
 
+static void gttcan_begin(gttcan_t *gttcan, bool is_joining);
+static void gttcan_update_global_time(gttcan_t *gttcan, uint64_t reference_payload);
+static void gttcan_set_timer(gttcan_t *gttcan, uint32_t time);
+static void gttcan_load_timer(gttcan_t *gttcan, uint32_t time);
+static void gttcan_capture_event_time(gttcan_t *gttcan);
+static void gttcan_fire_pre_slot_hook(gttcan_t *gttcan);
+static void gttcan_step_slot_duration(gttcan_t *gttcan, int step);
+static void gttcan_record_lowest_seen_node_id(gttcan_t *gttcan, uint8_t node_id);
+static uint32_t gttcan_scale_slots(gttcan_t *gttcan, uint16_t from_slot_id, uint16_t to_slot_id, uint32_t slot_duration);
+static int gttcan_get_subscription_index(gttcan_t *gttcan, uint16_t data_id);
+static bool gttcan_is_sending_data(gttcan_t *gttcan, uint16_t local_schedule_index);
+static uint64_t gttcan_read_data_payload(gttcan_t *gttcan, uint16_t data_id);
+static bool gttcan_get_global_entry(gttcan_t *gttcan, uint16_t index, global_schedule_entry_t *entry);
+static bool gttcan_find_slot_entry(gttcan_t *gttcan, uint16_t slot_id, global_schedule_entry_t *entry);
+static uint64_t gttcan_get_bit_time(const gttcan_timing_params_t *params, uint64_t bits);
+static uint16_t gttcan_count_timer_loads(gttcan_t *gttcan);
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+static int gttcan_find_schedule_run(gttcan_t *gttcan, uint16_t slot_id);
+static uint16_t gttcan_count_run_local_slots(gttcan_t *gttcan, int run_index, uint16_t slot_count);
+static int gttcan_find_local_run(gttcan_t *gttcan, uint16_t local_schedule_index);
+static void gttcan_seek_local_run(gttcan_t *gttcan);
+static void gttcan_step_local_run(gttcan_t *gttcan);
+static local_schedule_entry_t gttcan_get_local_entry(gttcan_t *gttcan, uint16_t local_schedule_index);
+static local_schedule_entry_t gttcan_get_current_local_entry(gttcan_t *gttcan);
+// The local schedule is not stored, its entries are worked out from the runs
+#define GTTCAN_LOCAL_ENTRY(gttcan, index) gttcan_get_local_entry((gttcan), (index))
+#define GTTCAN_CURRENT_LOCAL_ENTRY(gttcan) gttcan_get_current_local_entry(gttcan)
+// Keep the position in the runs with local_schedule_index, searched for when it jumps
+#define GTTCAN_SEEK_LOCAL_RUN(gttcan) gttcan_seek_local_run(gttcan)
+#define GTTCAN_STEP_LOCAL_RUN(gttcan) gttcan_step_local_run(gttcan)
+#else
+static uint16_t gttcan_build_local_schedule(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr, uint16_t global_schedule_length, local_schedule_entry_t *local_schedule);
+#define GTTCAN_LOCAL_ENTRY(gttcan, index) ((gttcan)->local_schedule[(index)])
+#define GTTCAN_CURRENT_LOCAL_ENTRY(gttcan) ((gttcan)->local_schedule[(gttcan)->local_schedule_index])
+#define GTTCAN_SEEK_LOCAL_RUN(gttcan) ((void)0)
+#define GTTCAN_STEP_LOCAL_RUN(gttcan) ((void)0)
+#endif
+// Keeps the compiler from moving memory accesses across a hand-off with an interrupt
+#if defined(__GNUC__)
+#define GTTCAN_COMPILER_BARRIER() __asm__ volatile("" ::: "memory")
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#define GTTCAN_COMPILER_BARRIER() atomic_signal_fence(memory_order_seq_cst)
+#else
+#define GTTCAN_COMPILER_BARRIER() ((void)0)
+#endif
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+static void gttcan_apply_schedule_update(gttcan_t *gttcan, uint32_t cycle_count);
+static void gttcan_receive_schedule_update(gttcan_t *gttcan, uint64_t payload);
+static bool gttcan_get_schedule_update_frame(gttcan_t *gttcan, uint64_t *payload);
+static bool gttcan_prepare_schedule(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr, uint16_t global_schedule_length);
+static global_schedule_entry_t *gttcan_get_schedule_update_buffer(gttcan_t *gttcan);
+static void gttcan_clear_schedule_update(gttcan_t *gttcan);
+#endif
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+static uint8_t gttcan_get_backup_index(gttcan_t *gttcan, const global_schedule_entry_t *entry);
+static uint8_t gttcan_attribute_frame(gttcan_t *gttcan, uint8_t rx_node_id, uint16_t scheduled_data_id, uint16_t data_id);
+static bool gttcan_is_slot_used(gttcan_t *gttcan, uint16_t local_schedule_index);
+static uint16_t gttcan_get_used_slot_id(gttcan_t *gttcan, int local_schedule_index, int step, uint16_t default_slot_id);
+static uint16_t gttcan_skip_unused_slots(gttcan_t *gttcan, uint16_t local_schedule_index);
+#endif
+static uint16_t gttcan_get_resync_index(gttcan_t *gttcan, uint16_t slot_id);
+#if GTTCAN_ENABLE_ON_DEMAND
+static bool gttcan_take_on_demand_message(gttcan_t *gttcan, uint16_t *data_id, uint64_t *data);
+#endif
+#if GTTCAN_ENABLE_TIMER_MUX
+static void gttcan_timer_mux_schedule(gttcan_timer_mux_t *mux, uint8_t index, uint32_t time);
+#endif
+#if GTTCAN_ENABLE_GATEWAY
+static uint32_t gttcan_get_slot_start(gttcan_t *gttcan, uint16_t slot_id);
+static bool gttcan_gateway_get_route_latency(gttcan_gateway_t *gateway, const gttcan_gateway_route_t *route, uint32_t phase, uint32_t *latency);
+#endif
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+static void gttcan_transmit_on_channels(gttcan_t *gttcan, local_schedule_entry_t entry, uint32_t frame_id, uint16_t data_id, uint64_t payload);
+#endif
+#if GTTCAN_ENABLE_FTA_SYNC
+static void gttcan_record_fta_frame(gttcan_t *gttcan, uint8_t node_id, uint16_t slot_id);
+static int gttcan_get_fta_correction(gttcan_t *gttcan);
+#endif
+#if GTTCAN_ENABLE_DATA_METRICS
+static void gttcan_update_data_metrics(gttcan_t *gttcan, uint16_t slot_id, uint16_t data_id);
+static uint32_t gttcan_count_missed_updates(const gttcan_data_metrics_state_t *state, uint32_t cycle_count);
+#endif
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+static uint8_t gttcan_get_entry_dlc(const global_schedule_entry_t *entry);
+static void gttcan_build_slot_start_offsets(global_schedule_ptr_t global_schedule_ptr, uint16_t global_schedule_length, uint32_t *slot_start_offset);
+#endif
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+static void gttcan_request_resync(gttcan_t *gttcan, uint16_t slot_id, bool has_cycle_count, uint32_t cycle_count);
+static bool gttcan_apply_resync(gttcan_t *gttcan);
+static bool gttcan_rearm_if_early(gttcan_t *gttcan);
+// The timer interrupt may preempt frame processing, so each keeps its own event time
+#define GTTCAN_RX_EVENT_LOCAL_TIME rx_event_local_time
+#else
+#define GTTCAN_RX_EVENT_LOCAL_TIME event_local_time
+#endif
+
+#if GTTCAN_ENABLE_TRACE
+static void gttcan_trace(gttcan_t *gttcan, gttcan_trace_type_t type, uint32_t arg, uint64_t data);
+#define GTTCAN_TRACE(gttcan, type, arg, data) gttcan_trace((gttcan), (type), (arg), (data))
+#else
+#define GTTCAN_TRACE(gttcan, type, arg, data) ((void)0)
+#endif
+
 /**
  * @brief Initialize a G-TTCAN instance with configuration parameters and callbacks
  * 
@@ -31,7 +135,8 @@
  * @note The slot_duration must be set to a value that is suitable for the network and hardware
  *          capabilities, and must be larger than the time it takes for transmission of a can frame.
  *          Reccomended slot duration is AT LEAST 1.5 times the time it takes to transmit a CAN frame, 
- *          to allow for processing time and some margin for error.
+ *          to allow for processing time and some margin for error. gttcan_configure_timing() can work it
+ *          out from measured timing instead.
  * 
  */
 void gttcan_init(
@@ -48,20 +153,86 @@ void gttcan_init(
     bool dynamic_slot_duration_correction
 ) {
     gttcan->is_active = false;
+    gttcan->is_joining = false;
+    gttcan->is_recovering = false;
+    gttcan->is_waiting_for_reference = false;
+    gttcan->recovery_slot_count = 0;
+    gttcan->error_counters = (gttcan_error_counters_t){0};
     gttcan->node_id = node_id;
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    // global_schedule_length counts runs, and the round ends with the last one
+    gttcan->schedule_run_count = (global_schedule_length < GTTCAN_MAX_SCHEDULE_RUNS) ? global_schedule_length : GTTCAN_MAX_SCHEDULE_RUNS;
+    gttcan->global_schedule_length = 0;
+    if (gttcan->schedule_run_count > 0)
+    {
+        const gttcan_schedule_run_t *last_run = &global_schedule_ptr[gttcan->schedule_run_count - 1];
+        gttcan->global_schedule_length = last_run->first_slot_id + last_run->slot_count;
+    }
+#else
     gttcan->global_schedule_length = global_schedule_length;
+#endif
     gttcan->slot_duration = slot_duration;
     gttcan->local_schedule_index = 0;
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    gttcan->local_schedule_run = 0; // Sought once the runs are read in gttcan_get_local_schedule()
+    gttcan->local_run_base = 0;
+    gttcan->local_run_offset = 0;
+#endif
     gttcan->interrupt_timing_offset = interrupt_timing_offset;
 
     gttcan->global_schedule_ptr = global_schedule_ptr;
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    gttcan->slot_backups = NULL;
+    gttcan->slot_backup_count = 0;
+#endif
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    gttcan->local_schedule = gttcan->local_schedule_buffers[0];
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    gttcan->slot_start_offset = gttcan->slot_start_offset_buffers[0];
+#endif
+    gttcan->schedule_version = 0;
+    gttcan->schedule_switch_cycle_count = 0;
+    gttcan->schedule_update_buffers[0] = NULL;
+    gttcan->schedule_update_buffers[1] = NULL;
+    gttcan->schedule_update_capacity = 0;
+    gttcan->is_schedule_stale = false;
+    gttcan->update_version = 0;
+    gttcan->update_stream_position = 0;
+    gttcan->update_generation = 0;
+    gttcan->is_preparing_update = false;
+    gttcan_clear_schedule_update(gttcan);
+#endif
     gttcan_get_local_schedule(gttcan, global_schedule_ptr);
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    gttcan_get_slot_start_offsets(gttcan, global_schedule_ptr);
+    gttcan->bit_time = 0;
+    gttcan->transmit_dlc = GTTCAN_MAX_DLC;
+#endif
 
     gttcan->transmit_frame_callback_fp = transmit_frame_callback_fp;
     gttcan->set_timer_int_callback_fp = set_timer_int_callback_fp;
     gttcan->read_value_fp = read_value_fp;
     gttcan->write_value_fp = write_value_fp;
 
+    gttcan->frame_layouts = NULL;
+    gttcan->frame_layout_count = 0;
+
+    gttcan->subscribed_data_ids = NULL;
+    gttcan->subscription_count = 0;
+
+#if GTTCAN_ENABLE_DATA_METRICS
+    gttcan->reference_slot_id = 0;
+    gttcan->reference_slot_start = 0;
+    gttcan->reference_cycle_count = 0;
+    gttcan->has_reference_slot = false;
+    gttcan->nominal_slot_duration = slot_duration;
+#endif
+
+    gttcan->pre_slot_hook_fp = NULL;
+    gttcan->post_slot_hook_fp = NULL;
+    gttcan->pre_slot_lead_time = 0;
+    gttcan->is_pre_slot_pending = false;
+
     gttcan->is_initialised = true;
 
     gttcan->slot_duration_offset = 0;
@@ -72,6 +243,59 @@ void gttcan_init(
 
     gttcan->rounds_without_shuffling_against_master = 0;
     gttcan->dynamic_slot_duration_correction = dynamic_slot_duration_correction;
+
+#if GTTCAN_ENABLE_FTA_SYNC
+    gttcan->fta_sender_count = 0;
+    gttcan->fta_epoch = 0;
+#endif
+
+    gttcan->get_local_time_fp = NULL;
+    gttcan->cycle_count = 0;
+    gttcan->global_time_reference = 0;
+    gttcan->local_time_reference = 0;
+    gttcan->global_time_rate = 1UL << GTTCAN_RATE_FRACTIONAL_BITS;
+    gttcan->has_global_time_reference = false;
+    gttcan->event_local_time = 0;
+    gttcan->timer_due_local_time = 0;
+    gttcan->reference_local_time = 0;
+
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+    atomic_init(&gttcan->resync_sequences[0], 0);
+    atomic_init(&gttcan->resync_sequences[1], 0);
+    atomic_init(&gttcan->resync_request_count, 0);
+    gttcan->resync_applied_count = 0;
+    atomic_init(&gttcan->slot_duration_step, 0);
+    gttcan->rx_event_local_time = 0;
+#endif
+
+#if GTTCAN_ENABLE_ON_DEMAND
+    for (int i = 0; i < GTTCAN_ON_DEMAND_QUEUE_LENGTH; i++)
+    {
+        gttcan->on_demand_queue[i].is_queued = false;
+    }
+    gttcan->on_demand_sequence = 0;
+#endif
+
+#if GTTCAN_ENABLE_GATEWAY
+    gttcan->round_start_local_time = 0;
+    gttcan->has_round_start = false;
+#endif
+
+#if GTTCAN_ENABLE_TIMER_MUX
+    gttcan->timer_mux = NULL;
+    gttcan->timer_mux_index = 0;
+#endif
+
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+    gttcan->transmit_frame_b_callback_fp = NULL;
+    gttcan->has_last_reference = false;
+    gttcan->last_reference_slot_id = 0;
+    gttcan->last_reference_payload = 0;
+#endif
+
+#if GTTCAN_ENABLE_TRACE
+    gttcan->trace_count = 0;
+#endif
 }
 
 /**
@@ -91,13 +315,252 @@ void gttcan_init(
  * @note After startup delay, the node will begin transmitting according to its local schedule
  */
 void gttcan_start(gttcan_t *gttcan)
+{
+    gttcan_begin(gttcan, false);
+}
+
+/**
+ * @brief Start G-TTCAN by listening for a running network and joining it mid-round
+ * 
+ * Behaves like gttcan_start(), but the node first listens to the bus. The first received
+ * frame whose slot_id appears in the global schedule (a reference frame or any other
+ * scheduled frame) tells the node where the network currently is, so it moves to the next
+ * entry in its local schedule and arms its timer from that frame, joining within the
+ * current round. The cold-start delay of gttcan_start() is only used if the bus stays silent.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * 
+ * @note gttcan_init() must be called successfully before this function
+ * @note Intended for nodes (re)starting on a bus that may already be running, e.g. after a
+ *          watchdog reset, so they rejoin within a few slots instead of waiting a full round
+ * @note If no frame is received before the cold-start delay expires, the node starts exactly
+ *          as it would have with gttcan_start()
+ */
+void gttcan_join(gttcan_t *gttcan)
+{
+    gttcan_begin(gttcan, true);
+}
+
+/**
+ * @brief Activate the node and arm the cold-start timer
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param is_joining Whether to listen for a running network before the cold-start delay expires
+ */
+static void gttcan_begin(gttcan_t *gttcan, bool is_joining)
 {
     gttcan->is_active = true;
+    gttcan->is_joining = is_joining;
+    gttcan->is_recovering = false;
+    gttcan->is_waiting_for_reference = false;
     gttcan->local_schedule_index = 0;
+    GTTCAN_SEEK_LOCAL_RUN(gttcan);
     gttcan->is_time_master = false;
     gttcan->last_lowest_seen_node_id = gttcan->node_id;
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+    gttcan->resync_applied_count = atomic_load(&gttcan->resync_request_count);
+    atomic_store(&gttcan->slot_duration_step, 0);
+#endif
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    for (int i = 0; i < gttcan->slot_backup_count; i++)
+    {
+        gttcan->owner_silent_rounds[i] = 0; // Owners are assumed present until proven silent
+    }
+#endif
+    gttcan_capture_event_time(gttcan);
+    GTTCAN_TRACE(gttcan, GTTCAN_TRACE_START, is_joining, gttcan->slot_duration);
     uint32_t start_up_wait_time = ((gttcan->global_schedule_length + (gttcan->node_id * DEFAULT_STARTUP_PAUSE_SLOTS)) * gttcan->slot_duration);
-    gttcan->set_timer_int_callback_fp(start_up_wait_time);
+    gttcan_set_timer(gttcan, start_up_wait_time);
+}
+
+/**
+ * @brief Report a bus error seen by the CAN driver, and resynchronise before transmitting again
+ * 
+ * After bus-off, a failed transmission or lost received frames, the node can no longer be
+ * sure where the network is, and its timer driven frames could land in other nodes' slots.
+ * It stops transmitting but keeps its timer running, and, as in gttcan_join(), the first
+ * scheduled frame it receives places it in the current round, so it transmits again from
+ * its next slot. If nothing scheduled is heard for a round of its own slots, the bus is
+ * taken to be silent and the node goes on transmitting with its own timing.
+ * 
+ * @param gttcan Pointer to active gttcan_t structure
+ * @param error What the driver saw
+ * 
+ * @note Call from the CAN error interrupt, at the priority of the other G-TTCAN interrupts
+ * @note Another error during a recovery restarts the round it waits for
+ * @note Errors are counted even before gttcan_start(), but only an active node recovers
+ */
+void gttcan_report_error(gttcan_t *gttcan, gttcan_error_t error)
+{
+    gttcan_capture_event_time(gttcan);
+    GTTCAN_TRACE(gttcan, GTTCAN_TRACE_ERROR, error, gttcan->local_schedule_index);
+
+    switch (error)
+    {
+        case GTTCAN_ERROR_BUS_OFF:
+            gttcan->error_counters.bus_off_count++;
+            break;
+        case GTTCAN_ERROR_TX:
+            gttcan->error_counters.tx_error_count++;
+            break;
+        case GTTCAN_ERROR_RX_OVERRUN:
+            gttcan->error_counters.rx_overrun_count++;
+            break;
+    }
+
+    if (gttcan->is_active)
+    {
+        gttcan->recovery_slot_count = 0;
+        gttcan->is_recovering = true;
+    }
+}
+
+/**
+ * @brief Read the error and recovery counts of a node
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param counters Receives the counts since gttcan_init()
+ */
+void gttcan_get_error_counters(gttcan_t *gttcan, gttcan_error_counters_t *counters)
+{
+    *counters = gttcan->error_counters;
+}
+
+/**
+ * @brief Work out how long the node can sleep before anything that matters to it happens
+ * 
+ * The next activity is the earliest of the node's next own slot, the next reference frame
+ * and the next frame of another node whose data_id it subscribes to. Everything else on
+ * the bus can be missed, so the platform may stop the CPU, or enter a deeper sleep, until
+ * then. The node's next own or reference slot is where its timer is due, and the slots of
+ * other nodes before it are checked against the subscriptions.
+ * 
+ * @param gttcan Pointer to active gttcan_t structure
+ * @param activity Receives what the node does at that time, may be NULL
+ * 
+ * @return Time in system time units until the activity, or 0 if it is due, under way or
+ *          the node must stay awake
+ * 
+ * @note Needs get_local_time_fp, see gttcan_set_local_time_callback(), and returns 0 without it
+ * @note Returns 0 with GTTCAN_ACTIVITY_LISTEN while the node is stopped, joining or recovering,
+ *          as it does not know where it is in the round
+ * @note Without a subscription list every frame is subscribed, so only the gaps between
+ *          frames are left to sleep in
+ * @note Until the reference frame of a reference slot that has started is received, the
+ *          node stays awake for it, up to its next own slot
+ * @note Linear in the number of slots up to the node's next own slot, so call it from the
+ *          main loop rather than an interrupt
+ * @note Works from the node's place in the round and its timer, and starts over if the timer
+ *          interrupt changes them meanwhile
+ * @note Frames of other nodes can start early by the precision of the network, so wake up
+ *          that much, plus the platform's own wake-up time, before the activity
+ */
+uint32_t gttcan_get_time_to_next_activity(gttcan_t *gttcan, gttcan_activity_t *activity)
+{
+    gttcan_activity_t next_activity = GTTCAN_ACTIVITY_LISTEN;
+    uint32_t time_to_next_activity = 0;
+
+    if (gttcan->is_active && !gttcan->is_joining && !gttcan->is_recovering &&
+        gttcan->get_local_time_fp != NULL && gttcan->local_schedule_length > 0)
+    {
+        // The timer interrupt may move us on or fire the pre-slot hook while we work, so start
+        // again if it did
+        uint16_t local_schedule_index;
+        uint32_t next_slot_start;
+        bool is_pre_slot_pending;
+        do
+        {
+            uint32_t local_time = gttcan->get_local_time_fp();
+            local_schedule_index = gttcan->local_schedule_index;
+            uint16_t previous_index = (local_schedule_index > 0) ? local_schedule_index - 1 : gttcan->local_schedule_length - 1;
+            local_schedule_entry_t next_entry = GTTCAN_LOCAL_ENTRY(gttcan, local_schedule_index);
+            local_schedule_entry_t previous_entry = GTTCAN_LOCAL_ENTRY(gttcan, previous_index);
+            uint16_t previous_slot_id = previous_entry.slot_id;
+
+            // The timer is due at the start of our next slot, our previous one started a gap earlier
+            next_slot_start = gttcan->timer_due_local_time;
+            uint32_t previous_slot_start = next_slot_start - gttcan_get_time_between_slots(gttcan, previous_slot_id, next_entry.slot_id);
+            uint32_t activity_start = next_slot_start - gttcan->interrupt_timing_offset; // When the timer interrupt comes
+            is_pre_slot_pending = gttcan->is_pre_slot_pending;
+            if (is_pre_slot_pending)
+            {
+                activity_start -= gttcan->pre_slot_lead_time; // The timer fires early for the pre-slot hook
+            }
+            next_activity = (next_entry.data_id == REFERENCE_FRAME_DATA_ID) ? GTTCAN_ACTIVITY_REFERENCE : GTTCAN_ACTIVITY_TRANSMIT;
+
+            // The master's reference frame can come after our timer interrupt for its slot, so wait for it
+            bool is_reference_due = previous_entry.data_id == REFERENCE_FRAME_DATA_ID && !gttcan->is_time_master &&
+                                    (int32_t)(gttcan->reference_local_time - (previous_slot_start - gttcan->slot_duration)) < 0;
+            if (is_reference_due)
+            {
+                activity_start = previous_slot_start;
+                next_activity = GTTCAN_ACTIVITY_REFERENCE;
+            }
+
+            // Otherwise other nodes' slots up to our next one, the first subscribed one that has not ended is the activity
+            for (uint16_t slot_id = (previous_slot_id + 1) % gttcan->global_schedule_length;
+                 !is_reference_due && slot_id != next_entry.slot_id;
+                 slot_id = (slot_id + 1) % gttcan->global_schedule_length)
+            {
+                global_schedule_entry_t entry;
+                if (!gttcan_find_slot_entry(gttcan, slot_id, &entry))
+                {
+                    continue;
+                }
+                bool is_subscribed = entry.node_id != 0 && gttcan_is_subscribed(gttcan, entry.data_id);
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+                is_subscribed = is_subscribed || (entry.node_id_b != 0 && gttcan_is_subscribed(gttcan, entry.data_id_b));
+#endif
+                uint32_t slot_start = previous_slot_start + gttcan_get_time_between_slots(gttcan, previous_slot_id, slot_id);
+                if (is_subscribed && (int32_t)(slot_start + gttcan->slot_duration - local_time) > 0)
+                {
+                    activity_start = slot_start;
+                    next_activity = GTTCAN_ACTIVITY_RECEIVE;
+                    break;
+                }
+            }
+
+            int32_t time_to_activity_start = (int32_t)(activity_start - local_time);
+            time_to_next_activity = (time_to_activity_start > 0) ? (uint32_t)time_to_activity_start : 0;
+            GTTCAN_COMPILER_BARRIER();
+        } while (gttcan->local_schedule_index != local_schedule_index || gttcan->timer_due_local_time != next_slot_start ||
+                 gttcan->is_pre_slot_pending != is_pre_slot_pending);
+    }
+
+    if (activity != NULL)
+    {
+        *activity = next_activity;
+    }
+    return time_to_next_activity;
+}
+
+/**
+ * @brief Resynchronise on the next reference frame after the node slept through part of the round
+ * 
+ * Call on waking from a sleep that stopped the CAN controller, or anything else that may
+ * have lost frames or timer expiries, so the node's place in the round can no longer be
+ * trusted. The node keeps its timer running but sends nothing until it receives a
+ * reference frame, which places it in the round and re-arms its timer exactly as it does
+ * for a node that stayed awake. Data frames do not place it, as they only show where
+ * their sender thinks the round is. If no reference frame is heard for a round of its
+ * own slots, the node goes on transmitting with its own timing, as after
+ * gttcan_report_error().
+ * 
+ * @param gttcan Pointer to active gttcan_t structure
+ * 
+ * @note Not needed if the timer and the CAN controller kept running while the CPU slept
+ * @note Sleep until a GTTCAN_ACTIVITY_REFERENCE from gttcan_get_time_to_next_activity()
+ *          so the node transmits again from the slot after it
+ * @note Counted as a recovery in the error counters, but not as an error
+ */
+void gttcan_resume_after_sleep(gttcan_t *gttcan)
+{
+    if (gttcan->is_active)
+    {
+        gttcan->recovery_slot_count = 0;
+        gttcan->is_waiting_for_reference = true;
+        gttcan->is_recovering = true;
+    }
 }
 
 /**
@@ -112,7 +575,10 @@ void gttcan_start(gttcan_t *gttcan)
  * @note Must be called from timer interrupt context
  * @note Automatically constructs extended CAN frame header from slot_id and data_id from schedule
  * @note Data payload is retrieved by calling read_value_fp with the data_id from the schedule
+ * @note With GTTCAN_ENABLE_ON_DEMAND, preemptible and pool slots carry the most urgent queued on-demand message instead
  * @note Reference frames are only transmitted by the current time master
+ * @note With GTTCAN_ENABLE_DUAL_CHANNEL, the frames of both channels in the slot are sent from this one interrupt
+ * @note While recovering from an error reported with gttcan_report_error(), the timer keeps running but nothing is sent
  * @note Updates master election state and schedules next transmission via timer callback
  */
 void gttcan_transmit_next_frame(gttcan_t *gttcan)
@@ -122,16 +588,105 @@ void gttcan_transmit_next_frame(gttcan_t *gttcan)
         return;
     }
 
-    uint16_t slot_id = gttcan->local_schedule[gttcan->local_schedule_index].slot_id;
-    uint16_t data_id = gttcan->local_schedule[gttcan->local_schedule_index].data_id;
+    gttcan_capture_event_time(gttcan);
+
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+    // Take up a resynchronisation posted by gttcan_process_frame(), and re-arm for expiries that are not due yet
+    if (gttcan_apply_resync(gttcan) || gttcan_rearm_if_early(gttcan))
+    {
+        return;
+    }
+#endif
+
+    if (gttcan->is_pre_slot_pending)
+    {
+        gttcan_fire_pre_slot_hook(gttcan);
+        return;
+    }
+
+    // Nothing was heard while joining, so the bus is silent and we cold-start
+    gttcan->is_joining = false;
+
+    // Keep time through a recovery, but stay off the bus until a scheduled frame places us again
+    bool is_suspended = gttcan->is_recovering;
+    if (is_suspended)
+    {
+        gttcan->error_counters.suspended_slot_count++;
+        if (++gttcan->recovery_slot_count >= gttcan->local_schedule_length)
+        {
+            gttcan->is_recovering = false; // A round without a scheduled frame, so the bus is silent
+            gttcan->is_waiting_for_reference = false;
+            gttcan->error_counters.timeout_count++;
+        }
+    }
+
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    if (gttcan->local_schedule_index == 0)
+    {
+        gttcan_apply_schedule_update(gttcan, gttcan->cycle_count + 1);
+    }
+#endif
+
+    local_schedule_entry_t entry = GTTCAN_CURRENT_LOCAL_ENTRY(gttcan);
+    uint16_t slot_id = entry.slot_id;
+    uint16_t data_id = entry.data_id;
+    bool is_sending_data = !is_suspended && gttcan_is_sending_data(gttcan, gttcan->local_schedule_index);
+#if GTTCAN_ENABLE_ON_DEMAND
+    uint64_t on_demand_payload = 0;
+    bool is_sending_on_demand = is_sending_data && entry.policy != GTTCAN_SLOT_FIXED &&
+                                gttcan_take_on_demand_message(gttcan, &data_id, &on_demand_payload);
+    if (entry.policy == GTTCAN_SLOT_POOL && !is_sending_on_demand)
+    {
+        is_sending_data = false; // Nothing queued, so the pool slot stays silent
+    }
+#endif
+    GTTCAN_TRACE(gttcan, GTTCAN_TRACE_TIMER_EXPIRED, gttcan->local_schedule_index, slot_id);
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    gttcan->transmit_dlc = entry.dlc;
+#endif
 
     if (gttcan->local_schedule_index == 0){
-        gttcan->is_time_master = (gttcan->last_lowest_seen_node_id == gttcan->current_lowest_seen_node_id) && (gttcan->current_lowest_seen_node_id == gttcan->node_id);
-        gttcan->last_lowest_seen_node_id = gttcan->current_lowest_seen_node_id;
+        gttcan->cycle_count++;
+#if GTTCAN_ENABLE_GATEWAY
+        gttcan->round_start_local_time = gttcan->event_local_time - gttcan_get_slot_start(gttcan, slot_id);
+        gttcan->has_round_start = gttcan->get_local_time_fp != NULL;
+#endif
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+        uint8_t lowest_seen_node_id = atomic_exchange(&gttcan->current_lowest_seen_node_id, 0);
+#else
+        uint8_t lowest_seen_node_id = gttcan->current_lowest_seen_node_id;
         gttcan->current_lowest_seen_node_id = 0;
+#endif
+        gttcan->is_time_master = (gttcan->last_lowest_seen_node_id == lowest_seen_node_id) && (lowest_seen_node_id == gttcan->node_id);
+        gttcan->last_lowest_seen_node_id = lowest_seen_node_id;
+        GTTCAN_TRACE(gttcan, GTTCAN_TRACE_MASTER_DECISION, gttcan->is_time_master, gttcan->last_lowest_seen_node_id);
+#if GTTCAN_ENABLE_FTA_SYNC
+        if (gttcan->get_local_time_fp != NULL)
+        {
+            int correction = gttcan_get_fta_correction(gttcan);
+            if (!gttcan->is_time_master)
+            {
+                gttcan->slot_duration_offset += correction; // Applied with the slot 0 reference frame
+            }
+        }
+#endif
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+        for (int i = 0; i < gttcan->slot_backup_count; i++)
+        {
+            if (gttcan->owner_silent_rounds[i] < UINT8_MAX)
+            {
+                gttcan->owner_silent_rounds[i]++; // Reset whenever the owner is heard
+            }
+        }
+#endif
     }
 
     gttcan->local_schedule_index++;
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    // Don't wake up for slots that are left to their owner this round
+    gttcan->local_schedule_index = gttcan_skip_unused_slots(gttcan, gttcan->local_schedule_index);
+#endif
+    GTTCAN_STEP_LOCAL_RUN(gttcan);
     if (gttcan->local_schedule_index >= gttcan->local_schedule_length)
     {
         gttcan->local_schedule_index = 0;
@@ -144,9 +699,14 @@ void gttcan_transmit_next_frame(gttcan_t *gttcan)
 
     uint32_t time_to_next_transmission = gttcan_get_time_to_next_transmission(slot_id, gttcan);
 
-    gttcan->set_timer_int_callback_fp(time_to_next_transmission);
+    gttcan_set_timer(gttcan, time_to_next_transmission);
+
+    if (is_suspended)
+    {
+        return; // Nothing sent, so not seen on the bus either
+    }
 
-    uint32_t ext_frame_header = ((uint32_t)slot_id << GTTCAN_NUM_DATA_ID_BITS) | data_id;
+    uint32_t frame_id = gttcan_build_frame_id(slot_id, data_id);
 
     int ISTIMEMASTER;
     if (gttcan->is_time_master){
@@ -155,17 +715,70 @@ void gttcan_transmit_next_frame(gttcan_t *gttcan)
         ISTIMEMASTER = 3;
     }
 
-    uint64_t data_payload = gttcan->read_value_fp(data_id);
-
-    if (data_id != REFERENCE_FRAME_DATA_ID || gttcan->is_time_master)
+    if (data_id == REFERENCE_FRAME_DATA_ID)
+    {
+        if (gttcan->is_time_master)
+        {
+            // The master's network time continues from its last reference, re-anchored on every reference frame
+            uint32_t global_time = 0;
+            if (gttcan->get_local_time_fp != NULL)
+            {
+                global_time = gttcan_local_to_global_time(gttcan, gttcan->event_local_time);
+                gttcan->global_time_reference = global_time;
+                gttcan->local_time_reference = gttcan->event_local_time;
+            }
+            uint64_t reference_payload = ((uint64_t)gttcan->cycle_count << GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT) | global_time;
+#if GTTCAN_ENABLE_FTA_SYNC
+            gttcan->fta_epoch++;
+#endif
+#if GTTCAN_ENABLE_DATA_METRICS
+            gttcan->reference_slot_id = slot_id;
+            gttcan->reference_slot_start = global_time;
+            gttcan->reference_cycle_count = gttcan->cycle_count;
+            gttcan->has_reference_slot = true;
+#endif
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+            gttcan_transmit_on_channels(gttcan, entry, frame_id, data_id, reference_payload);
+#else
+            GTTCAN_TRACE(gttcan, GTTCAN_TRACE_FRAME_SENT, frame_id, reference_payload);
+            gttcan->transmit_frame_callback_fp(frame_id, reference_payload);
+#endif
+        }
+    }
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    else if (data_id == GTTCAN_SCHEDULE_UPDATE_DATA_ID)
     {
-        gttcan->transmit_frame_callback_fp(ext_frame_header, data_payload); 
+        uint64_t update_payload;
+        if (gttcan->is_time_master && gttcan_get_schedule_update_frame(gttcan, &update_payload))
+        {
+            GTTCAN_TRACE(gttcan, GTTCAN_TRACE_FRAME_SENT, frame_id, update_payload);
+            gttcan->transmit_frame_callback_fp(frame_id, update_payload);
+        }
     }
-
-    if (gttcan->node_id < gttcan->current_lowest_seen_node_id || gttcan->current_lowest_seen_node_id == 0)
+#endif
+#if GTTCAN_ENABLE_ON_DEMAND
+    else if (is_sending_on_demand)
     {
-        gttcan->current_lowest_seen_node_id = gttcan->node_id;
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+        gttcan_transmit_on_channels(gttcan, entry, frame_id, data_id, on_demand_payload);
+#else
+        GTTCAN_TRACE(gttcan, GTTCAN_TRACE_FRAME_SENT, frame_id, on_demand_payload);
+        gttcan->transmit_frame_callback_fp(frame_id, on_demand_payload);
+#endif
     }
+#endif
+    else if (is_sending_data)
+    {
+        uint64_t data_payload = gttcan_read_data_payload(gttcan, data_id);
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+        gttcan_transmit_on_channels(gttcan, entry, frame_id, data_id, data_payload);
+#else
+        GTTCAN_TRACE(gttcan, GTTCAN_TRACE_FRAME_SENT, frame_id, data_payload);
+        gttcan->transmit_frame_callback_fp(frame_id, data_payload);
+#endif
+    }
+
+    gttcan_record_lowest_seen_node_id(gttcan, gttcan->node_id);
 }
 
 /**
@@ -176,7 +789,8 @@ void gttcan_transmit_next_frame(gttcan_t *gttcan)
  * and stores received data via the write_value callback.
  * 
  * @param gttcan Pointer to gttcan_t structure
- * @param can_frame_id 29-bit extended CAN frame identifier containing slot_id and data_id from the received CAN frame
+ * @param can_frame_id 29-bit extended CAN frame identifier containing slot_id and data_id from the received CAN frame,
+ *          or the 11-bit standard identifier containing slot_id if GTTCAN_USE_STANDARD_FRAME_ID is set
  * @param data 64-bit data payload from the received CAN frame
  * 
  * @note Should be called for every received CAN frame on the bus
@@ -186,32 +800,156 @@ void gttcan_transmit_next_frame(gttcan_t *gttcan)
  * @note Updates master election by tracking lowest node IDs seen in consecutive rounds
  * @note If the node is not initialized, this function does nothing. This is to prevent 
  *          processing frames before the G-TTCAN instance is fully set up, if the interrupt handler fires before gttcan_start() is called.
+ * @note With GTTCAN_ENABLE_DUAL_CHANNEL, this is for frames received on channel A
  */
 void gttcan_process_frame(gttcan_t *gttcan, uint32_t can_frame_id, uint64_t data)
 {
+    gttcan_process_frame_on_channel(gttcan, GTTCAN_CHANNEL_A, can_frame_id, data);
+}
+
+/**
+ * @brief Process a CAN frame received on one of the two channels
+ * 
+ * As gttcan_process_frame(), with the sender and (with standard identifiers) the data_id
+ * of the slot taken from the channel's half of the schedule entry. The second copy of a
+ * reference frame, from the other channel, is ignored.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param channel Channel the frame was received on, GTTCAN_CHANNEL_A without GTTCAN_ENABLE_DUAL_CHANNEL
+ * @param can_frame_id CAN frame identifier, as for gttcan_process_frame()
+ * @param data 64-bit data payload from the received CAN frame
+ */
+void gttcan_process_frame_on_channel(gttcan_t *gttcan, gttcan_channel_t channel, uint32_t can_frame_id, uint64_t data)
+{
+#if !GTTCAN_ENABLE_DUAL_CHANNEL
+    (void)channel;
+#endif
+
     if (!gttcan->is_initialised)
     {
         return;
     }
 
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+    if (gttcan->get_local_time_fp != NULL)
+    {
+        gttcan->rx_event_local_time = gttcan->get_local_time_fp();
+    }
+#else
+    gttcan_capture_event_time(gttcan);
+#endif
+    GTTCAN_TRACE(gttcan, GTTCAN_TRACE_FRAME_RECEIVED, can_frame_id, data);
+
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    uint16_t slot_id = can_frame_id & GTTCAN_STANDARD_FRAME_ID_MASK;
+    uint16_t data_id = 0;
+#else
     uint16_t slot_id = can_frame_id >> GTTCAN_NUM_DATA_ID_BITS;
-    uint16_t data_id = can_frame_id & 0xFFFF;
+    uint16_t data_id = can_frame_id & GTTCAN_DATA_ID_MASK;
+#endif
 
     uint8_t rx_node_id = 0;
-    for (int i = 0; i < gttcan->global_schedule_length; i++)
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    uint16_t scheduled_data_id = 0;
+#endif
+    global_schedule_entry_t rx_entry;
+    if (gttcan_find_slot_entry(gttcan, slot_id, &rx_entry))
     {
-        if (gttcan->global_schedule_ptr[i].slot_id == slot_id)
+        rx_node_id = rx_entry.node_id;
+#if GTTCAN_USE_STANDARD_FRAME_ID
+        data_id = rx_entry.data_id;
+#endif
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+        scheduled_data_id = rx_entry.data_id;
+#endif
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+        if (channel == GTTCAN_CHANNEL_B && rx_entry.data_id != REFERENCE_FRAME_DATA_ID)
         {
-            rx_node_id = gttcan->global_schedule_ptr[i].node_id;
-            break;
+            rx_node_id = rx_entry.node_id_b;
+#if GTTCAN_USE_STANDARD_FRAME_ID
+            data_id = rx_entry.data_id_b;
+#endif
+        }
+#endif
+    }
+
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    if (rx_node_id != 0)
+    {
+        rx_node_id = gttcan_attribute_frame(gttcan, rx_node_id, scheduled_data_id, data_id);
+    }
+#endif
+
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    if (rx_node_id == 0)
+    {
+        return; // Not a slot in our schedule, so the data_id is unknown
+    }
+#endif
+
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+    if (data_id == REFERENCE_FRAME_DATA_ID)
+    {
+        if (gttcan->has_last_reference && slot_id == gttcan->last_reference_slot_id && data == gttcan->last_reference_payload)
+        {
+            return; // The copy from the other channel, already synchronised to
+        }
+        gttcan->has_last_reference = true;
+        gttcan->last_reference_slot_id = slot_id;
+        gttcan->last_reference_payload = data;
+    }
+#endif
+
+    // Until a frame places us, our position says nothing about our timing
+    bool is_unplaced = gttcan->is_joining || gttcan->is_recovering;
+    bool is_placing = gttcan->is_joining ||
+                      (gttcan->is_recovering && (!gttcan->is_waiting_for_reference || data_id == REFERENCE_FRAME_DATA_ID));
+    if (is_placing && rx_node_id != 0)
+    {
+        if (gttcan->is_recovering)
+        {
+            gttcan->is_recovering = false;
+            gttcan->is_waiting_for_reference = false;
+            gttcan->error_counters.resync_count++;
+        }
+        gttcan->is_joining = false;
+
+        // Reference frames are synchronised to below, any other scheduled frame places us here
+        if (data_id != REFERENCE_FRAME_DATA_ID)
+        {
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+            gttcan_request_resync(gttcan, slot_id, false, 0);
+#else
+            gttcan->local_schedule_index = gttcan_get_resync_index(gttcan, slot_id);
+            GTTCAN_SEEK_LOCAL_RUN(gttcan);
+            uint32_t time_to_next_transmission = gttcan_get_time_to_next_transmission(slot_id, gttcan);
+            gttcan_set_timer(gttcan, time_to_next_transmission);
+#endif
         }
     }
 
     bool is_from_master = (rx_node_id == gttcan->last_lowest_seen_node_id) && (rx_node_id == gttcan->current_lowest_seen_node_id) && (gttcan->last_lowest_seen_node_id != 0);
+    bool is_adjusting = is_from_master || (gttcan->rounds_without_shuffling_against_master >= NUM_ROUNDS_BEFORE_SWITCHING_TO_ALL_NODE_ADJUST);
+#if GTTCAN_ENABLE_FTA_SYNC
+    if (gttcan->get_local_time_fp != NULL)
+    {
+        is_adjusting = is_from_master; // Other nodes count through the fault-tolerant average instead
+    }
+#endif
+    is_adjusting = is_adjusting && !is_unplaced;
+
+    uint16_t local_schedule_index = gttcan->local_schedule_index; // One snapshot, the timer interrupt may move it on
+    uint16_t next_slot_id = GTTCAN_LOCAL_ENTRY(gttcan, local_schedule_index).slot_id;
+    uint16_t previous_slot_id = (local_schedule_index > 0) ? GTTCAN_LOCAL_ENTRY(gttcan, local_schedule_index - 1).slot_id : 0;
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    // Reclaimable slots the node is not using say nothing about its position in the schedule
+    next_slot_id = gttcan_get_used_slot_id(gttcan, local_schedule_index, 1, UINT16_MAX);
+    previous_slot_id = gttcan_get_used_slot_id(gttcan, local_schedule_index - 1, -1, 0);
+#endif
 
-    if ((is_from_master || (gttcan->rounds_without_shuffling_against_master >= NUM_ROUNDS_BEFORE_SWITCHING_TO_ALL_NODE_ADJUST)) &&
-        slot_id > gttcan->local_schedule[gttcan->local_schedule_index].slot_id &&   // If received frame is after my next frame, AND
-        gttcan->local_schedule_index > 0 &&                                         // I have transmitted, AND
+    if (is_adjusting &&
+        slot_id > next_slot_id &&                                                   // If received frame is after my next frame, AND
+        local_schedule_index > 0 &&                                                 // I have transmitted, AND
         !gttcan->reached_end_of_my_schedule_prematurely                             // I haven't already wrapped in this round
     ) {
         gttcan->slot_duration_offset--; // I am slow, speed up
@@ -220,9 +958,9 @@ void gttcan_process_frame(gttcan_t *gttcan, uint32_t can_frame_id, uint64_t data
         }
     }
 
-    if ((is_from_master || (gttcan->rounds_without_shuffling_against_master >= NUM_ROUNDS_BEFORE_SWITCHING_TO_ALL_NODE_ADJUST)) &&
-        slot_id < gttcan->local_schedule[gttcan->local_schedule_index - 1].slot_id && // If received frame is before my previous, AND
-        gttcan->local_schedule_index > 0 &&                                           // I have transmitted, AND
+    if (is_adjusting &&
+        slot_id < previous_slot_id &&                                                 // If received frame is before my previous, AND
+        local_schedule_index > 0 &&                                                   // I have transmitted, AND
         !gttcan->reached_end_of_my_schedule_prematurely &&                            // I haven't already wrapped in this round, AND
         slot_id != 0                                                                  // received frame isn't at start of schedule
     ) {
@@ -239,17 +977,34 @@ void gttcan_process_frame(gttcan_t *gttcan, uint32_t can_frame_id, uint64_t data
 
     if (data_id == REFERENCE_FRAME_DATA_ID)
     {
-        
+        gttcan->reference_local_time = gttcan->GTTCAN_RX_EVENT_LOCAL_TIME;
+        gttcan_update_global_time(gttcan, data);
+#if GTTCAN_ENABLE_FTA_SYNC
+        gttcan->fta_epoch++;
+#endif
+#if GTTCAN_ENABLE_DATA_METRICS
+        gttcan->reference_slot_id = slot_id;
+        gttcan->reference_slot_start = (uint32_t)(data & GTTCAN_REFERENCE_FRAME_TIME_MASK);
+        gttcan->reference_cycle_count = (uint32_t)(data >> GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT);
+        gttcan->has_reference_slot = true;
+#endif
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+        if (slot_id == 0)
+        {
+            // In case our own timer for slot 0 has not fired yet
+            gttcan_apply_schedule_update(gttcan, gttcan->cycle_count);
+        }
+#endif
+
         if (slot_id == 0 && !gttcan->is_time_master)
         {
             if (gttcan->dynamic_slot_duration_correction && gttcan->slot_duration_offset > 0)
             {
-                gttcan->slot_duration++;
-
+                gttcan_step_slot_duration(gttcan, 1);
             }
             if (gttcan->dynamic_slot_duration_correction && gttcan->slot_duration_offset < 0)
             {
-                gttcan->slot_duration--;
+                gttcan_step_slot_duration(gttcan, -1);
             }
             if (
                 gttcan->slot_duration_offset == 0 && 
@@ -261,58 +1016,73 @@ void gttcan_process_frame(gttcan_t *gttcan, uint32_t can_frame_id, uint64_t data
 
         }
 
-        bool found_next_index = false;
-        // Find the first local schedule entry where its slot_id > ref slot_id
-        for (int i = 0; i < gttcan->local_schedule_length; i++)
-        {
-            if (gttcan->local_schedule[i].slot_id > slot_id)
-            {
-                if ((is_from_master || (gttcan->rounds_without_shuffling_against_master >= NUM_ROUNDS_BEFORE_SWITCHING_TO_ALL_NODE_ADJUST)) &&
-                    !gttcan->reached_end_of_my_schedule_prematurely &&
-                    ((gttcan->local_schedule_index < i) ||              // (If I am behind schedule, OR
-                    (i == 0 && gttcan->local_schedule_index))           // I didn't complete my schedule)
-                ) {
-                    gttcan->slot_duration_offset--; // speeding up
-                    if (is_from_master){
-                        gttcan->rounds_without_shuffling_against_master = 0;
-                    }
-                }
-                gttcan->local_schedule_index = i;
-
-                found_next_index = true;
-                break;
+        // The first local schedule entry in use where its slot_id > ref slot_id, or 0 if there is none
+        uint16_t next_index = gttcan_get_resync_index(gttcan, slot_id);
+        if (is_adjusting &&
+            !gttcan->reached_end_of_my_schedule_prematurely &&
+            ((local_schedule_index < next_index) ||             // (If I am behind schedule, OR
+            (next_index == 0 && local_schedule_index != 0))     // I didn't complete my schedule)
+        ) {
+            gttcan->slot_duration_offset--; // speeding up
+            if (is_from_master){
+                gttcan->rounds_without_shuffling_against_master = 0;
             }
         }
 
-        if (!found_next_index)
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+        gttcan_request_resync(gttcan, slot_id, true, (uint32_t)(data >> GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT));
+#else
+        gttcan->local_schedule_index = next_index;
+        GTTCAN_SEEK_LOCAL_RUN(gttcan);
+        uint32_t time_to_next_transmission = gttcan_get_time_to_next_transmission(slot_id, gttcan);
+        gttcan_set_timer(gttcan, time_to_next_transmission);
+#endif
+    }
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    else if (data_id == GTTCAN_SCHEDULE_UPDATE_DATA_ID)
+    {
+        gttcan_receive_schedule_update(gttcan, data);
+    }
+#endif
+    else if (gttcan_is_subscribed(gttcan, data_id))
+    {
+#if GTTCAN_ENABLE_DATA_METRICS
+        gttcan_update_data_metrics(gttcan, slot_id, data_id);
+#endif
+        gttcan_frame_layout_t *frame_layout = gttcan_get_frame_layout(gttcan, data_id);
+        if (frame_layout != NULL)
         {
-            // No slot is greater than the reference slot
-            if ((is_from_master || (gttcan->rounds_without_shuffling_against_master >= NUM_ROUNDS_BEFORE_SWITCHING_TO_ALL_NODE_ADJUST)) &&
-                gttcan->local_schedule_index != 0 && !gttcan->reached_end_of_my_schedule_prematurely)
-            {
-                gttcan->slot_duration_offset--; // Needs a speedup, as I never got to transmit my final frame
-                if (is_from_master){
-                    gttcan->rounds_without_shuffling_against_master = 0;
-                }
-            }
-            gttcan->local_schedule_index = 0;
+            gttcan_unpack_frame(gttcan, frame_layout, data);
+        }
+        else
+        {
+            gttcan->write_value_fp(data_id, data);
         }
 
-        uint32_t time_to_next_transmission = gttcan_get_time_to_next_transmission(slot_id, gttcan);
-        gttcan->set_timer_int_callback_fp(time_to_next_transmission);
+        if (gttcan->post_slot_hook_fp != NULL)
+        {
+            gttcan->post_slot_hook_fp(slot_id, data_id);
+        }
     }
-    else
+
+#if GTTCAN_ENABLE_FTA_SYNC
+    bool is_timed_frame = rx_node_id != 0 && data_id != REFERENCE_FRAME_DATA_ID;
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    is_timed_frame = is_timed_frame && data_id != GTTCAN_SCHEDULE_UPDATE_DATA_ID; // Not sent by the node in the schedule
+#endif
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+    is_timed_frame = is_timed_frame && channel == GTTCAN_CHANNEL_A; // A node may send on both channels in one slot
+#endif
+    if (is_timed_frame)
     {
-        gttcan->write_value_fp(data_id, data);
+        gttcan_record_fta_frame(gttcan, rx_node_id, slot_id);
     }
+#endif
 
     // Here onwards is for determining master
 
 
-    if ((rx_node_id < gttcan->current_lowest_seen_node_id || gttcan->current_lowest_seen_node_id == 0))
-    {
-        gttcan->current_lowest_seen_node_id = rx_node_id;
-    }
+    gttcan_record_lowest_seen_node_id(gttcan, rx_node_id);
 }
 
 /**
@@ -327,81 +1097,3685 @@ void gttcan_process_frame(gttcan_t *gttcan, uint32_t can_frame_id, uint64_t data
  * 
  * @note Called automatically during gttcan_init()
  * @note Local schedule includes slots where node_id matches or data_id is REFERENCE_FRAME_DATA_ID
+ *          (or GTTCAN_SCHEDULE_UPDATE_DATA_ID)
  * @note Populates gttcan->local_schedule array and sets gttcan->local_schedule_length
  * @note Local schedule entries maintain original slot_id values for timing calculations
+ * @note With GTTCAN_ENABLE_COMPRESSED_SCHEDULE, only notes where the node sends in the pattern
+ *          of each run and how many local entries come before it, linear in the number of runs
  */
 void gttcan_get_local_schedule(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr)
 {
-    uint16_t local_schedule_index = 0;
-    for (int i = 0; i < gttcan->global_schedule_length; i++)
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    uint16_t local_schedule_length = 0;
+    for (int i = 0; i < gttcan->schedule_run_count; i++)
     {
-        if (global_schedule_ptr[i].node_id == gttcan->node_id || global_schedule_ptr[i].data_id == REFERENCE_FRAME_DATA_ID)
+        const gttcan_schedule_run_t *run = &global_schedule_ptr[i];
+        uint8_t local_count = 0;
+        for (uint8_t k = 0; k < run->pattern_length; k++)
         {
-            gttcan->local_schedule[local_schedule_index].slot_id = global_schedule_ptr[i].slot_id;
-            gttcan->local_schedule[local_schedule_index].data_id = global_schedule_ptr[i].data_id;
-            local_schedule_index++;
+            if (run->data_id == REFERENCE_FRAME_DATA_ID || run->node_ids[k] == gttcan->node_id)
+            {
+                gttcan->run_local_offsets[i][local_count++] = k;
+            }
         }
+        gttcan->run_local_count[i] = local_count;
+        gttcan->run_local_start[i] = local_schedule_length;
+        local_schedule_length += gttcan_count_run_local_slots(gttcan, i, run->slot_count);
     }
-    gttcan->local_schedule_length = local_schedule_index;
+    gttcan->run_local_start[gttcan->schedule_run_count] = local_schedule_length;
+    gttcan->local_schedule_length = local_schedule_length;
+    gttcan_seek_local_run(gttcan);
+#else
+    gttcan->local_schedule_length = gttcan_build_local_schedule(gttcan, global_schedule_ptr, gttcan->global_schedule_length, gttcan->local_schedule);
+#endif
 }
 
+#if !GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+
 /**
- * @brief Calculate number of schedule slots between two positions with wraparound handling
- * 
- * Computes the shortest path from current slot to next slot, accounting for
- * schedule wraparound when the next slot has a lower ID than the current slot.
- * 
- * @param current_slot_id Current position in the global schedule
- * @param next_slot_id Target slot position in the global schedule  
- * @param global_schedule_length Total number of slots in the global schedule
+ * @brief Build the local schedule of this node from a global schedule
  * 
- * @return Number of slots to advance from current to next position
+ * @param gttcan Pointer to gttcan_t structure
+ * @param global_schedule_ptr Pointer to the complete global schedule array
+ * @param global_schedule_length Number of entries in the global schedule
+ * @param local_schedule Array of GTTCAN_MAX_LOCAL_SCHEDULE_LENGTH entries to fill
  * 
- * @note Handles schedule wraparound (e.g., slot 10 to slot 2 in 12-slot schedule = 4 slots)
- * @note Used internally for timing calculations
+ * @return Number of local schedule entries, entries beyond GTTCAN_MAX_LOCAL_SCHEDULE_LENGTH are dropped
  */
-uint16_t gttcan_get_number_of_slots_to_next(uint16_t current_slot_id, uint16_t next_slot_id, uint16_t global_schedule_length)
+static uint16_t gttcan_build_local_schedule(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr, uint16_t global_schedule_length, local_schedule_entry_t *local_schedule)
 {
-    if (current_slot_id < next_slot_id)
-    {
-        return next_slot_id - current_slot_id;
-    }
-    else
+    uint16_t local_schedule_index = 0;
+    for (int i = 0; i < global_schedule_length; i++)
     {
-        return global_schedule_length - current_slot_id + next_slot_id;
+        bool is_shared_entry = global_schedule_ptr[i].data_id == REFERENCE_FRAME_DATA_ID;
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+        is_shared_entry = is_shared_entry || global_schedule_ptr[i].data_id == GTTCAN_SCHEDULE_UPDATE_DATA_ID;
+#endif
+        if (local_schedule_index >= GTTCAN_MAX_LOCAL_SCHEDULE_LENGTH)
+        {
+            break;
+        }
+        if (global_schedule_ptr[i].node_id == gttcan->node_id || is_shared_entry)
+        {
+            local_schedule[local_schedule_index].slot_id = global_schedule_ptr[i].slot_id;
+            local_schedule[local_schedule_index].data_id = global_schedule_ptr[i].data_id;
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+            local_schedule[local_schedule_index].dlc = gttcan_get_entry_dlc(&global_schedule_ptr[i]);
+#endif
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+            local_schedule[local_schedule_index].backup_index = GTTCAN_NO_SLOT_BACKUP;
+#endif
+#if GTTCAN_ENABLE_ON_DEMAND
+            local_schedule[local_schedule_index].policy = global_schedule_ptr[i].policy;
+#endif
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+            // Reference frames go out on both channels
+            bool is_on_channel_b = global_schedule_ptr[i].node_id_b == gttcan->node_id || is_shared_entry;
+            local_schedule[local_schedule_index].channels = (1U << GTTCAN_CHANNEL_A) | (is_on_channel_b ? 1U << GTTCAN_CHANNEL_B : 0);
+            local_schedule[local_schedule_index].data_id_b = is_shared_entry ? global_schedule_ptr[i].data_id : global_schedule_ptr[i].data_id_b;
+#endif
+            local_schedule_index++;
+        }
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+        else if (global_schedule_ptr[i].node_id_b == gttcan->node_id)
+        {
+            // Slots where we only send on channel B
+            local_schedule[local_schedule_index].slot_id = global_schedule_ptr[i].slot_id;
+            local_schedule[local_schedule_index].data_id = global_schedule_ptr[i].data_id_b;
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+            local_schedule[local_schedule_index].dlc = gttcan_get_entry_dlc(&global_schedule_ptr[i]);
+#endif
+#if GTTCAN_ENABLE_ON_DEMAND
+            local_schedule[local_schedule_index].policy = global_schedule_ptr[i].policy;
+#endif
+            local_schedule[local_schedule_index].channels = 1U << GTTCAN_CHANNEL_B;
+            local_schedule[local_schedule_index].data_id_b = global_schedule_ptr[i].data_id_b;
+            local_schedule_index++;
+        }
+#endif
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+        else
+        {
+            // Slots of a node we back up, used only while it is silent
+            uint8_t backup_index = gttcan_get_backup_index(gttcan, &global_schedule_ptr[i]);
+            if (backup_index != GTTCAN_NO_SLOT_BACKUP)
+            {
+                local_schedule[local_schedule_index].slot_id = global_schedule_ptr[i].slot_id;
+                local_schedule[local_schedule_index].data_id = gttcan->slot_backups[backup_index].data_id;
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+                local_schedule[local_schedule_index].dlc = gttcan_get_entry_dlc(&global_schedule_ptr[i]);
+#endif
+                local_schedule[local_schedule_index].backup_index = backup_index;
+                local_schedule_index++;
+            }
+        }
+#endif
     }
+    return local_schedule_index;
 }
+#endif
 
 /**
- * @brief Calculate time delay until next scheduled transmission
+ * @brief Build the CAN frame identifier for a schedule entry
  * 
- * Determines the exact time delay needed before the next transmission interrupt
- * should occur, accounting for slot duration, interrupt timing offset, and
- * schedule position.
+ * @param slot_id Slot position of the entry in the global schedule
+ * @param data_id Data identifier of the entry
+ * 
+ * @return 29-bit extended identifier (slot_id << GTTCAN_NUM_DATA_ID_BITS) | data_id, or the
+ *          11-bit standard identifier slot_id if GTTCAN_USE_STANDARD_FRAME_ID is set
+ * 
+ * @note Used internally by gttcan_transmit_next_frame(), and useful for configuring CAN filters
+ */
+uint32_t gttcan_build_frame_id(uint16_t slot_id, uint16_t data_id)
+{
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    (void)data_id;
+    return slot_id & GTTCAN_STANDARD_FRAME_ID_MASK;
+#else
+    return ((uint32_t)slot_id << GTTCAN_NUM_DATA_ID_BITS) | (data_id & GTTCAN_DATA_ID_MASK);
+#endif
+}
+
+/**
+ * @brief Find the local schedule entry that follows a given slot
+ * 
+ * Returns the index of the first local schedule entry whose slot_id is greater than
+ * slot_id, wrapping around to the start of the local schedule if there is none.
+ * 
+ * @param gttcan Pointer to gttcan_t structure with a populated local schedule
+ * @param slot_id Slot position in the global schedule to search from
+ * 
+ * @return Index into gttcan->local_schedule of the next entry after slot_id
+ * 
+ * @note Used to place the node after a reference frame, and when joining a running network
+ * @note With GTTCAN_ENABLE_COMPRESSED_SCHEDULE, counts the local entries up to slot_id in its
+ *          run instead of searching, logarithmic in the number of runs
+ */
+uint16_t gttcan_get_next_local_schedule_index(gttcan_t *gttcan, uint16_t slot_id)
+{
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    int run_index = gttcan_find_schedule_run(gttcan, slot_id);
+    if (run_index < 0)
+    {
+        return 0;
+    }
+    const gttcan_schedule_run_t *run = &gttcan->global_schedule_ptr[run_index];
+    uint32_t slots_up_to = (uint32_t)(slot_id - run->first_slot_id) + 1; // Slots of the run up to and including slot_id
+    if (slots_up_to > run->slot_count)
+    {
+        slots_up_to = run->slot_count;
+    }
+    uint16_t next_index = gttcan->run_local_start[run_index] + gttcan_count_run_local_slots(gttcan, run_index, (uint16_t)slots_up_to);
+    return (next_index < gttcan->local_schedule_length) ? next_index : 0;
+#else
+    for (int i = 0; i < gttcan->local_schedule_length; i++)
+    {
+        if (gttcan->local_schedule[i].slot_id > slot_id)
+        {
+            return i;
+        }
+    }
+    return 0;
+#endif
+}
+
+/**
+ * @brief Find the local schedule entry to arm the timer for when a frame places the node
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param slot_id Slot of the received frame
+ * 
+ * @return As gttcan_get_next_local_schedule_index(), passing over reclaimable slots left to
+ *          their owner as gttcan_transmit_next_frame() does
+ */
+static uint16_t gttcan_get_resync_index(gttcan_t *gttcan, uint16_t slot_id)
+{
+    uint16_t next_index = gttcan_get_next_local_schedule_index(gttcan, slot_id);
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    next_index = gttcan_skip_unused_slots(gttcan, next_index);
+    if (next_index >= gttcan->local_schedule_length)
+    {
+        next_index = 0;
+    }
+#endif
+    return next_index;
+}
+
+/**
+ * @brief Get an entry of the global schedule
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param index Entry of the global schedule array, or with GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+ *          the slot, below gttcan->global_schedule_length
+ * @param entry Receives the entry
+ * 
+ * @return false for slots that no run covers
+ */
+static bool gttcan_get_global_entry(gttcan_t *gttcan, uint16_t index, global_schedule_entry_t *entry)
+{
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    return gttcan_find_slot_entry(gttcan, index, entry);
+#else
+    *entry = gttcan->global_schedule_ptr[index];
+    return true;
+#endif
+}
+
+/**
+ * @brief Find the global schedule entry of a slot
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param slot_id Slot to look up
+ * @param entry Receives the entry
+ * 
+ * @return false if the slot is not in the schedule
+ * 
+ * @note Constant time when the entry of every slot is at its slot_id in the global schedule,
+ *          otherwise linear in its length. With GTTCAN_ENABLE_COMPRESSED_SCHEDULE logarithmic
+ *          in the number of runs
+ */
+static bool gttcan_find_slot_entry(gttcan_t *gttcan, uint16_t slot_id, global_schedule_entry_t *entry)
+{
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    int run_index = gttcan_find_schedule_run(gttcan, slot_id);
+    if (run_index < 0)
+    {
+        return false;
+    }
+    const gttcan_schedule_run_t *run = &gttcan->global_schedule_ptr[run_index];
+    uint16_t slot_in_run = slot_id - run->first_slot_id;
+    if (slot_in_run >= run->slot_count)
+    {
+        return false;
+    }
+    entry->node_id = run->node_ids[slot_in_run % run->pattern_length];
+    entry->slot_id = slot_id;
+    entry->data_id = run->data_id;
+    return true;
+#else
+    // Schedules usually list every slot in order, so try its own index before searching
+    if (slot_id < gttcan->global_schedule_length && gttcan->global_schedule_ptr[slot_id].slot_id == slot_id)
+    {
+        *entry = gttcan->global_schedule_ptr[slot_id];
+        return true;
+    }
+    for (int i = 0; i < gttcan->global_schedule_length; i++)
+    {
+        if (gttcan->global_schedule_ptr[i].slot_id == slot_id)
+        {
+            *entry = gttcan->global_schedule_ptr[i];
+            return true;
+        }
+    }
+    return false;
+#endif
+}
+
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+/**
+ * @brief Find the run of a compressed schedule that a slot falls in
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param slot_id Slot to look up
+ * 
+ * @return Index of the last run starting at or before slot_id, or -1 if there is none. The
+ *          slot may lie after the end of the run, in unused slots
+ */
+static int gttcan_find_schedule_run(gttcan_t *gttcan, uint16_t slot_id)
+{
+    int low = 0;
+    int high = gttcan->schedule_run_count - 1;
+    if (high < 0 || gttcan->global_schedule_ptr[0].first_slot_id > slot_id)
+    {
+        return -1;
+    }
+    while (low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if (gttcan->global_schedule_ptr[middle].first_slot_id <= slot_id)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Count the local schedule entries among the first slots of a run
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param run_index Run of the compressed schedule
+ * @param slot_count Number of slots from the start of the run to count in
+ * 
+ * @return Number of those slots this node sends in, all of them for reference frame runs
+ */
+static uint16_t gttcan_count_run_local_slots(gttcan_t *gttcan, int run_index, uint16_t slot_count)
+{
+    uint8_t pattern_length = gttcan->global_schedule_ptr[run_index].pattern_length;
+    uint8_t remainder = slot_count % pattern_length;
+    uint16_t count = (slot_count / pattern_length) * gttcan->run_local_count[run_index];
+    for (int i = 0; i < gttcan->run_local_count[run_index] && gttcan->run_local_offsets[run_index][i] < remainder; i++)
+    {
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Find the run of a compressed schedule that a local schedule entry falls in
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param local_schedule_index Entry of the local schedule
+ * 
+ * @return Index of the last run whose first local entry is at or before local_schedule_index,
+ *          runs without any share it with the next. 0 if there are no runs
+ * 
+ * @note Logarithmic in the number of runs, only used when local_schedule_index jumps
+ */
+static int gttcan_find_local_run(gttcan_t *gttcan, uint16_t local_schedule_index)
+{
+    int low = 0;
+    int high = gttcan->schedule_run_count - 1;
+    while (low < high)
+    {
+        int middle = (low + high + 1) / 2;
+        if (gttcan->run_local_start[middle] <= local_schedule_index)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle - 1;
+        }
+    }
+    return low;
+}
+
+/**
+ * @brief Work out where local_schedule_index is in the runs after it has jumped
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @note Called on begin, on resync and on join, gttcan_step_local_run() follows it from there
+ */
+static void gttcan_seek_local_run(gttcan_t *gttcan)
+{
+    uint16_t local_schedule_index = gttcan->local_schedule_index;
+    int run_index = gttcan_find_local_run(gttcan, local_schedule_index);
+    gttcan->local_run_base = 0;
+    gttcan->local_run_offset = 0;
+    if (local_schedule_index < gttcan->local_schedule_length)
+    {
+        uint16_t entry_in_run = local_schedule_index - gttcan->run_local_start[run_index];
+        uint8_t local_count = gttcan->run_local_count[run_index];
+        gttcan->local_run_base = (entry_in_run / local_count) * gttcan->global_schedule_ptr[run_index].pattern_length;
+        gttcan->local_run_offset = entry_in_run % local_count;
+    }
+    gttcan->local_schedule_run = run_index;
+}
+
+/**
+ * @brief Move the position in the runs on to local_schedule_index after it has been incremented
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @note Constant time, bar runs without local entries being passed over. Past the end of the
+ *          local schedule it moves to the first entry, where the index wraps to
+ */
+static void gttcan_step_local_run(gttcan_t *gttcan)
+{
+    uint16_t local_schedule_index = gttcan->local_schedule_index;
+    int run_index = gttcan->local_schedule_run;
+    if (local_schedule_index >= gttcan->local_schedule_length)
+    {
+        local_schedule_index = 0;
+    }
+
+    if (local_schedule_index == 0)
+    {
+        run_index = 0;
+        gttcan->local_run_base = 0;
+        gttcan->local_run_offset = 0;
+    }
+    else if (++gttcan->local_run_offset == gttcan->run_local_count[run_index])
+    {
+        gttcan->local_run_base += gttcan->global_schedule_ptr[run_index].pattern_length; // Next repeat of the pattern
+        gttcan->local_run_offset = 0;
+    }
+
+    while (run_index + 1 < gttcan->schedule_run_count && gttcan->run_local_start[run_index + 1] <= local_schedule_index)
+    {
+        run_index++;
+        gttcan->local_run_base = 0;
+        gttcan->local_run_offset = 0;
+    }
+    gttcan->local_schedule_run = run_index;
+}
+
+/**
+ * @brief Work out a local schedule entry from the compressed schedule
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param local_schedule_index Entry of the local schedule
+ * 
+ * @return The entry, or an entry for slot 0 if local_schedule_index is past the end of the
+ *          local schedule
+ * 
+ * @note Walks from the run of gttcan->local_schedule_index, so constant time for entries
+ *          next to it. Any run is a valid start, so a timer interrupt moving it on is harmless
+ */
+static local_schedule_entry_t gttcan_get_local_entry(gttcan_t *gttcan, uint16_t local_schedule_index)
+{
+    local_schedule_entry_t entry = {0};
+    if (local_schedule_index >= gttcan->local_schedule_length)
+    {
+        return entry;
+    }
+
+    int run_index = gttcan->local_schedule_run;
+    while (run_index > 0 && gttcan->run_local_start[run_index] > local_schedule_index)
+    {
+        run_index--;
+    }
+    while (run_index + 1 < gttcan->schedule_run_count && gttcan->run_local_start[run_index + 1] <= local_schedule_index)
+    {
+        run_index++;
+    }
+    const gttcan_schedule_run_t *run = &gttcan->global_schedule_ptr[run_index];
+
+    uint16_t entry_in_run = local_schedule_index - gttcan->run_local_start[run_index];
+    uint8_t local_count = gttcan->run_local_count[run_index];
+    entry.slot_id = run->first_slot_id + (entry_in_run / local_count) * run->pattern_length +
+                    gttcan->run_local_offsets[run_index][entry_in_run % local_count];
+    entry.data_id = run->data_id;
+    return entry;
+}
+
+/**
+ * @brief Read the local schedule entry at gttcan->local_schedule_index from the compressed schedule
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return The entry, or an entry for slot 0 if the local schedule is empty
+ * 
+ * @note Constant time, from the position kept by gttcan_step_local_run(). Only for the
+ *          context that moves the index, others use gttcan_get_local_entry()
+ */
+static local_schedule_entry_t gttcan_get_current_local_entry(gttcan_t *gttcan)
+{
+    local_schedule_entry_t entry = {0};
+    if (gttcan->local_schedule_index >= gttcan->local_schedule_length)
+    {
+        return entry;
+    }
+
+    int run_index = gttcan->local_schedule_run;
+    const gttcan_schedule_run_t *run = &gttcan->global_schedule_ptr[run_index];
+    entry.slot_id = run->first_slot_id + gttcan->local_run_base + gttcan->run_local_offsets[run_index][gttcan->local_run_offset];
+    entry.data_id = run->data_id;
+    return entry;
+}
+#endif
+
+/**
+ * @brief Calculate the worst-case length of a G-TTCAN frame in bits
+ * 
+ * Counts the fixed frame fields, the payload, the worst-case number of stuff bits and the
+ * 3-bit interframe space, for the identifier mode in use (see GTTCAN_USE_STANDARD_FRAME_ID).
+ * 
+ * @param dlc Payload length in bytes, values above 8 are treated as 8
+ * 
+ * @return Worst-case number of bit times the frame occupies the bus
+ * 
+ * @note gttcan_get_frame_bits(8) == GTTCAN_WORST_CASE_FRAME_BITS
+ */
+uint16_t gttcan_get_frame_bits(uint8_t dlc)
+{
+    if (dlc > GTTCAN_MAX_DLC)
+    {
+        dlc = GTTCAN_MAX_DLC;
+    }
+
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    uint16_t stuffable_bits = 34 + 8 * dlc;
+    uint16_t fixed_bits = 44 + 8 * dlc;
+#else
+    uint16_t stuffable_bits = 54 + 8 * dlc;
+    uint16_t fixed_bits = 64 + 8 * dlc;
+#endif
+
+    return fixed_bits + (stuffable_bits - 1) / 4 + 3;
+}
+
+/**
+ * @brief Work out the shortest safe slot_duration and the interrupt_timing_offset from measured timing
+ * 
+ * Models two consecutive slots with the first sender as late and the next as early as they can
+ * be. Every node but the time master starts its slots from the end of the last reference frame
+ * it received, so it runs behind the master by the master's transmit latency, the reference frame
+ * and its own receive latency. interrupt_timing_offset is set to the middle of timer_set_latency,
+ * so each timer load is off by at most half its spread, and a node loads its timer once for each
+ * of its slots until the next reference frame. Over that time two clocks drift apart by up to
+ * twice clock_tolerance_ppm. A slot
+ * is long enough when its frame, with worst-case bit stuffing, ends before the next slot can start.
+ * 
+ * @param gttcan Pointer to gttcan_t structure initialised with gttcan_init()
+ * @param params Timing of the bus and the nodes, measured on the target
+ * @param timing Receives the derived timing and its parts, may be NULL
+ * 
+ * @return false, leaving gttcan unchanged, if params are inconsistent, the schedule has no reference
+ *          frame or clocks can drift apart by a whole slot before the next reference frame
+ * 
+ * @note Sets slot_duration and interrupt_timing_offset, so both may be passed to gttcan_init() as 0.
+ *          Call before gttcan_start() or gttcan_join()
+ * @note All nodes must use the same slot_duration, so give the worst latencies measured on any node
+ * @note With GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS also gives the bit time, so every slot keeps the
+ *          guard of a full slot after its own frame
+ */
+bool gttcan_configure_timing(gttcan_t *gttcan, const gttcan_timing_params_t *params, gttcan_timing_t *timing)
+{
+    if (params->bit_rate == 0 || params->timer_frequency == 0 ||
+        params->transmit_latency_min > params->transmit_latency_max ||
+        params->receive_latency_min > params->receive_latency_max ||
+        params->timer_set_latency_min > params->timer_set_latency_max)
+    {
+        return false;
+    }
+
+    // Longest run of slots between reference frames, and the longest frame
+    int first_reference_slot = -1;
+    int last_reference_slot = -1;
+    uint16_t reference_interval = 0;
+    uint16_t reference_frame_bits = 0;
+    uint16_t longest_frame_bits = 0;
+    for (uint16_t i = 0; i < gttcan->global_schedule_length; i++)
+    {
+        global_schedule_entry_t entry;
+        if (!gttcan_get_global_entry(gttcan, i, &entry))
+        {
+            continue;
+        }
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+        uint16_t frame_bits = gttcan_get_frame_bits(gttcan_get_entry_dlc(&entry));
+#else
+        uint16_t frame_bits = gttcan_get_frame_bits(GTTCAN_MAX_DLC); // Every frame is sent with 8 bytes
+#endif
+        longest_frame_bits = (frame_bits > longest_frame_bits) ? frame_bits : longest_frame_bits;
+
+        if (entry.data_id == REFERENCE_FRAME_DATA_ID)
+        {
+            if (last_reference_slot >= 0 && entry.slot_id - last_reference_slot > reference_interval)
+            {
+                reference_interval = entry.slot_id - last_reference_slot;
+            }
+            if (first_reference_slot < 0)
+            {
+                first_reference_slot = entry.slot_id;
+            }
+            last_reference_slot = entry.slot_id;
+            reference_frame_bits = (frame_bits > reference_frame_bits) ? frame_bits : reference_frame_bits;
+        }
+    }
+    if (first_reference_slot < 0)
+    {
+        return false;
+    }
+    uint16_t wrap_interval = gttcan->global_schedule_length - last_reference_slot + first_reference_slot;
+    reference_interval = (wrap_interval > reference_interval) ? wrap_interval : reference_interval;
+    uint16_t timer_loads = gttcan_count_timer_loads(gttcan);
+
+    uint32_t interrupt_timing_offset = (params->timer_set_latency_min + params->timer_set_latency_max + 1) / 2;
+    uint64_t timer_set_error = params->timer_set_latency_max - interrupt_timing_offset;
+    if (interrupt_timing_offset - params->timer_set_latency_min > timer_set_error)
+    {
+        timer_set_error = interrupt_timing_offset - params->timer_set_latency_min;
+    }
+
+    // Spread between the latest start of one slot and the earliest start of the next, without drift
+    uint64_t reference_lag = (uint64_t)params->transmit_latency_max + params->receive_latency_max +
+                             gttcan_get_bit_time(params, reference_frame_bits);
+    uint64_t synchronisation_error = reference_lag + 2 * (uint64_t)timer_loads * timer_set_error +
+                                     (params->transmit_latency_max - params->transmit_latency_min);
+
+    // Drift, in millionths of a full slot, until the slot after the next reference frame is started
+    uint64_t drift_ppm = 2 * (uint64_t)params->clock_tolerance_ppm * (reference_interval + 1);
+    if (drift_ppm >= 1000000)
+    {
+        return false;
+    }
+
+    // A slot must hold a full frame, the error and the drift over a whole slot. Shorter frames
+    // save their own bus time from the slot and keep the same guard, so a full frame bounds it
+    uint64_t frame_time = gttcan_get_bit_time(params, gttcan_get_frame_bits(GTTCAN_MAX_DLC));
+    uint64_t slot_duration = ((frame_time + synchronisation_error) * 1000000ULL + (1000000 - drift_ppm) - 1) /
+                             (1000000 - drift_ppm);
+    if (slot_duration > UINT32_MAX)
+    {
+        return false;
+    }
+
+    gttcan->slot_duration = (uint32_t)slot_duration;
+    gttcan->interrupt_timing_offset = interrupt_timing_offset;
+    gttcan_set_bit_rate(gttcan, params->bit_rate, params->timer_frequency);
+#if GTTCAN_ENABLE_DATA_METRICS
+    gttcan->nominal_slot_duration = (uint32_t)slot_duration;
+#endif
+
+    if (timing != NULL)
+    {
+        timing->slot_duration = (uint32_t)slot_duration;
+        timing->interrupt_timing_offset = interrupt_timing_offset;
+        timing->longest_frame_time = (uint32_t)gttcan_get_bit_time(params, longest_frame_bits);
+        timing->synchronisation_error = (uint32_t)synchronisation_error;
+        timing->drift = (uint32_t)((slot_duration * drift_ppm + 999999) / 1000000);
+        timing->reference_interval = reference_interval;
+        timing->timer_loads = timer_loads;
+    }
+    return true;
+}
+
+/**
+ * @brief Count the most timer loads of any one node from one reference frame to the next
+ * 
+ * A node loads its timer in each of its own slots, and resynchronises at reference frames.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return Most slots any node owns between two reference frames, including the one it sends
+ *          a reference frame in
+ * 
+ * @note Takes one pass over the schedule per node
+ */
+static uint16_t gttcan_count_timer_loads(gttcan_t *gttcan)
+{
+    uint8_t node_seen[32] = {0};
+    for (uint16_t i = 0; i < gttcan->global_schedule_length; i++)
+    {
+        global_schedule_entry_t entry;
+        if (gttcan_get_global_entry(gttcan, i, &entry))
+        {
+            node_seen[entry.node_id / 8] |= (uint8_t)(1U << (entry.node_id % 8));
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+            node_seen[entry.node_id_b / 8] |= (uint8_t)(1U << (entry.node_id_b % 8));
+#endif
+        }
+    }
+
+    uint16_t timer_loads = 0;
+    for (int node_id = 1; node_id < 256; node_id++)
+    {
+        if (!(node_seen[node_id / 8] & (1U << (node_id % 8))))
+        {
+            continue;
+        }
+
+        // Loads before the first reference frame continue the count from the end of the round
+        uint16_t loads_before_first_reference = 0;
+        uint16_t loads = 0;
+        bool has_reference = false;
+        for (uint16_t i = 0; i < gttcan->global_schedule_length; i++)
+        {
+            global_schedule_entry_t entry;
+            if (!gttcan_get_global_entry(gttcan, i, &entry))
+            {
+                continue;
+            }
+            if (entry.data_id == REFERENCE_FRAME_DATA_ID)
+            {
+                if (!has_reference)
+                {
+                    loads_before_first_reference = loads;
+                }
+                timer_loads = (loads > timer_loads) ? loads : timer_loads;
+                has_reference = true;
+                loads = 0;
+            }
+            bool is_sender = entry.node_id == node_id;
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+            is_sender = is_sender || entry.node_id_b == node_id; // Both channels from one load
+#endif
+            if (is_sender)
+            {
+                loads++;
+            }
+        }
+        loads += has_reference ? loads_before_first_reference : 0;
+        timer_loads = (loads > timer_loads) ? loads : timer_loads;
+    }
+    return timer_loads;
+}
+
+/**
+ * @brief Convert a number of bit times into system time units, rounding up
+ */
+static uint64_t gttcan_get_bit_time(const gttcan_timing_params_t *params, uint64_t bits)
+{
+    return (bits * params->timer_frequency + params->bit_rate - 1) / params->bit_rate;
+}
+
+/**
+ * @brief Precompute the start offset of every slot for variable slot lengths
+ * 
+ * Each slot is shortened from slot_duration by the bits its frame saves against a full 8-byte
+ * frame, with worst-case bit stuffing, so every slot keeps the same guard time after its frame.
+ * Stores how many bits every slot starts early (and the whole round at index
+ * global_schedule_length) in gttcan->slot_start_offset.
+ * 
+ * @param gttcan Pointer to gttcan_t structure to populate
+ * @param global_schedule_ptr Pointer to the complete global schedule array
+ * 
+ * @note Called automatically during gttcan_init() when GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS is set,
+ *          and does nothing otherwise
+ * @note Offsets are in bits, so they remain valid when slot_duration is corrected at runtime, and
+ *          only shorten slots once gttcan_set_bit_rate() or gttcan_configure_timing() gives the bit time
+ * @note Slots missing from the global schedule are given a full length
+ */
+void gttcan_get_slot_start_offsets(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr)
+{
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    gttcan_build_slot_start_offsets(global_schedule_ptr, gttcan->global_schedule_length, gttcan->slot_start_offset);
+#else
+    (void)gttcan;
+    (void)global_schedule_ptr;
+#endif
+}
+
+/**
+ * @brief Give the bit time, so that variable length slots can be shortened to their frames
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param bit_rate CAN bit rate in bits per second
+ * @param timer_frequency System time units per second
+ * 
+ * @note Only needed with GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS and a slot_duration chosen by hand,
+ *          gttcan_configure_timing() sets it too. Until it is given every slot is a full slot_duration
+ * @note Call before gttcan_start() or gttcan_join()
+ */
+void gttcan_set_bit_rate(gttcan_t *gttcan, uint32_t bit_rate, uint32_t timer_frequency)
+{
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    // Rounded down, so slots are never shortened by more than their frames save
+    gttcan->bit_time = (bit_rate == 0) ? 0 :
+                       (uint32_t)(((uint64_t)timer_frequency << GTTCAN_SLOT_LENGTH_FRACTIONAL_BITS) / bit_rate);
+#else
+    (void)gttcan;
+    (void)bit_rate;
+    (void)timer_frequency;
+#endif
+}
+
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+/**
+ * @brief Fill in the cumulative slot start offsets of a global schedule
+ * 
+ * @param global_schedule_ptr Pointer to the complete global schedule array
+ * @param global_schedule_length Number of entries in the global schedule
+ * @param slot_start_offset Array of global_schedule_length + 1 offsets to fill
+ */
+static void gttcan_build_slot_start_offsets(global_schedule_ptr_t global_schedule_ptr, uint16_t global_schedule_length, uint32_t *slot_start_offset)
+{
+    uint16_t full_frame_bits = gttcan_get_frame_bits(GTTCAN_MAX_DLC);
+
+    // Store the bits each slot is short of a full one one place ahead, then accumulate in place
+    slot_start_offset[0] = 0;
+    for (int i = 0; i < global_schedule_length; i++)
+    {
+        slot_start_offset[i + 1] = 0;
+    }
+    for (int i = 0; i < global_schedule_length; i++)
+    {
+        uint16_t slot_id = global_schedule_ptr[i].slot_id;
+        if (slot_id < global_schedule_length)
+        {
+            slot_start_offset[slot_id + 1] = full_frame_bits - gttcan_get_frame_bits(gttcan_get_entry_dlc(&global_schedule_ptr[i]));
+        }
+    }
+    for (int i = 0; i < global_schedule_length; i++)
+    {
+        slot_start_offset[i + 1] += slot_start_offset[i];
+    }
+}
+#endif
+
+/**
+ * @brief Get the payload length of the frame being transmitted
+ * 
+ * Intended to be called from transmit_frame_callback_fp to set the DLC of the outgoing frame.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return DLC from the schedule entry being transmitted, or 8 unless GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS is set
+ */
+uint8_t gttcan_get_transmit_dlc(gttcan_t *gttcan)
+{
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    return gttcan->transmit_dlc;
+#else
+    (void)gttcan;
+    return GTTCAN_MAX_DLC;
+#endif
+}
+
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+/**
+ * @brief Get the payload length of a global schedule entry
+ * 
+ * @param entry Pointer to the global schedule entry
+ * 
+ * @return DLC of the entry, where 0 (unspecified) and values above 8 are treated as 8
+ */
+static uint8_t gttcan_get_entry_dlc(const global_schedule_entry_t *entry)
+{
+    if (entry->dlc == 0 || entry->dlc > GTTCAN_MAX_DLC)
+    {
+        return GTTCAN_MAX_DLC;
+    }
+    return entry->dlc;
+}
+#endif
+
+/**
+ * @brief Calculate number of schedule slots between two positions with wraparound handling
+ * 
+ * Computes the shortest path from current slot to next slot, accounting for
+ * schedule wraparound when the next slot has a lower ID than the current slot.
+ * 
+ * @param current_slot_id Current position in the global schedule
+ * @param next_slot_id Target slot position in the global schedule  
+ * @param global_schedule_length Total number of slots in the global schedule
+ * 
+ * @return Number of slots to advance from current to next position
+ * 
+ * @note Handles schedule wraparound (e.g., slot 10 to slot 2 in 12-slot schedule = 4 slots)
+ * @note Used internally for timing calculations
+ */
+uint16_t gttcan_get_number_of_slots_to_next(uint16_t current_slot_id, uint16_t next_slot_id, uint16_t global_schedule_length)
+{
+    if (current_slot_id < next_slot_id)
+    {
+        return next_slot_id - current_slot_id;
+    }
+    else
+    {
+        return global_schedule_length - current_slot_id + next_slot_id;
+    }
+}
+
+/**
+ * @brief Calculate the time from the start of one slot to the start of another
+ * 
+ * @param gttcan Pointer to gttcan_t structure containing timing configuration
+ * @param from_slot_id Slot position to measure from
+ * @param to_slot_id Slot position to measure to, wrapping into the next round if it is not after from_slot_id
+ * 
+ * @return Time in system time units, a whole round if both slots are the same
+ * 
+ * @note With GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS, uses the precomputed slot start offsets
+ */
+uint32_t gttcan_get_time_between_slots(gttcan_t *gttcan, uint16_t from_slot_id, uint16_t to_slot_id)
+{
+    return gttcan_scale_slots(gttcan, from_slot_id, to_slot_id, gttcan->slot_duration);
+}
+
+// Time between the starts of two slots for a given slot_duration
+static uint32_t gttcan_scale_slots(gttcan_t *gttcan, uint16_t from_slot_id, uint16_t to_slot_id, uint32_t slot_duration)
+{
+    uint16_t number_of_slots_between = gttcan_get_number_of_slots_to_next(from_slot_id, to_slot_id, gttcan->global_schedule_length);
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    // Full slots, less the bus time the shorter frames in between save
+    uint32_t bits_saved;
+    if (from_slot_id < to_slot_id)
+    {
+        bits_saved = gttcan->slot_start_offset[to_slot_id] - gttcan->slot_start_offset[from_slot_id];
+    }
+    else
+    {
+        bits_saved = gttcan->slot_start_offset[gttcan->global_schedule_length] - gttcan->slot_start_offset[from_slot_id] + gttcan->slot_start_offset[to_slot_id];
+    }
+    uint64_t time_saved = ((uint64_t)bits_saved * gttcan->bit_time) >> GTTCAN_SLOT_LENGTH_FRACTIONAL_BITS;
+    uint64_t full_time = (uint64_t)number_of_slots_between * slot_duration;
+    return (time_saved < full_time) ? (uint32_t)(full_time - time_saved) : 0;
+#else
+    return (uint32_t)number_of_slots_between * slot_duration;
+#endif
+}
+
+/**
+ * @brief Calculate time delay until next scheduled transmission
+ * 
+ * Determines the exact time delay needed before the next transmission interrupt
+ * should occur, accounting for slot duration, interrupt timing offset, and
+ * schedule position.
  * 
  * @param current_slot_id Current slot position in the schedule (reference point)
  * @param gttcan Pointer to gttcan_t structure containing timing configuration
  * 
- * @return Time delay in system time units until next transmission should occur
+ * @return Time delay in system time units until next transmission should occur
+ * 
+ * @note Accounts for interrupt_timing_offset to compensate for processing delays
+ * @note Returns minimum delay of 1 time unit if calculated delay would be too small
+ * @note Used internally by gttcan_transmit_next_frame() and gttcan_process_frame()
+ * @note Time calculation: (slots_to_next * slot_duration) - interrupt_timing_offset
+ * @note With GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS, the bus time saved by the shorter frames in
+ *          between is taken off, from the precomputed slot start offsets
+ */
+uint32_t gttcan_get_time_to_next_transmission(uint16_t current_slot_id, gttcan_t *gttcan)
+{
+    uint16_t next_slot_id = GTTCAN_LOCAL_ENTRY(gttcan, gttcan->local_schedule_index).slot_id;
+    uint32_t time_to_next_transmission = gttcan_get_time_between_slots(gttcan, current_slot_id, next_slot_id);
+
+    if (time_to_next_transmission > gttcan->interrupt_timing_offset)
+    {
+        return time_to_next_transmission - gttcan->interrupt_timing_offset;
+    }
+    else
+    {
+        return 1;
+    }
+}
+
+/**
+ * @brief Register the frame layouts used to pack several signals into one payload
+ * 
+ * Frames whose data_id has a layout are packed from, and unpacked into, the individual
+ * signals of the layout, each read and written through read_value_fp and write_value_fp
+ * with the signal's data_id. Frames without a layout carry a single value as before.
+ * This lets many small values (flags, ADC readings) share one slot.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param frame_layouts Array of frame layouts, or NULL to disable signal packing
+ * @param frame_layout_count Number of entries in frame_layouts
+ * 
+ * @return false, leaving the previous layouts in use, if a signal does not fit in the payload
+ * 
+ * @note Precomputes the mask of every signal and sorts the layouts by data_id in place, so both
+ *          arrays must be writable
+ * @note The layouts must remain valid for the lifetime of the gttcan instance
+ * @note All nodes sending or receiving a data_id must use the same layout for it
+ * @note Signals must be 1 to 64 bits wide and fit within the 64-bit payload (bit_offset + bit_width <= 64)
+ */
+bool gttcan_set_frame_layouts(gttcan_t *gttcan, gttcan_frame_layout_t *frame_layouts, uint8_t frame_layout_count)
+{
+    for (int i = 0; frame_layouts != NULL && i < frame_layout_count; i++)
+    {
+        for (int j = 0; j < frame_layouts[i].signal_count; j++)
+        {
+            const gttcan_signal_t *signal = &frame_layouts[i].signals[j];
+            if (signal->bit_width == 0 || signal->bit_offset >= 64 || signal->bit_offset + signal->bit_width > 64)
+            {
+                return false; // Would shift by 64 or more, or lose the top bits
+            }
+        }
+    }
+
+    for (int i = 0; frame_layouts != NULL && i < frame_layout_count; i++)
+    {
+        for (int j = 0; j < frame_layouts[i].signal_count; j++)
+        {
+            gttcan_signal_t *signal = &frame_layouts[i].signals[j];
+            if (signal->bit_width >= 64)
+            {
+                signal->mask = UINT64_MAX;
+            }
+            else
+            {
+                signal->mask = (1ULL << signal->bit_width) - 1;
+            }
+        }
+    }
+
+    // Sorted by data_id so gttcan_get_frame_layout() can search them in the interrupts
+    for (int i = 1; frame_layouts != NULL && i < frame_layout_count; i++)
+    {
+        gttcan_frame_layout_t frame_layout = frame_layouts[i];
+        int j = i;
+        for (; j > 0 && frame_layouts[j - 1].data_id > frame_layout.data_id; j--)
+        {
+            frame_layouts[j] = frame_layouts[j - 1];
+        }
+        frame_layouts[j] = frame_layout;
+    }
+
+    gttcan->frame_layouts = frame_layouts;
+    gttcan->frame_layout_count = (frame_layouts != NULL) ? frame_layout_count : 0;
+    return true;
+}
+
+/**
+ * @brief Find the frame layout registered for a data_id
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param data_id Data identifier of the frame
+ * 
+ * @return Pointer to the frame layout, or NULL if frames with this data_id carry a single value
+ * 
+ * @note Binary search of the layouts, which gttcan_set_frame_layouts() sorted by data_id
+ */
+gttcan_frame_layout_t *gttcan_get_frame_layout(gttcan_t *gttcan, uint16_t data_id)
+{
+    int low = 0;
+    int high = gttcan->frame_layout_count;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (gttcan->frame_layouts[middle].data_id < data_id)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low < gttcan->frame_layout_count && gttcan->frame_layouts[low].data_id == data_id)
+    {
+        return &gttcan->frame_layouts[low];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Build a frame payload from the signals of a frame layout
+ * 
+ * Reads every signal through read_value_fp, converts it to its raw value
+ * (raw = (value - scale_offset) / scale_factor) and packs it at its bit offset.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param frame_layout Layout of the frame to build
+ * 
+ * @return 64-bit payload to transmit
+ * 
+ * @note Raw values wider than the signal are truncated to bit_width bits, which keeps
+ *          negative raw values of signed signals in two's complement
+ */
+uint64_t gttcan_pack_frame(gttcan_t *gttcan, const gttcan_frame_layout_t *frame_layout)
+{
+    uint64_t payload = 0;
+    for (int i = 0; i < frame_layout->signal_count; i++)
+    {
+        const gttcan_signal_t *signal = &frame_layout->signals[i];
+        uint64_t raw = gttcan->read_value_fp(signal->data_id);
+        if (signal->scale_factor > 1 || signal->scale_factor < 0 || signal->scale_offset != 0)
+        {
+            int32_t scale_factor = (signal->scale_factor != 0) ? signal->scale_factor : 1;
+            raw = (uint64_t)(((int64_t)raw - signal->scale_offset) / scale_factor);
+        }
+        payload |= (raw & signal->mask) << signal->bit_offset;
+    }
+    return payload;
+}
+
+/**
+ * @brief Split a received frame payload into the signals of a frame layout
+ * 
+ * Extracts every signal at its bit offset, sign-extends it if is_signed, converts it to its
+ * value (value = raw * scale_factor + scale_offset) and passes it to write_value_fp.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param frame_layout Layout of the received frame
+ * @param data 64-bit payload of the received frame
+ */
+void gttcan_unpack_frame(gttcan_t *gttcan, const gttcan_frame_layout_t *frame_layout, uint64_t data)
+{
+    for (int i = 0; i < frame_layout->signal_count; i++)
+    {
+        const gttcan_signal_t *signal = &frame_layout->signals[i];
+        uint64_t value = (data >> signal->bit_offset) & signal->mask;
+        if (signal->is_signed && signal->bit_width < 64)
+        {
+            uint64_t sign_bit = 1ULL << (signal->bit_width - 1);
+            value = (value ^ sign_bit) - sign_bit;
+        }
+        if (signal->scale_factor > 1 || signal->scale_factor < 0 || signal->scale_offset != 0)
+        {
+            int32_t scale_factor = (signal->scale_factor != 0) ? signal->scale_factor : 1;
+            value = (uint64_t)((int64_t)value * scale_factor + signal->scale_offset);
+        }
+        gttcan->write_value_fp(signal->data_id, value);
+    }
+}
+
+/**
+ * @brief Set the data_ids this node consumes
+ * 
+ * Received data frames with other data_ids are no longer passed to write_value_fp, and
+ * gttcan_get_acceptance_filters() derives hardware filters that drop them before they
+ * raise a receive interrupt. Reference frames and the frames needed for time master
+ * tracking are always processed.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param data_ids Array of subscribed data_ids in ascending order, or NULL to receive every data_id
+ *          (the default)
+ * @param data_id_count Number of entries in data_ids
+ * 
+ * @return false, leaving the previous subscriptions in use, if data_ids is not in ascending order
+ * 
+ * @note The array must remain valid for the lifetime of the gttcan instance
+ * @note Data_ids carrying packed signals are subscribed by the data_id of the frame
+ * @note The order lets every received frame find its data_id by binary search
+ */
+bool gttcan_set_subscriptions(gttcan_t *gttcan, const uint16_t *data_ids, uint16_t data_id_count)
+{
+    for (int i = 1; data_ids != NULL && i < data_id_count; i++)
+    {
+        if (data_ids[i] <= data_ids[i - 1])
+        {
+            return false;
+        }
+    }
+
+    gttcan->subscribed_data_ids = data_ids;
+    gttcan->subscription_count = (data_ids != NULL) ? data_id_count : 0;
+#if GTTCAN_ENABLE_DATA_METRICS
+    gttcan_reset_data_metrics(gttcan);
+#endif
+    return true;
+}
+
+/**
+ * @brief Check whether this node consumes frames with a given data_id
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param data_id Data identifier of the frame
+ * 
+ * @return true if no subscription list is set or data_id is in it
+ * 
+ * @note Binary search of the subscriptions
+ */
+bool gttcan_is_subscribed(gttcan_t *gttcan, uint16_t data_id)
+{
+    return (gttcan->subscribed_data_ids == NULL) || (gttcan_get_subscription_index(gttcan, data_id) >= 0);
+}
+
+// Position of a data_id in the ascending subscription list, or -1
+static int gttcan_get_subscription_index(gttcan_t *gttcan, uint16_t data_id)
+{
+    int low = 0;
+    int high = gttcan->subscription_count;
+    while (low < high)
+    {
+        int middle = (low + high) / 2;
+        if (gttcan->subscribed_data_ids[middle] < data_id)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low < gttcan->subscription_count && gttcan->subscribed_data_ids[low] == data_id)
+    {
+        return low;
+    }
+    return -1;
+}
+
+// Whether every identifier accepted by inner is also accepted by outer
+static bool gttcan_filter_covers(const gttcan_filter_t *outer, const gttcan_filter_t *inner)
+{
+    return ((inner->mask & outer->mask) == outer->mask) && (((inner->id ^ outer->id) & outer->mask) == 0);
+}
+
+static uint8_t gttcan_count_bits(uint32_t value)
+{
+    uint8_t count = 0;
+    while (value)
+    {
+        value &= value - 1;
+        count++;
+    }
+    return count;
+}
+
+/*
+ Add a filter to a filter set, keeping the set small:
+ - filters already accepted by the set are dropped, and filters the new one covers are removed
+ - two filters with the same mask whose identifiers differ in one bit are merged exactly
+ - when the set is full, the two filters whose combination keeps the most mask bits are
+   merged, accepting a few identifiers that were not asked for
+*/
+static uint8_t gttcan_add_filter(gttcan_filter_t *filters, uint8_t filter_count, uint8_t max_filters, gttcan_filter_t filter)
+{
+    while (true)
+    {
+        filter.id &= filter.mask;
+
+        bool merged = false;
+        for (int i = 0; i < filter_count; i++)
+        {
+            if (gttcan_filter_covers(&filters[i], &filter))
+            {
+                return filter_count;
+            }
+            if (gttcan_filter_covers(&filter, &filters[i]))
+            {
+                filters[i--] = filters[--filter_count];
+                continue;
+            }
+            uint32_t difference = filters[i].id ^ filter.id;
+            if (filters[i].mask == filter.mask && (difference & (difference - 1)) == 0)
+            {
+                filter.mask &= ~difference;
+                filters[i] = filters[--filter_count];
+                merged = true;
+                break;
+            }
+        }
+        if (merged)
+        {
+            continue; // The merged filter may merge again
+        }
+
+        if (filter_count < max_filters)
+        {
+            filters[filter_count++] = filter;
+            return filter_count;
+        }
+
+        // Full, widen the closest pair, index filter_count standing for the new filter
+        int best_a = 0, best_b = filter_count;
+        int best_bits = -1;
+        for (int a = 0; a < filter_count; a++)
+        {
+            for (int b = a + 1; b <= filter_count; b++)
+            {
+                const gttcan_filter_t *other = (b < filter_count) ? &filters[b] : &filter;
+                int bits = gttcan_count_bits(filters[a].mask & other->mask & ~(filters[a].id ^ other->id));
+                if (bits > best_bits)
+                {
+                    best_bits = bits;
+                    best_a = a;
+                    best_b = b;
+                }
+            }
+        }
+        gttcan_filter_t *other = (best_b < filter_count) ? &filters[best_b] : &filter;
+        gttcan_filter_t widened = {filters[best_a].id, filters[best_a].mask & other->mask & ~(filters[best_a].id ^ other->id)};
+        if (best_b < filter_count)
+        {
+            // Both came from the set, which keeps the new filter pending
+            filters[best_b] = filters[--filter_count];
+            filters[best_a] = widened;
+        }
+        else
+        {
+            filters[best_a] = filters[--filter_count];
+            filter = widened;
+        }
+    }
+}
+
+/**
+ * @brief Derive CAN acceptance filters for this node from the schedule and its subscriptions
+ * 
+ * Builds a small set of identifier/mask filters that accepts:
+ * - all reference frames (and schedule update frames)
+ * - every frame whose data_id is subscribed (see gttcan_set_subscriptions())
+ * - one frame per round from every node with a lower node_id, which the time master
+ *   election needs to see
+ * Filters that differ in a single identifier bit are merged, and if more than max_filters
+ * remain, the closest filters are widened, so the hardware may accept some extra frames.
+ * These are handled as before, unsubscribed data is simply not passed to write_value_fp.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param filters Array receiving the filters
+ * @param max_filters Number of filter banks available
+ * 
+ * @return Number of filters written, a single accept-all filter if no subscription list is set
+ * 
+ * @note Call after gttcan_init() and gttcan_set_subscriptions(), outside interrupt context
+ * @note Linear in the global schedule length, and quadratic in max_filters when widening
+ * @note Shuffle correction only sees the accepted frames, so nodes that filter rely mostly
+ *          on reference frames to stay aligned
+ */
+uint8_t gttcan_get_acceptance_filters(gttcan_t *gttcan, gttcan_filter_t *filters, uint8_t max_filters)
+{
+    if (max_filters == 0)
+    {
+        return 0;
+    }
+    if (gttcan->subscribed_data_ids == NULL)
+    {
+        filters[0].id = 0;
+        filters[0].mask = 0;
+        return 1;
+    }
+
+    uint8_t filter_count = 0;
+    gttcan_filter_t filter;
+
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    // The data_id is not on the bus, accept the slots carrying reference frames and subscribed data
+    for (int i = 0; i < gttcan->global_schedule_length; i++)
+    {
+        global_schedule_entry_t entry;
+        if (!gttcan_get_global_entry(gttcan, (uint16_t)i, &entry))
+        {
+            continue;
+        }
+        bool is_shared_entry = entry.data_id == REFERENCE_FRAME_DATA_ID;
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+        is_shared_entry = is_shared_entry || entry.data_id == GTTCAN_SCHEDULE_UPDATE_DATA_ID;
+#endif
+        bool is_subscribed = gttcan_is_subscribed(gttcan, entry.data_id);
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+        is_subscribed = is_subscribed || (entry.node_id_b != 0 && gttcan_is_subscribed(gttcan, entry.data_id_b));
+#endif
+        if (is_shared_entry || is_subscribed)
+        {
+            filter.id = gttcan_build_frame_id(entry.slot_id, entry.data_id);
+            filter.mask = GTTCAN_FRAME_ID_MASK;
+            filter_count = gttcan_add_filter(filters, filter_count, max_filters, filter);
+        }
+    }
+#else
+    // Reference frames and subscribed data in whatever slot they are sent
+    filter.id = REFERENCE_FRAME_DATA_ID;
+    filter.mask = GTTCAN_DATA_ID_MASK;
+    filter_count = gttcan_add_filter(filters, filter_count, max_filters, filter);
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    filter.id = GTTCAN_SCHEDULE_UPDATE_DATA_ID;
+    filter_count = gttcan_add_filter(filters, filter_count, max_filters, filter);
+#endif
+    for (int i = 0; i < gttcan->subscription_count; i++)
+    {
+        filter.id = gttcan->subscribed_data_ids[i];
+        filter.mask = GTTCAN_DATA_ID_MASK;
+        filter_count = gttcan_add_filter(filters, filter_count, max_filters, filter);
+    }
+#endif
+
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    // The slots we may reclaim, to hear whether their owner is still there
+    for (int i = 0; i < gttcan->local_schedule_length; i++)
+    {
+        const local_schedule_entry_t *local_entry = &gttcan->local_schedule[i];
+        if (local_entry->backup_index != GTTCAN_NO_SLOT_BACKUP)
+        {
+            filter.id = (uint32_t)local_entry->slot_id << GTTCAN_NUM_DATA_ID_BITS;
+            filter.mask = GTTCAN_FRAME_ID_MASK & ~GTTCAN_DATA_ID_MASK;
+            filter_count = gttcan_add_filter(filters, filter_count, max_filters, filter);
+        }
+    }
+#endif
+
+    // The first slot of every lower node_id, so this node knows whether it should be time master
+    uint32_t seen_node_ids[8] = {0};
+    for (int i = 0; i < gttcan->global_schedule_length; i++)
+    {
+        global_schedule_entry_t entry;
+        if (!gttcan_get_global_entry(gttcan, (uint16_t)i, &entry) ||
+            entry.node_id >= gttcan->node_id || (seen_node_ids[entry.node_id >> 5] & (1UL << (entry.node_id & 31))))
+        {
+            continue;
+        }
+        seen_node_ids[entry.node_id >> 5] |= 1UL << (entry.node_id & 31);
+
+        filter.id = gttcan_build_frame_id(entry.slot_id, entry.data_id);
+        filter.mask = GTTCAN_FRAME_ID_MASK;
+        filter_count = gttcan_add_filter(filters, filter_count, max_filters, filter);
+    }
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+    // Lower node_ids that only send on channel B
+    for (int i = 0; i < gttcan->global_schedule_length; i++)
+    {
+        global_schedule_entry_t entry;
+        if (!gttcan_get_global_entry(gttcan, (uint16_t)i, &entry) || entry.node_id_b == 0 ||
+            entry.node_id_b >= gttcan->node_id || (seen_node_ids[entry.node_id_b >> 5] & (1UL << (entry.node_id_b & 31))))
+        {
+            continue;
+        }
+        seen_node_ids[entry.node_id_b >> 5] |= 1UL << (entry.node_id_b & 31);
+
+        filter.id = gttcan_build_frame_id(entry.slot_id, entry.data_id_b);
+        filter.mask = GTTCAN_FRAME_ID_MASK;
+        filter_count = gttcan_add_filter(filters, filter_count, max_filters, filter);
+    }
+#endif
+
+    return filter_count;
+}
+
+/**
+ * @brief Read the data age statistics of a subscribed data_id
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param data_id Subscribed data identifier
+ * @param metrics Receives the statistics since the subscriptions were set or last reset.
+ *          Latency and jitter fields are 0 until a value has been timestamped
+ * 
+ * @return false if GTTCAN_ENABLE_DATA_METRICS is not set or data_id is not among the first
+ *          GTTCAN_MAX_DATA_METRICS subscribed data_ids
+ * 
+ * @note Rounds completed since the last receipt of the data_id are counted as missed
+ * @note Call outside interrupt context, the means need a division
+ */
+bool gttcan_get_data_metrics(gttcan_t *gttcan, uint16_t data_id, gttcan_data_metrics_t *metrics)
+{
+#if GTTCAN_ENABLE_DATA_METRICS
+    int index = gttcan_get_subscription_index(gttcan, data_id);
+    if (index < 0 || index >= GTTCAN_MAX_DATA_METRICS)
+    {
+        return false;
+    }
+    const gttcan_data_metrics_state_t *state = &gttcan->data_metrics[index];
+
+    metrics->received_count = state->received_count;
+    metrics->missed_count = state->missed_count;
+    if (state->received_count > 0)
+    {
+        metrics->missed_count += gttcan_count_missed_updates(state, gttcan->cycle_count);
+    }
+
+    metrics->latency_min = state->latency_count ? state->latency_min : 0;
+    metrics->latency_max = state->latency_max;
+    metrics->latency_mean = state->latency_count ? (uint32_t)(state->latency_sum / state->latency_count) : 0;
+    metrics->jitter_min = state->jitter_count ? state->jitter_min : 0;
+    metrics->jitter_max = state->jitter_max;
+    metrics->jitter_mean = state->jitter_count ? (uint32_t)(state->jitter_sum / state->jitter_count) : 0;
+    return true;
+#else
+    (void)gttcan;
+    (void)data_id;
+    (void)metrics;
+    return false;
+#endif
+}
+
+/**
+ * @brief Clear the data age statistics of all subscribed data_ids
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @note Called by gttcan_set_subscriptions(), linear in the global schedule length
+ */
+void gttcan_reset_data_metrics(gttcan_t *gttcan)
+{
+#if GTTCAN_ENABLE_DATA_METRICS
+    for (int i = 0; i < gttcan->subscription_count && i < GTTCAN_MAX_DATA_METRICS; i++)
+    {
+        gttcan_data_metrics_state_t *state = &gttcan->data_metrics[i];
+        *state = (gttcan_data_metrics_state_t){0};
+        state->latency_min = UINT32_MAX;
+        state->jitter_min = UINT32_MAX;
+        for (int j = 0; j < gttcan->global_schedule_length; j++)
+        {
+            // Our own frames are never received
+            global_schedule_entry_t entry;
+            if (gttcan_get_global_entry(gttcan, (uint16_t)j, &entry) &&
+                entry.data_id == gttcan->subscribed_data_ids[i] && entry.node_id != gttcan->node_id)
+            {
+                state->frames_per_round++;
+            }
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+            if (entry.node_id_b != 0 && entry.node_id_b != gttcan->node_id &&
+                entry.data_id_b == gttcan->subscribed_data_ids[i] && entry.data_id != REFERENCE_FRAME_DATA_ID)
+            {
+                state->frames_per_round++;
+            }
+#endif
+        }
+    }
+#else
+    (void)gttcan;
+#endif
+}
+
+#if GTTCAN_ENABLE_DATA_METRICS
+/**
+ * @brief Timestamp a received subscribed frame against the start of its slot
+ * 
+ * The slot start is the start of the last reference frame slot in global time (taken from
+ * its payload, or the master's own send time) plus the scheduled time between the two slots
+ * at the slot_duration given to gttcan_init().
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param slot_id Slot the frame was received in
+ * @param data_id Data identifier of the frame
+ */
+static void gttcan_update_data_metrics(gttcan_t *gttcan, uint16_t slot_id, uint16_t data_id)
+{
+    int index = gttcan_get_subscription_index(gttcan, data_id);
+    if (index < 0 || index >= GTTCAN_MAX_DATA_METRICS)
+    {
+        return;
+    }
+    gttcan_data_metrics_state_t *state = &gttcan->data_metrics[index];
+
+    // The round a frame belongs to follows from the last reference frame, as our own round
+    // may start a little before or after the master's
+    uint32_t cycle_count = gttcan->cycle_count;
+    if (gttcan->has_reference_slot)
+    {
+        cycle_count = gttcan->reference_cycle_count + ((slot_id < gttcan->reference_slot_id) ? 1 : 0);
+    }
+
+    // Close the rounds since the last receipt
+    if (state->received_count > 0 && state->round_cycle_count != cycle_count)
+    {
+        state->missed_count += gttcan_count_missed_updates(state, cycle_count);
+        state->round_received_count = 0;
+    }
+    state->round_cycle_count = cycle_count;
+    state->round_received_count++;
+    if (state->received_count == 0)
+    {
+        state->round_received_count = state->frames_per_round; // Counting starts part way through this round
+    }
+    state->received_count++;
+
+    if (gttcan->get_local_time_fp == NULL || !gttcan->has_reference_slot)
+    {
+        return;
+    }
+
+    // Slots run at the configured slot_duration in network time, the local one follows drift
+    uint32_t slot_start = gttcan->reference_slot_start + gttcan_scale_slots(gttcan, gttcan->reference_slot_id, slot_id, gttcan->nominal_slot_duration);
+    int32_t signed_latency = (int32_t)(gttcan_local_to_global_time(gttcan, gttcan->GTTCAN_RX_EVENT_LOCAL_TIME) - slot_start);
+    uint32_t latency = (signed_latency > 0) ? (uint32_t)signed_latency : 0;
+
+    if (state->latency_count > 0)
+    {
+        uint32_t jitter = (latency > state->last_latency) ? latency - state->last_latency : state->last_latency - latency;
+        if (jitter < state->jitter_min)
+        {
+            state->jitter_min = jitter;
+        }
+        if (jitter > state->jitter_max)
+        {
+            state->jitter_max = jitter;
+        }
+        state->jitter_sum += jitter;
+        state->jitter_count++;
+    }
+
+    if (latency < state->latency_min)
+    {
+        state->latency_min = latency;
+    }
+    if (latency > state->latency_max)
+    {
+        state->latency_max = latency;
+    }
+    state->latency_sum += latency;
+    state->latency_count++;
+    state->last_latency = latency;
+}
+
+/**
+ * @brief Count the scheduled frames of a data_id not received since its last receipt
+ * 
+ * @param state Metrics of the data_id
+ * @param cycle_count Current round
+ * 
+ * @return Missing frames in the round of the last receipt and every full round since
+ */
+static uint32_t gttcan_count_missed_updates(const gttcan_data_metrics_state_t *state, uint32_t cycle_count)
+{
+    int32_t rounds_passed = (int32_t)(cycle_count - state->round_cycle_count);
+    if (rounds_passed <= 0)
+    {
+        return 0; // Same round, or the cycle counter was taken over from a new master
+    }
+
+    uint32_t missed = (uint32_t)(rounds_passed - 1) * state->frames_per_round;
+    if (state->round_received_count < state->frames_per_round)
+    {
+        missed += state->frames_per_round - state->round_received_count;
+    }
+    return missed;
+}
+#endif
+
+/**
+ * @brief Set the slot backup table used to reclaim the slots of silent nodes
+ * 
+ * For every entry naming this node as backup, the slots of the owner are added to the local
+ * schedule. They are only transmitted in, with the entry's data_id, while the owner has not
+ * been heard for GTTCAN_RECLAIM_AFTER_SILENT_ROUNDS rounds. Every node uses the table to tell
+ * backup frames apart from owner frames, so all nodes should be given the same table.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param slot_backups Array of slot backups, or NULL for none
+ * @param slot_backup_count Number of entries in slot_backups, at most GTTCAN_MAX_SLOT_BACKUPS
+ * 
+ * @note Rebuilds the local schedule, so call after gttcan_init() and before gttcan_start() or gttcan_join()
+ * @note The array must remain valid for the lifetime of the gttcan instance
+ * @note Does nothing unless GTTCAN_ENABLE_SLOT_RECLAMATION is set
+ */
+void gttcan_set_slot_backups(gttcan_t *gttcan, const gttcan_slot_backup_t *slot_backups, uint8_t slot_backup_count)
+{
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    if (slot_backups == NULL || slot_backup_count > GTTCAN_MAX_SLOT_BACKUPS)
+    {
+        slot_backup_count = (slot_backups == NULL) ? 0 : GTTCAN_MAX_SLOT_BACKUPS;
+    }
+    gttcan->slot_backups = slot_backups;
+    gttcan->slot_backup_count = slot_backup_count;
+    for (int i = 0; i < slot_backup_count; i++)
+    {
+        gttcan->owner_silent_rounds[i] = 0;
+    }
+    gttcan_get_local_schedule(gttcan, gttcan->global_schedule_ptr);
+#else
+    (void)gttcan;
+    (void)slot_backups;
+    (void)slot_backup_count;
+#endif
+}
+
+/**
+ * @brief Check whether a node with a backup has been silent long enough to lose its slots
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param node_id Owner node to check
+ * 
+ * @return true if node_id is an owner in the slot backup table and has not been heard for
+ *          GTTCAN_RECLAIM_AFTER_SILENT_ROUNDS rounds
+ */
+bool gttcan_is_node_silent(gttcan_t *gttcan, uint8_t node_id)
+{
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    for (int i = 0; i < gttcan->slot_backup_count; i++)
+    {
+        if (gttcan->slot_backups[i].owner_node_id == node_id)
+        {
+            return gttcan->owner_silent_rounds[i] >= GTTCAN_RECLAIM_AFTER_SILENT_ROUNDS;
+        }
+    }
+#else
+    (void)gttcan;
+    (void)node_id;
+#endif
+    return false;
+}
+
+/**
+ * @brief Queue an on-demand message for the node's next preemptible or pool slot
+ * 
+ * Messages go out most urgent first, and in the order they were queued among equal
+ * priorities, each in one of the node's slots with policy GTTCAN_SLOT_PREEMPTIBLE or
+ * GTTCAN_SLOT_POOL, with data_id in the identifier.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param data_id Data identifier receivers know the message by
+ * @param data Payload
+ * @param priority Urgency, lower values are sent first
+ * 
+ * @return false if the queue is full, data_id is reserved for reference frames or schedule
+ *          updates, or GTTCAN_ENABLE_ON_DEMAND is not set
+ * 
+ * @note May be called while the timer interrupt runs, but not from two contexts at once
+ * @note data is taken as it is, not through the frame layouts
+ */
+bool gttcan_queue_on_demand(gttcan_t *gttcan, uint16_t data_id, uint64_t data, uint8_t priority)
+{
+#if GTTCAN_ENABLE_ON_DEMAND
+    if (data_id == REFERENCE_FRAME_DATA_ID)
+    {
+        return false;
+    }
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    if (data_id == GTTCAN_SCHEDULE_UPDATE_DATA_ID)
+    {
+        return false;
+    }
+#endif
+    for (int i = 0; i < GTTCAN_ON_DEMAND_QUEUE_LENGTH; i++)
+    {
+        volatile gttcan_on_demand_message_t *message = &gttcan->on_demand_queue[i];
+        if (!message->is_queued)
+        {
+            message->data = data;
+            message->data_id = data_id;
+            message->priority = priority;
+            message->sequence = gttcan->on_demand_sequence++;
+            message->is_queued = true; // Hands the entry to the timer interrupt
+            return true;
+        }
+    }
+#else
+    (void)gttcan;
+    (void)data_id;
+    (void)data;
+    (void)priority;
+#endif
+    return false;
+}
+
+/**
+ * @brief Get the number of on-demand messages waiting to be sent
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return Number of queued messages, 0 if GTTCAN_ENABLE_ON_DEMAND is not set
+ */
+uint8_t gttcan_get_on_demand_count(gttcan_t *gttcan)
+{
+    uint8_t count = 0;
+#if GTTCAN_ENABLE_ON_DEMAND
+    for (int i = 0; i < GTTCAN_ON_DEMAND_QUEUE_LENGTH; i++)
+    {
+        if (gttcan->on_demand_queue[i].is_queued)
+        {
+            count++;
+        }
+    }
+#else
+    (void)gttcan;
+#endif
+    return count;
+}
+
+#if GTTCAN_ENABLE_ON_DEMAND
+/**
+ * @brief Take the most urgent on-demand message off the queue
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param data_id Set to the data identifier of the message
+ * @param data Set to the payload of the message
+ * 
+ * @return false if no message is queued
+ */
+static bool gttcan_take_on_demand_message(gttcan_t *gttcan, uint16_t *data_id, uint64_t *data)
+{
+    int best_index = -1;
+    for (int i = 0; i < GTTCAN_ON_DEMAND_QUEUE_LENGTH; i++)
+    {
+        volatile gttcan_on_demand_message_t *message = &gttcan->on_demand_queue[i];
+        if (!message->is_queued)
+        {
+            continue;
+        }
+        if (best_index < 0)
+        {
+            best_index = i;
+            continue;
+        }
+        volatile gttcan_on_demand_message_t *best = &gttcan->on_demand_queue[best_index];
+        if (message->priority < best->priority ||
+            (message->priority == best->priority && (int16_t)(message->sequence - best->sequence) < 0))
+        {
+            best_index = i;
+        }
+    }
+    if (best_index < 0)
+    {
+        return false;
+    }
+    *data_id = gttcan->on_demand_queue[best_index].data_id;
+    *data = gttcan->on_demand_queue[best_index].data;
+    gttcan->on_demand_queue[best_index].is_queued = false; // Frees the entry for gttcan_queue_on_demand()
+    return true;
+}
+#endif
+
+/**
+ * @brief Check whether the node sends data in a local schedule entry
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param local_schedule_index Entry of the local schedule
+ * 
+ * @return false for reference frame and schedule update entries, for reclaimable slots whose
+ *          owner is present, and while the node waits for a schedule it should already be using
+ */
+static bool gttcan_is_sending_data(gttcan_t *gttcan, uint16_t local_schedule_index)
+{
+    local_schedule_entry_t entry = GTTCAN_LOCAL_ENTRY(gttcan, local_schedule_index);
+    if (entry.data_id == REFERENCE_FRAME_DATA_ID)
+    {
+        return false;
+    }
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    if (entry.data_id == GTTCAN_SCHEDULE_UPDATE_DATA_ID || gttcan->is_schedule_stale)
+    {
+        return false;
+    }
+#endif
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    if (entry.backup_index != GTTCAN_NO_SLOT_BACKUP)
+    {
+        return gttcan->owner_silent_rounds[entry.backup_index] >= GTTCAN_RECLAIM_AFTER_SILENT_ROUNDS;
+    }
+#endif
+    return true;
+}
+
+/**
+ * @brief Get the payload of a data_id the node sends
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param data_id Data identifier to send
+ * 
+ * @return The signals of its frame layout packed together, or else the value from read_value_fp
+ */
+static uint64_t gttcan_read_data_payload(gttcan_t *gttcan, uint16_t data_id)
+{
+    gttcan_frame_layout_t *frame_layout = gttcan_get_frame_layout(gttcan, data_id);
+    if (frame_layout != NULL)
+    {
+        return gttcan_pack_frame(gttcan, frame_layout);
+    }
+    return gttcan->read_value_fp(data_id);
+}
+
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+/**
+ * @brief Send the frames of a local schedule entry on each channel the node has in the slot
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param entry Local schedule entry of the slot
+ * @param frame_id Identifier of the frame on the first channel
+ * @param data_id Data sent on the first channel, the scheduled one or an on-demand message
+ * @param payload Payload of the frame on the first channel
+ * 
+ * @note Channel B repeats the frame when it carries the same data_id, and reads its own data otherwise
+ */
+static void gttcan_transmit_on_channels(gttcan_t *gttcan, local_schedule_entry_t entry, uint32_t frame_id, uint16_t data_id, uint64_t payload)
+{
+    if (entry.channels & (1U << GTTCAN_CHANNEL_A))
+    {
+        GTTCAN_TRACE(gttcan, GTTCAN_TRACE_FRAME_SENT, frame_id, payload);
+        gttcan->transmit_frame_callback_fp(frame_id, payload);
+        if (!(entry.channels & (1U << GTTCAN_CHANNEL_B)))
+        {
+            return;
+        }
+        if (entry.data_id_b != data_id)
+        {
+            frame_id = gttcan_build_frame_id(entry.slot_id, entry.data_id_b);
+            payload = gttcan_read_data_payload(gttcan, entry.data_id_b);
+        }
+    }
+    if (gttcan->transmit_frame_b_callback_fp != NULL)
+    {
+        GTTCAN_TRACE(gttcan, GTTCAN_TRACE_FRAME_SENT, frame_id, payload);
+        gttcan->transmit_frame_b_callback_fp(frame_id, payload);
+    }
+}
+#endif
+
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+/**
+ * @brief Find the slot backup entry that lets this node use a slot of another node
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param entry Global schedule entry of the slot
+ * 
+ * @return Index into the slot backup table, or GTTCAN_NO_SLOT_BACKUP
+ */
+static uint8_t gttcan_get_backup_index(gttcan_t *gttcan, const global_schedule_entry_t *entry)
+{
+    if (entry->data_id == REFERENCE_FRAME_DATA_ID)
+    {
+        return GTTCAN_NO_SLOT_BACKUP;
+    }
+    for (int i = 0; i < gttcan->slot_backup_count; i++)
+    {
+        const gttcan_slot_backup_t *slot_backup = &gttcan->slot_backups[i];
+        // The owner must win arbitration when it comes back
+        if (slot_backup->owner_node_id == entry->node_id && slot_backup->backup_node_id == gttcan->node_id &&
+            slot_backup->data_id > entry->data_id)
+        {
+            return (uint8_t)i;
+        }
+    }
+    return GTTCAN_NO_SLOT_BACKUP;
+}
+
+/**
+ * @brief Check whether a local schedule entry is one the node acts on this round
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param local_schedule_index Entry of the local schedule
+ * 
+ * @return false only for reclaimable slots whose owner has not gone silent
+ */
+static bool gttcan_is_slot_used(gttcan_t *gttcan, uint16_t local_schedule_index)
+{
+    return gttcan->local_schedule[local_schedule_index].backup_index == GTTCAN_NO_SLOT_BACKUP ||
+           gttcan_is_sending_data(gttcan, local_schedule_index);
+}
+
+/**
+ * @brief Find the slot of the nearest local schedule entry the node is using
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param local_schedule_index Entry to start from
+ * @param step 1 to search forwards, -1 to search backwards
+ * @param default_slot_id Returned if the search leaves the local schedule
+ * 
+ * @return slot_id of the first entry that is not a reclaimable slot left to its owner
+ */
+static uint16_t gttcan_get_used_slot_id(gttcan_t *gttcan, int local_schedule_index, int step, uint16_t default_slot_id)
+{
+    while (local_schedule_index >= 0 && local_schedule_index < gttcan->local_schedule_length)
+    {
+        if (gttcan_is_slot_used(gttcan, (uint16_t)local_schedule_index))
+        {
+            return gttcan->local_schedule[local_schedule_index].slot_id;
+        }
+        local_schedule_index += step;
+    }
+    return default_slot_id;
+}
+
+/**
+ * @brief Move past the reclaimable slots left to their owner this round
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param local_schedule_index Entry to start from
+ * 
+ * @return The first entry from local_schedule_index on that the node is using, or
+ *          local_schedule_length if there is none
+ */
+static uint16_t gttcan_skip_unused_slots(gttcan_t *gttcan, uint16_t local_schedule_index)
+{
+    while (local_schedule_index < gttcan->local_schedule_length && !gttcan_is_slot_used(gttcan, local_schedule_index))
+    {
+        local_schedule_index++;
+    }
+    return local_schedule_index;
+}
+
+/**
+ * @brief Work out which node sent a received frame, and note owners that are present
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param rx_node_id Owner of the slot in the global schedule
+ * @param scheduled_data_id Data identifier of the slot in the global schedule
+ * @param data_id Data identifier of the received frame
+ * 
+ * @return The owner if the frame carries the scheduled data_id, otherwise the backup whose
+ *          data_id it carries (or the owner if there is none)
+ */
+static uint8_t gttcan_attribute_frame(gttcan_t *gttcan, uint8_t rx_node_id, uint16_t scheduled_data_id, uint16_t data_id)
+{
+    uint8_t sender_node_id = rx_node_id;
+    for (int i = 0; i < gttcan->slot_backup_count; i++)
+    {
+        const gttcan_slot_backup_t *slot_backup = &gttcan->slot_backups[i];
+        if (slot_backup->owner_node_id != rx_node_id)
+        {
+            continue;
+        }
+        if (data_id == scheduled_data_id)
+        {
+            gttcan->owner_silent_rounds[i] = 0;
+        }
+        else if (data_id == slot_backup->data_id)
+        {
+            sender_node_id = slot_backup->backup_node_id;
+        }
+    }
+    return sender_node_id;
+}
+#endif
+
+/**
+ * @brief Give the node two buffers to receive schedule updates into
+ * 
+ * A received schedule is collected into whichever buffer is not holding the active schedule,
+ * and becomes the active global schedule at its switch round, so the buffers take turns.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param buffer_a First buffer of capacity entries
+ * @param buffer_b Second buffer of capacity entries
+ * @param capacity Number of entries each buffer holds, at most MAX_GLOBAL_SCHEDULE_LENGTH
+ * 
+ * @note Without buffers the node still follows updates it is given through gttcan_update_schedule(),
+ *          but ignores updates streamed over the bus
+ * @note Call after gttcan_init() and before gttcan_start() or gttcan_join(). The buffers must
+ *          remain valid for the lifetime of the gttcan instance
+ * @note Does nothing unless GTTCAN_ENABLE_SCHEDULE_UPDATE is set
+ */
+void gttcan_set_schedule_update_buffers(gttcan_t *gttcan, global_schedule_entry_t *buffer_a, global_schedule_entry_t *buffer_b, uint16_t capacity)
+{
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    if (buffer_a == NULL || buffer_b == NULL)
+    {
+        capacity = 0;
+    }
+    gttcan->schedule_update_buffers[0] = buffer_a;
+    gttcan->schedule_update_buffers[1] = buffer_b;
+    gttcan->schedule_update_capacity = (capacity > MAX_GLOBAL_SCHEDULE_LENGTH) ? MAX_GLOBAL_SCHEDULE_LENGTH : capacity;
+    gttcan_clear_schedule_update(gttcan);
+#else
+    (void)gttcan;
+    (void)buffer_a;
+    (void)buffer_b;
+    (void)capacity;
+#endif
+}
+
+/**
+ * @brief Switch the network to a new global schedule at a given round
+ * 
+ * Builds the new local schedule straight away, into the spare local schedule buffer, and
+ * switches to it at the start of round switch_cycle_count. While this node is time master it
+ * streams the schedule in the schedule update slots, so every other node can follow; after
+ * the switch it keeps streaming it, for nodes that join late or missed part of it.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param global_schedule_ptr New global schedule, which must remain valid while it is in use
+ * @param global_schedule_length Number of entries in the new global schedule
+ * @param version Version of the new schedule, different from the active one (see gttcan_get_schedule_version())
+ * @param switch_cycle_count Cycle count of the first round to run on the new schedule
+ *          (see gttcan_get_cycle_count()), far enough ahead for the whole schedule to be
+ *          streamed at least once, and preferably a few times
+ * 
+ * @return false if the schedule is not usable: the version is the active one, it is longer
+ *          than MAX_GLOBAL_SCHEDULE_LENGTH, does not start with a reference frame in slot 0,
+ *          has a slot_id beyond its length, or gives this node too many slots
+ * 
+ * @note Intended to be called on the time master, from the main loop, as it is linear in the schedule length
+ * @note Also call gttcan_set_subscriptions() or gttcan_reset_data_metrics() and re-derive the
+ *          acceptance filters once gttcan_get_schedule_version() returns the new version
+ */
+bool gttcan_update_schedule(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr, uint16_t global_schedule_length, uint8_t version, uint32_t switch_cycle_count)
+{
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    if (version == gttcan->schedule_version)
+    {
+        return false;
+    }
+    gttcan->pending_schedule_ptr = NULL;
+    if (!gttcan_prepare_schedule(gttcan, global_schedule_ptr, global_schedule_length))
+    {
+        return false;
+    }
+
+    gttcan->update_version = version;
+    gttcan->update_length = global_schedule_length;
+    gttcan->update_crc = gttcan_get_schedule_crc(global_schedule_ptr, global_schedule_length);
+    gttcan->update_switch_cycle_count = switch_cycle_count;
+    gttcan->update_received_count = global_schedule_length;
+    gttcan->update_stream_position = 0;
+    gttcan->has_update_header = true;
+    gttcan->has_update_switch_cycle = true;
+    gttcan->pending_schedule_ptr = global_schedule_ptr; // Last, this makes the update live
+    return true;
+#else
+    (void)gttcan;
+    (void)global_schedule_ptr;
+    (void)global_schedule_length;
+    (void)version;
+    (void)switch_cycle_count;
+    return false;
+#endif
+}
+
+/**
+ * @brief Check and prepare a schedule update received over the bus
+ * 
+ * Once every entry of a streamed schedule has arrived, checks its CRC and builds the new
+ * local schedule into the spare local schedule buffer, ready for the switch round. If the
+ * CRC does not match, the entries are collected again from the next repetition.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * 
+ * @note Call regularly from the main loop (the work is linear in the schedule length, so it
+ *          is kept out of the receive interrupt). A node that has not prepared the schedule by
+ *          the switch round stops sending data until it has
+ * @note While it checks the buffer the receive interrupt leaves the update alone, dropping
+ *          update frames that would change it, so they are taken from the next repetition
+ * @note Does nothing unless GTTCAN_ENABLE_SCHEDULE_UPDATE is set
+ */
+void gttcan_poll_schedule_update(gttcan_t *gttcan)
+{
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    uint8_t generation = gttcan->update_generation;
+    if (!gttcan->has_update_header || gttcan->pending_schedule_ptr != NULL ||
+        gttcan->update_received_count != gttcan->update_length)
+    {
+        return;
+    }
+
+    // Claim the buffer, then make sure the update was not dropped for a newer one before we did
+    gttcan->is_preparing_update = true;
+    GTTCAN_COMPILER_BARRIER();
+    if (gttcan->update_generation == generation)
+    {
+        global_schedule_entry_t *buffer = gttcan_get_schedule_update_buffer(gttcan);
+        if (gttcan_get_schedule_crc(buffer, gttcan->update_length) == gttcan->update_crc &&
+            gttcan_prepare_schedule(gttcan, buffer, gttcan->update_length))
+        {
+            gttcan->pending_schedule_ptr = buffer;
+        }
+        else
+        {
+            // Corrupted, or not a schedule we can run, so collect it again
+            for (int i = 0; i < (int)sizeof(gttcan->update_received); i++)
+            {
+                gttcan->update_received[i] = 0;
+            }
+            gttcan->update_received_count = 0;
+        }
+    }
+    GTTCAN_COMPILER_BARRIER();
+    gttcan->is_preparing_update = false; // Hands the update back to the receive interrupt
+#else
+    (void)gttcan;
+#endif
+}
+
+/**
+ * @brief Get the version of the active global schedule
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return 0 for the schedule given to gttcan_init(), otherwise the version it was updated to
+ */
+uint8_t gttcan_get_schedule_version(gttcan_t *gttcan)
+{
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    return gttcan->schedule_version;
+#else
+    (void)gttcan;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Compute the CRC-16 of a global schedule, as carried in schedule update header frames
+ * 
+ * CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) over node_id, slot_id, data_id
+ * and dlc of every entry, in that order, with 16-bit fields least significant byte first.
+ * The dlc byte is 0 in builds whose entries have no dlc, and with GTTCAN_ENABLE_ON_DEMAND
+ * the slot policy is in its bits 4-5.
+ * 
+ * @param global_schedule_ptr Pointer to the global schedule array
+ * @param global_schedule_length Number of entries in the global schedule
+ * 
+ * @return CRC-16 of the schedule
+ */
+uint16_t gttcan_get_schedule_crc(const global_schedule_entry_t *global_schedule_ptr, uint16_t global_schedule_length)
+{
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < global_schedule_length; i++)
+    {
+        const global_schedule_entry_t *entry = &global_schedule_ptr[i];
+        uint8_t bytes[6] = {
+            entry->node_id,
+            (uint8_t)entry->slot_id, (uint8_t)(entry->slot_id >> 8),
+            (uint8_t)entry->data_id, (uint8_t)(entry->data_id >> 8),
+            0,
+        };
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS || GTTCAN_ENABLE_SCHEDULE_UPDATE
+        bytes[5] = entry->dlc;
+#endif
+#if GTTCAN_ENABLE_ON_DEMAND
+        bytes[5] |= (uint8_t)((entry->policy & 0x3) << 4); // As carried in entry frames
+#endif
+        for (int j = 0; j < 6; j++)
+        {
+            crc ^= (uint16_t)bytes[j] << 8;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+            }
+        }
+    }
+    return crc;
+}
+
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+/**
+ * @brief Switch to the pending schedule if its round has come
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param cycle_count Cycle count of the round that is starting
+ * 
+ * @note Only swaps buffers, so it is cheap enough for the slot 0 interrupt
+ */
+static void gttcan_apply_schedule_update(gttcan_t *gttcan, uint32_t cycle_count)
+{
+    if (!gttcan->has_update_switch_cycle || (int32_t)(cycle_count - gttcan->update_switch_cycle_count) < 0)
+    {
+        return;
+    }
+    if (gttcan->pending_schedule_ptr == NULL)
+    {
+        // Our slots may belong to someone else now
+        gttcan->is_schedule_stale = true;
+        return;
+    }
+
+    gttcan->global_schedule_ptr = gttcan->pending_schedule_ptr;
+    gttcan->global_schedule_length = gttcan->update_length;
+    gttcan->local_schedule = (gttcan->local_schedule == gttcan->local_schedule_buffers[0]) ? gttcan->local_schedule_buffers[1] : gttcan->local_schedule_buffers[0];
+    gttcan->local_schedule_length = gttcan->pending_local_schedule_length;
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    gttcan->slot_start_offset = (gttcan->slot_start_offset == gttcan->slot_start_offset_buffers[0]) ? gttcan->slot_start_offset_buffers[1] : gttcan->slot_start_offset_buffers[0];
+#endif
+    gttcan->local_schedule_index = 0;
+    gttcan->schedule_version = gttcan->update_version;
+    gttcan->schedule_switch_cycle_count = gttcan->update_switch_cycle_count;
+    gttcan->is_schedule_stale = false;
+
+    gttcan->pending_schedule_ptr = NULL;
+    gttcan->has_update_header = false;
+    gttcan->has_update_switch_cycle = false;
+}
+
+/**
+ * @brief Collect a received schedule update frame
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param payload 64-bit payload of the received frame
+ */
+static void gttcan_receive_schedule_update(gttcan_t *gttcan, uint64_t payload)
+{
+    uint16_t index = (uint16_t)(payload & 0xFFFF);
+    uint8_t version = (uint8_t)(payload >> 16);
+
+    if (index == GTTCAN_SCHEDULE_UPDATE_HEADER)
+    {
+        uint16_t length = (uint16_t)(payload >> 24);
+        bool is_known = (gttcan->has_update_header || gttcan->pending_schedule_ptr != NULL) && version == gttcan->update_version;
+        if (version == gttcan->schedule_version || is_known || length == 0 || length > gttcan->schedule_update_capacity ||
+            gttcan->is_preparing_update)
+        {
+            return; // A newer update while the main loop checks this one waits for the next header
+        }
+        gttcan_clear_schedule_update(gttcan);
+        gttcan->update_version = version;
+        gttcan->update_length = length;
+        gttcan->update_crc = (uint16_t)(payload >> 40);
+        gttcan->has_update_header = true;
+    }
+    else if (index == GTTCAN_SCHEDULE_UPDATE_SWITCH)
+    {
+        if (gttcan->has_update_header && version == gttcan->update_version)
+        {
+            gttcan->update_switch_cycle_count = (uint32_t)(payload >> 24);
+            gttcan->has_update_switch_cycle = true;
+            if (gttcan->pending_schedule_ptr == NULL && (int32_t)(gttcan->cycle_count - gttcan->update_switch_cycle_count) >= 0)
+            {
+                gttcan->is_schedule_stale = true; // The network switched without us, e.g. we joined late
+            }
+        }
+    }
+    else if (gttcan->has_update_header && index < gttcan->update_length &&
+             gttcan->pending_schedule_ptr == NULL && !gttcan->is_preparing_update && // The buffer is no longer ours to write
+             !(gttcan->update_received[index >> 3] & (1U << (index & 7))))
+    {
+        global_schedule_entry_t *entry = &gttcan_get_schedule_update_buffer(gttcan)[index];
+        entry->node_id = (uint8_t)(payload >> 16);
+        entry->slot_id = (uint16_t)(payload >> 24);
+        entry->data_id = (uint16_t)(payload >> 40);
+        entry->dlc = (uint8_t)(payload >> 56);
+#if GTTCAN_ENABLE_ON_DEMAND
+        entry->policy = (entry->dlc >> 4) & 0x3;
+        entry->dlc &= 0xF;
+#endif
+        gttcan->update_received[index >> 3] |= (uint8_t)(1U << (index & 7));
+        gttcan->update_received_count++;
+    }
+}
+
+/**
+ * @brief Build the next frame of the schedule stream sent in schedule update slots
+ * 
+ * Streams the pending schedule, or once it is active, the active schedule, so that nodes
+ * joining later still get it. The stream is the entries in blocks of
+ * GTTCAN_SCHEDULE_UPDATE_BLOCK_LENGTH, each preceded by the header and the switch round.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param payload Receives the payload of the frame
+ * 
+ * @return false if this node has no updated schedule to stream
+ */
+static bool gttcan_get_schedule_update_frame(gttcan_t *gttcan, uint64_t *payload)
+{
+    global_schedule_ptr_t global_schedule_ptr = gttcan->pending_schedule_ptr;
+    if (global_schedule_ptr == NULL)
+    {
+        if (gttcan->schedule_version == 0 || gttcan->has_update_header || gttcan->update_version != gttcan->schedule_version)
+        {
+            return false;
+        }
+        global_schedule_ptr = gttcan->global_schedule_ptr;
+    }
+
+    // Every block of entries is preceded by the header and switch frames
+    uint16_t block_length = GTTCAN_SCHEDULE_UPDATE_BLOCK_LENGTH + 2;
+    uint16_t position = gttcan->update_stream_position;
+    uint16_t offset = position % block_length;
+    uint16_t index = (position / block_length) * GTTCAN_SCHEDULE_UPDATE_BLOCK_LENGTH + offset - 2;
+    if (offset >= 2 && index >= gttcan->update_length)
+    {
+        position = 0;
+        offset = 0;
+    }
+    gttcan->update_stream_position = position + 1;
+
+    uint64_t version = (uint64_t)gttcan->update_version << 16;
+    if (offset == 0)
+    {
+        *payload = GTTCAN_SCHEDULE_UPDATE_HEADER | version | ((uint64_t)gttcan->update_length << 24) | ((uint64_t)gttcan->update_crc << 40);
+    }
+    else if (offset == 1)
+    {
+        *payload = GTTCAN_SCHEDULE_UPDATE_SWITCH | version | ((uint64_t)gttcan->update_switch_cycle_count << 24);
+    }
+    else
+    {
+        const global_schedule_entry_t *entry = &global_schedule_ptr[index];
+        *payload = (uint64_t)index | ((uint64_t)entry->node_id << 16) | ((uint64_t)entry->slot_id << 24) |
+                   ((uint64_t)entry->data_id << 40) | ((uint64_t)entry->dlc << 56);
+#if GTTCAN_ENABLE_ON_DEMAND
+        *payload |= (uint64_t)(entry->policy & 0x3) << 60;
+#endif
+    }
+    return true;
+}
+
+/**
+ * @brief Check a new global schedule and build its local schedule into the spare buffers
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param global_schedule_ptr New global schedule
+ * @param global_schedule_length Number of entries in the new global schedule
+ * 
+ * @return false if the schedule cannot be run, see gttcan_update_schedule()
+ */
+static bool gttcan_prepare_schedule(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr, uint16_t global_schedule_length)
+{
+    if (global_schedule_length == 0 || global_schedule_length > MAX_GLOBAL_SCHEDULE_LENGTH ||
+        global_schedule_ptr[0].slot_id != 0 || global_schedule_ptr[0].data_id != REFERENCE_FRAME_DATA_ID)
+    {
+        return false;
+    }
+    uint16_t local_schedule_length = 0;
+    for (int i = 0; i < global_schedule_length; i++)
+    {
+        const global_schedule_entry_t *entry = &global_schedule_ptr[i];
+        if (entry->slot_id >= global_schedule_length)
+        {
+            return false;
+        }
+        if (entry->node_id == gttcan->node_id || entry->data_id == REFERENCE_FRAME_DATA_ID || entry->data_id == GTTCAN_SCHEDULE_UPDATE_DATA_ID)
+        {
+            local_schedule_length++;
+        }
+    }
+    if (local_schedule_length > GTTCAN_MAX_LOCAL_SCHEDULE_LENGTH)
+    {
+        return false;
+    }
+
+    local_schedule_entry_t *local_schedule = (gttcan->local_schedule == gttcan->local_schedule_buffers[0]) ? gttcan->local_schedule_buffers[1] : gttcan->local_schedule_buffers[0];
+    gttcan->pending_local_schedule_length = gttcan_build_local_schedule(gttcan, global_schedule_ptr, global_schedule_length, local_schedule);
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    uint32_t *slot_start_offset = (gttcan->slot_start_offset == gttcan->slot_start_offset_buffers[0]) ? gttcan->slot_start_offset_buffers[1] : gttcan->slot_start_offset_buffers[0];
+    gttcan_build_slot_start_offsets(global_schedule_ptr, global_schedule_length, slot_start_offset);
+#endif
+    return true;
+}
+
+/**
+ * @brief Get the buffer that streamed schedule entries are collected into
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return Whichever schedule update buffer is not the active global schedule
+ */
+static global_schedule_entry_t *gttcan_get_schedule_update_buffer(gttcan_t *gttcan)
+{
+    return (gttcan->global_schedule_ptr == gttcan->schedule_update_buffers[0]) ? gttcan->schedule_update_buffers[1] : gttcan->schedule_update_buffers[0];
+}
+
+/**
+ * @brief Forget any schedule update being received or waiting for its round
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ */
+static void gttcan_clear_schedule_update(gttcan_t *gttcan)
+{
+    gttcan->update_generation++; // Tells gttcan_poll_schedule_update() the buffer may hold another update now
+    gttcan->pending_schedule_ptr = NULL;
+    gttcan->pending_local_schedule_length = 0;
+    gttcan->has_update_header = false;
+    gttcan->has_update_switch_cycle = false;
+    gttcan->update_length = 0;
+    gttcan->update_crc = 0;
+    gttcan->update_switch_cycle_count = 0;
+    gttcan->update_received_count = 0;
+    for (int i = 0; i < (int)sizeof(gttcan->update_received); i++)
+    {
+        gttcan->update_received[i] = 0;
+    }
+}
+#endif
+
+#if GTTCAN_ENABLE_FTA_SYNC
+/**
+ * @brief Measure the slot length of a sender from two of its frames
+ * 
+ * Compares the local time between this frame and the sender's previous one against the time
+ * the slots in between take on this node. Both frames must follow the same reference frame,
+ * as the sender realigns to every reference frame, and frames delayed by more than half a
+ * slot (e.g. retransmitted) are not used.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param node_id Node that sent the frame
+ * @param slot_id Slot the frame was received in
+ */
+static void gttcan_record_fta_frame(gttcan_t *gttcan, uint8_t node_id, uint16_t slot_id)
+{
+    if (gttcan->get_local_time_fp == NULL)
+    {
+        return;
+    }
+
+    gttcan_fta_sender_t *sender = NULL;
+    for (int i = 0; i < gttcan->fta_sender_count; i++)
+    {
+        if (gttcan->fta_senders[i].node_id == node_id)
+        {
+            sender = &gttcan->fta_senders[i];
+            break;
+        }
+    }
+    if (sender == NULL)
+    {
+        if (gttcan->fta_sender_count >= GTTCAN_FTA_MAX_SENDERS)
+        {
+            return;
+        }
+        sender = &gttcan->fta_senders[gttcan->fta_sender_count++];
+        *sender = (gttcan_fta_sender_t){0};
+        sender->node_id = node_id;
+        sender->last_epoch = gttcan->fta_epoch - 1; // No previous frame to compare with
+    }
+
+    if (sender->last_epoch == gttcan->fta_epoch && slot_id > sender->last_slot_id)
+    {
+        int32_t elapsed = (int32_t)(gttcan->event_local_time - sender->last_local_time);
+        int32_t expected = (int32_t)gttcan_get_time_between_slots(gttcan, sender->last_slot_id, slot_id);
+        int32_t deviation = elapsed - expected;
+        if (deviation < (int32_t)(gttcan->slot_duration / 2) && deviation > -(int32_t)(gttcan->slot_duration / 2))
+        {
+            sender->deviation_sum += (deviation * (1 << GTTCAN_FTA_FRACTIONAL_BITS)) / (slot_id - sender->last_slot_id);
+            sender->deviation_count++;
+        }
+    }
+    sender->last_epoch = gttcan->fta_epoch;
+    sender->last_slot_id = slot_id;
+    sender->last_local_time = gttcan->event_local_time;
+}
+
+/**
+ * @brief Work out this round's slot_duration correction from the fault-tolerant average
+ * 
+ * Sorts the mean slot length deviation of every sender heard since the last call, and this
+ * node's own (zero), discards the GTTCAN_FTA_DISCARD largest and smallest, and averages the
+ * rest. Clears the measurements for the next round.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return 1 to lengthen slot_duration, -1 to shorten it, 0 if within GTTCAN_FTA_DEADBAND or
+ *          too few senders were heard
+ */
+static int gttcan_get_fta_correction(gttcan_t *gttcan)
+{
+    int32_t deviations[GTTCAN_FTA_MAX_SENDERS + 1];
+    int count = 0;
+    deviations[count++] = 0; // Our own clock
+
+    for (int i = 0; i < gttcan->fta_sender_count; i++)
+    {
+        gttcan_fta_sender_t *sender = &gttcan->fta_senders[i];
+        if (sender->deviation_count == 0)
+        {
+            continue;
+        }
+        int32_t deviation = sender->deviation_sum / sender->deviation_count;
+        sender->deviation_sum = 0;
+        sender->deviation_count = 0;
+
+        // Insertion sort, there are only a few senders
+        int j = count++;
+        while (j > 0 && deviations[j - 1] > deviation)
+        {
+            deviations[j] = deviations[j - 1];
+            j--;
+        }
+        deviations[j] = deviation;
+    }
+
+    if (count < 2 * GTTCAN_FTA_DISCARD + 1)
+    {
+        return 0;
+    }
+
+    int64_t sum = 0;
+    for (int i = GTTCAN_FTA_DISCARD; i < count - GTTCAN_FTA_DISCARD; i++)
+    {
+        sum += deviations[i];
+    }
+    int32_t mean = (int32_t)(sum / (count - 2 * GTTCAN_FTA_DISCARD));
+
+    if (mean > GTTCAN_FTA_DEADBAND)
+    {
+        return 1;
+    }
+    if (mean < -GTTCAN_FTA_DEADBAND)
+    {
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+/**
+ * @brief Register hooks that run in step with the schedule
+ * 
+ * The pre-slot hook runs pre_slot_lead_time before each of the node's own data slots (not
+ * before reference frames), from the timer interrupt. G-TTCAN splits the wait for the slot
+ * into two timer expiries to do this, so the hook can start sampling or computing the value
+ * that read_value_fp returns in the slot, rather than the application sampling inside
+ * read_value_fp or sending stale data. The post-slot hook runs after each received subscribed
+ * data frame, so consumers can run as soon as their inputs arrive.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param pre_slot_hook_fp Hook run before own data slots, or NULL to disable
+ * @param pre_slot_lead_time Time before the slot at which the pre-slot hook runs, in system time units
+ * @param post_slot_hook_fp Hook run after received subscribed data, or NULL to disable
+ * 
+ * @note Should be called after gttcan_init() and before gttcan_start() or gttcan_join()
+ * @note If less than pre_slot_lead_time is left when the timer for a slot is armed (e.g. for
+ *          back-to-back slots), the pre-slot hook runs immediately instead
+ * @note The lead time should exceed interrupt_timing_offset, as the second timer expiry is
+ *          compensated for it like every other
+ * @note Both hooks are called from interrupt context, so they should only release a task or set a flag
+ */
+void gttcan_set_slot_hooks(gttcan_t *gttcan, slot_hook_fp_t pre_slot_hook_fp, uint32_t pre_slot_lead_time, slot_hook_fp_t post_slot_hook_fp)
+{
+    gttcan->pre_slot_hook_fp = pre_slot_hook_fp;
+    gttcan->pre_slot_lead_time = pre_slot_lead_time;
+    gttcan->post_slot_hook_fp = post_slot_hook_fp;
+}
+
+/**
+ * @brief Register the transmit function of the second CAN bus
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param transmit_frame_b_callback_fp Sends a frame on channel B, as transmit_frame_callback_fp does on channel A
+ * 
+ * @note Should be called after gttcan_init() and before gttcan_start() or gttcan_join()
+ * @note Until it is set, the frames of channel B are not sent
+ * @note Does nothing without GTTCAN_ENABLE_DUAL_CHANNEL
+ */
+void gttcan_set_channel_b_callback(gttcan_t *gttcan, transmit_frame_callback_fp_t transmit_frame_b_callback_fp)
+{
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+    gttcan->transmit_frame_b_callback_fp = transmit_frame_b_callback_fp;
+#else
+    (void)gttcan;
+    (void)transmit_frame_b_callback_fp;
+#endif
+}
+
+/**
+ * @brief Register the local time source used for the global time base
+ * 
+ * Enables network time in G-TTCAN. Once set, the time master puts its network time in the
+ * reference frames it sends, and every other node learns the offset and rate between its local
+ * timer and network time from the reference frames it receives.
+ * 
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * @param get_local_time_fp Function pointer returning the free-running local time (see get_local_time_fp_t)
+ * 
+ * @note Should be called after gttcan_init() and before gttcan_start() or gttcan_join()
+ * @note Without a local time source, reference frames still carry the cycle counter and the
+ *          network time field is sent as 0
+ */
+void gttcan_set_local_time_callback(gttcan_t *gttcan, get_local_time_fp_t get_local_time_fp)
+{
+    gttcan->get_local_time_fp = get_local_time_fp;
+    gttcan->has_global_time_reference = false;
+    gttcan->global_time_rate = 1UL << GTTCAN_RATE_FRACTIONAL_BITS;
+
+    if (get_local_time_fp != NULL)
+    {
+        // Until a reference frame is received, network time is our own local time
+        gttcan->local_time_reference = get_local_time_fp();
+        gttcan->global_time_reference = gttcan->local_time_reference;
+    }
+}
+
+/**
+ * @brief Get the current network time
+ * 
+ * Converts the current local time into the network time base defined by the time master's
+ * reference frames, applying the rate correction learned from successive reference frames.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return Network time in system time units, wrapping at 2^32, or 0 if no local time source is set
+ * 
+ * @note Until the first reference frame is received, network time follows the local timer
+ * @note Safe to call from interrupt context
+ */
+uint32_t gttcan_get_global_time(gttcan_t *gttcan)
+{
+    if (gttcan->get_local_time_fp == NULL)
+    {
+        return 0;
+    }
+    return gttcan_local_to_global_time(gttcan, gttcan->get_local_time_fp());
+}
+
+/**
+ * @brief Convert a local timestamp into network time
+ * 
+ * Useful for timestamping samples in the common time base, where the local timestamp was
+ * captured earlier (e.g. in an ADC interrupt) with the same timer as get_local_time_fp.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param local_time Local time in system time units
+ * 
+ * @return Network time in system time units corresponding to local_time
+ * 
+ * @note local_time must be within 2^31 system time units of the last received reference frame
+ */
+uint32_t gttcan_local_to_global_time(gttcan_t *gttcan, uint32_t local_time)
+{
+    int32_t local_elapsed = (int32_t)(local_time - gttcan->local_time_reference);
+    int64_t global_elapsed = ((int64_t)local_elapsed * gttcan->global_time_rate) / (1L << GTTCAN_RATE_FRACTIONAL_BITS);
+    return gttcan->global_time_reference + (uint32_t)global_elapsed;
+}
+
+/**
+ * @brief Get the number of the current schedule round
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * 
+ * @return Cycle counter, incremented at the start of every round and taken over from the
+ *          time master with every reference frame received
+ */
+uint32_t gttcan_get_cycle_count(gttcan_t *gttcan)
+{
+    return gttcan->cycle_count;
+}
+
+/**
+ * @brief Update the cycle counter and global time base from a received reference frame
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param reference_payload 64-bit payload of the received reference frame
+ * 
+ * @note The rate correction is measured between successive reference frames, smoothed, and
+ *          discarded if it exceeds GTTCAN_MAX_RATE_CORRECTION_PPM
+ */
+static void gttcan_update_global_time(gttcan_t *gttcan, uint64_t reference_payload)
+{
+#if !GTTCAN_ENABLE_PREEMPTIVE_TIMER
+    gttcan->cycle_count = (uint32_t)(reference_payload >> GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT); // Else taken up with the resynchronisation
+#endif
+
+    if (gttcan->get_local_time_fp == NULL)
+    {
+        return;
+    }
+
+    uint32_t local_time = gttcan->GTTCAN_RX_EVENT_LOCAL_TIME;
+    uint32_t global_time = (uint32_t)(reference_payload & GTTCAN_REFERENCE_FRAME_TIME_MASK) + GTTCAN_FRAME_LATENCY;
+
+    if (gttcan->has_global_time_reference)
+    {
+        uint32_t local_elapsed = local_time - gttcan->local_time_reference;
+        uint32_t global_elapsed = global_time - gttcan->global_time_reference;
+
+        if (local_elapsed > 0)
+        {
+            int64_t nominal_rate = 1LL << GTTCAN_RATE_FRACTIONAL_BITS;
+            int64_t max_deviation = (nominal_rate * GTTCAN_MAX_RATE_CORRECTION_PPM) / 1000000;
+            int64_t measured_rate = (int64_t)(((uint64_t)global_elapsed << GTTCAN_RATE_FRACTIONAL_BITS) / local_elapsed);
+
+            if (measured_rate >= nominal_rate - max_deviation && measured_rate <= nominal_rate + max_deviation)
+            {
+                int64_t rate = gttcan->global_time_rate;
+                rate += (measured_rate - rate) / (1 << GTTCAN_RATE_FILTER_SHIFT);
+                gttcan->global_time_rate = (uint32_t)rate;
+            }
+        }
+    }
+
+    gttcan->global_time_reference = global_time;
+    gttcan->local_time_reference = local_time;
+    gttcan->has_global_time_reference = true;
+}
+
+/**
+ * @brief Arm the G-TTCAN timer
+ * 
+ * All timer re-arms go through here, so they can be traced.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param time Time in system time units until gttcan_transmit_next_frame() should be called
+ */
+static void gttcan_set_timer(gttcan_t *gttcan, uint32_t time)
+{
+    gttcan->is_pre_slot_pending = false;
+    // The timer fires interrupt_timing_offset after the event plus time, see gttcan_init()
+    gttcan->timer_due_local_time = gttcan->event_local_time + time + gttcan->interrupt_timing_offset;
+
+    // Wake up early for the pre-slot hook of our next data slot, or run it now if it is too close
+    if (gttcan->pre_slot_hook_fp != NULL && gttcan_is_sending_data(gttcan, gttcan->local_schedule_index))
+    {
+        if (time > gttcan->pre_slot_lead_time)
+        {
+            time -= gttcan->pre_slot_lead_time;
+            gttcan->is_pre_slot_pending = true;
+        }
+        else
+        {
+            local_schedule_entry_t entry = GTTCAN_LOCAL_ENTRY(gttcan, gttcan->local_schedule_index);
+            gttcan->pre_slot_hook_fp(entry.slot_id, entry.data_id);
+        }
+    }
+
+    GTTCAN_TRACE(gttcan, GTTCAN_TRACE_TIMER_SET, time, 0);
+    gttcan_load_timer(gttcan, time);
+}
+
+/**
+ * @brief Load the timer, or hand the load to the shared timer multiplexer
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param time Time in system time units until the timer should expire
+ */
+static void gttcan_load_timer(gttcan_t *gttcan, uint32_t time)
+{
+#if GTTCAN_ENABLE_TIMER_MUX
+    if (gttcan->timer_mux != NULL)
+    {
+        gttcan_timer_mux_schedule(gttcan->timer_mux, gttcan->timer_mux_index, time);
+        return;
+    }
+#endif
+    gttcan->set_timer_int_callback_fp(time);
+}
+
+/**
+ * @brief Handle the early timer expiry armed for a pre-slot hook
+ * 
+ * Re-arms the timer for the rest of the lead time before calling the hook, so the time the
+ * hook takes does not delay the slot.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ */
+static void gttcan_fire_pre_slot_hook(gttcan_t *gttcan)
+{
+    local_schedule_entry_t entry = GTTCAN_LOCAL_ENTRY(gttcan, gttcan->local_schedule_index);
+    GTTCAN_TRACE(gttcan, GTTCAN_TRACE_PRE_SLOT, gttcan->local_schedule_index, gttcan->pre_slot_lead_time);
+
+    gttcan->is_pre_slot_pending = false;
+    uint32_t remaining_time = 1;
+    if (gttcan->pre_slot_lead_time > gttcan->interrupt_timing_offset)
+    {
+        remaining_time = gttcan->pre_slot_lead_time - gttcan->interrupt_timing_offset;
+    }
+    GTTCAN_TRACE(gttcan, GTTCAN_TRACE_TIMER_SET, remaining_time, 0);
+    gttcan_load_timer(gttcan, remaining_time);
+
+    gttcan->pre_slot_hook_fp(entry.slot_id, entry.data_id);
+}
+
+/**
+ * @brief Read the local time once at the start of an event
+ * 
+ * The same timestamp is then used for the global time base and the trace of the event,
+ * so a replay of the trace reproduces it exactly.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ */
+static void gttcan_capture_event_time(gttcan_t *gttcan)
+{
+    if (gttcan->get_local_time_fp != NULL)
+    {
+        gttcan->event_local_time = gttcan->get_local_time_fp();
+    }
+}
+
+/**
+ * @brief Lengthen or shorten slot_duration by one system time unit
+ *
+ * @param gttcan Pointer to gttcan_t structure
+ * @param step 1 to lengthen, -1 to shorten
+ *
+ * @note With GTTCAN_ENABLE_PREEMPTIVE_TIMER the step is left for the timer interrupt to apply
+ *          with the resynchronisation that follows, as only it writes slot_duration
+ */
+static void gttcan_step_slot_duration(gttcan_t *gttcan, int step)
+{
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+    atomic_fetch_add(&gttcan->slot_duration_step, step);
+#else
+    gttcan->slot_duration += step;
+    GTTCAN_TRACE(gttcan, GTTCAN_TRACE_SLOT_DURATION, gttcan->slot_duration, 0);
+#endif
+}
+
+/**
+ * @brief Note a node heard (or this node sending) in the current round for master election
+ *
+ * @param gttcan Pointer to gttcan_t structure
+ * @param node_id Node that sent the frame, 0 for a frame not in the schedule
+ */
+static void gttcan_record_lowest_seen_node_id(gttcan_t *gttcan, uint8_t node_id)
+{
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+    // The timer interrupt may start a new round between the compare and the write
+    uint8_t current_lowest_seen_node_id = atomic_load(&gttcan->current_lowest_seen_node_id);
+    while ((node_id < current_lowest_seen_node_id || current_lowest_seen_node_id == 0) &&
+           !atomic_compare_exchange_weak(&gttcan->current_lowest_seen_node_id, &current_lowest_seen_node_id, node_id))
+    {
+    }
+#else
+    if (node_id < gttcan->current_lowest_seen_node_id || gttcan->current_lowest_seen_node_id == 0)
+    {
+        gttcan->current_lowest_seen_node_id = node_id;
+    }
+#endif
+}
+
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+/**
+ * @brief Post a resynchronisation for the timer interrupt to take up
+ *
+ * Requests alternate between two buffers, so the timer interrupt can copy the last complete
+ * request while the next one is written. Each buffer has a sequence count that is odd while
+ * it is written, so a timer interrupt on another core that copies a buffer as it is
+ * rewritten sees the count change and copies again.
+ *
+ * @param gttcan Pointer to gttcan_t structure
+ * @param slot_id Slot of the received frame to synchronise to
+ * @param has_cycle_count Whether cycle_count should be taken over (reference frames)
+ * @param cycle_count Cycle counter carried by the reference frame
+ *
+ * @note Called from gttcan_process_frame() only
+ */
+static void gttcan_request_resync(gttcan_t *gttcan, uint16_t slot_id, bool has_cycle_count, uint32_t cycle_count)
+{
+    unsigned int request_count = atomic_load_explicit(&gttcan->resync_request_count, memory_order_relaxed) + 1;
+    atomic_uint *sequence = &gttcan->resync_sequences[request_count & 1];
+    unsigned int sequence_count = atomic_load_explicit(sequence, memory_order_relaxed);
+    atomic_store_explicit(sequence, sequence_count + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // The odd count is seen before any of the new request
+
+    gttcan_resync_request_t *request = &gttcan->resync_requests[request_count & 1];
+    request->slot_id = slot_id;
+    request->local_time = gttcan->rx_event_local_time;
+    request->has_cycle_count = has_cycle_count;
+    request->cycle_count = cycle_count;
+
+    atomic_store_explicit(sequence, sequence_count + 2, memory_order_release);
+    atomic_store_explicit(&gttcan->resync_request_count, request_count, memory_order_release);
+
+    gttcan_load_timer(gttcan, 1); // Have the timer interrupt take it up straight away
+}
+
+/**
+ * @brief Take up the latest resynchronisation posted by gttcan_process_frame()
+ *
+ * Moves to the local schedule entry after the received frame and arms the timer for it,
+ * less the time since the frame was received, as gttcan_process_frame() used to.
+ *
+ * @param gttcan Pointer to gttcan_t structure
+ *
+ * @return true if a resynchronisation was taken up and the timer re-armed
+ *
+ * @note Called from gttcan_transmit_next_frame() only
+ */
+static bool gttcan_apply_resync(gttcan_t *gttcan)
+{
+    unsigned int request_count;
+    gttcan_resync_request_t request;
+    while (true)
+    {
+        request_count = atomic_load_explicit(&gttcan->resync_request_count, memory_order_acquire);
+        if (request_count == gttcan->resync_applied_count)
+        {
+            return false;
+        }
+        // The copy counts only if the buffer's sequence count is even and unchanged across it
+        atomic_uint *sequence = &gttcan->resync_sequences[request_count & 1];
+        unsigned int sequence_count = atomic_load_explicit(sequence, memory_order_acquire);
+        if (sequence_count & 1)
+        {
+            continue; // Being rewritten from another core
+        }
+        request = gttcan->resync_requests[request_count & 1];
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(sequence, memory_order_relaxed) == sequence_count)
+        {
+            break;
+        }
+    }
+    gttcan->resync_applied_count = request_count;
+
+    if (request.has_cycle_count)
+    {
+        gttcan->cycle_count = request.cycle_count;
+    }
+    gttcan->slot_duration += atomic_exchange(&gttcan->slot_duration_step, 0);
+
+    gttcan->local_schedule_index = gttcan_get_resync_index(gttcan, request.slot_id);
+    GTTCAN_SEEK_LOCAL_RUN(gttcan);
+    uint32_t time_to_next_transmission = gttcan_get_time_to_next_transmission(request.slot_id, gttcan);
+    if (gttcan->get_local_time_fp != NULL)
+    {
+        uint32_t time_since_frame = gttcan->event_local_time - request.local_time;
+        time_to_next_transmission = (time_to_next_transmission > time_since_frame) ? time_to_next_transmission - time_since_frame : 1;
+    }
+    gttcan_set_timer(gttcan, time_to_next_transmission);
+    return true;
+}
+
+/**
+ * @brief Re-arm the timer if it expired before the expiry last armed is due
+ *
+ * Catches the kick from gttcan_request_resync(), and an expiry armed before a
+ * resynchronisation that fired while it was being taken up.
+ *
+ * @param gttcan Pointer to gttcan_t structure
+ *
+ * @return true if the expiry was early and the timer re-armed
+ *
+ * @note An expiry up to interrupt_timing_offset early counts as due
+ */
+static bool gttcan_rearm_if_early(gttcan_t *gttcan)
+{
+    if (gttcan->get_local_time_fp == NULL)
+    {
+        return false;
+    }
+
+    uint32_t due_local_time = gttcan->timer_due_local_time;
+    if (gttcan->is_pre_slot_pending)
+    {
+        due_local_time -= gttcan->pre_slot_lead_time;
+    }
+
+    int32_t time_left = (int32_t)(due_local_time - gttcan->event_local_time);
+    if (time_left <= (int32_t)gttcan->interrupt_timing_offset)
+    {
+        return false;
+    }
+    gttcan_load_timer(gttcan, (uint32_t)time_left - gttcan->interrupt_timing_offset);
+    return true;
+}
+#endif
+
+/**
+ * @brief Set up a timer multiplexer on a free-running timer
+ * 
+ * @param mux Pointer to the gttcan_timer_mux_t structure to set up
+ * @param get_time_fp Reads the free-running timer, in system time units wrapping at 2^32
+ * @param set_compare_fp Loads its compare channel (see set_timer_compare_fp_t)
  * 
- * @note Accounts for interrupt_timing_offset to compensate for processing delays
- * @note Returns minimum delay of 1 time unit if calculated delay would be too small
- * @note Used internally by gttcan_transmit_next_frame() and gttcan_process_frame()
- * @note Time calculation: (slots_to_next * slot_duration) - interrupt_timing_offset
+ * @note Does nothing without GTTCAN_ENABLE_TIMER_MUX
  */
-uint32_t gttcan_get_time_to_next_transmission(uint16_t current_slot_id, gttcan_t *gttcan)
+void gttcan_timer_mux_init(gttcan_timer_mux_t *mux, get_local_time_fp_t get_time_fp, set_timer_compare_fp_t set_compare_fp)
 {
-    uint16_t next_slot_id = gttcan->local_schedule[gttcan->local_schedule_index].slot_id;
-    uint16_t number_of_slots_to_next = gttcan_get_number_of_slots_to_next(current_slot_id, next_slot_id, gttcan->global_schedule_length);
+#if GTTCAN_ENABLE_TIMER_MUX
+    mux->get_time_fp = get_time_fp;
+    mux->set_compare_fp = set_compare_fp;
+    mux->instance_count = 0;
+    mux->queue_length = 0;
+    mux->is_dispatching = false;
+    mux->max_lateness = 0;
+#else
+    (void)mux;
+    (void)get_time_fp;
+    (void)set_compare_fp;
+#endif
+}
 
-    uint32_t time_to_next_transmission = (uint32_t)number_of_slots_to_next * gttcan->slot_duration;
+/**
+ * @brief Have an instance load its timer through a timer multiplexer
+ * 
+ * From here on the instance's timer loads become deadlines on the multiplexer's free-running
+ * timer, and set_timer_int_callback_fp is no longer called (it may be NULL).
+ * 
+ * @param mux Pointer to a timer multiplexer set up with gttcan_timer_mux_init()
+ * @param gttcan Pointer to initialized gttcan_t structure
+ * 
+ * @return false if GTTCAN_TIMER_MUX_MAX_INSTANCES instances are already attached, or
+ *          GTTCAN_ENABLE_TIMER_MUX is not set
+ * 
+ * @note Should be called after gttcan_init() and before gttcan_start() or gttcan_join()
+ */
+bool gttcan_timer_mux_attach(gttcan_timer_mux_t *mux, gttcan_t *gttcan)
+{
+#if GTTCAN_ENABLE_TIMER_MUX
+    if (mux->instance_count >= GTTCAN_TIMER_MUX_MAX_INSTANCES)
+    {
+        return false;
+    }
+    gttcan->timer_mux = mux;
+    gttcan->timer_mux_index = mux->instance_count;
+    mux->instances[mux->instance_count++] = gttcan;
+    return true;
+#else
+    (void)mux;
+    (void)gttcan;
+    return false;
+#endif
+}
 
-    if (time_to_next_transmission > gttcan->interrupt_timing_offset)
+/**
+ * @brief Serve the instances whose deadlines have passed
+ * 
+ * Calls gttcan_transmit_next_frame() of each due instance, earliest deadline first, then
+ * loads the compare channel with the next deadline.
+ * 
+ * @param mux Pointer to the timer multiplexer
+ * 
+ * @note Must be called from the compare interrupt of the shared timer
+ * @note Spurious calls with nothing due only reload the compare channel
+ */
+void gttcan_timer_mux_handle_interrupt(gttcan_timer_mux_t *mux)
+{
+#if GTTCAN_ENABLE_TIMER_MUX
+    mux->is_dispatching = true;
+    while (mux->queue_length > 0)
     {
-        return time_to_next_transmission - gttcan->interrupt_timing_offset;
+        uint8_t index = mux->queue[0];
+        uint32_t lateness = mux->get_time_fp() - mux->due_times[index];
+        if ((int32_t)lateness < 0)
+        {
+            break;
+        }
+        mux->max_lateness = (lateness > mux->max_lateness) ? lateness : mux->max_lateness;
+
+        mux->queue_length--;
+        for (int i = 0; i < mux->queue_length; i++)
+        {
+            mux->queue[i] = mux->queue[i + 1];
+        }
+        gttcan_transmit_next_frame(mux->instances[index]); // Normally loads its next deadline
     }
-    else
+    mux->is_dispatching = false;
+
+    if (mux->queue_length > 0)
     {
-        return 1;
+        mux->set_compare_fp(mux->due_times[mux->queue[0]]);
+    }
+#else
+    (void)mux;
+#endif
+}
+
+/**
+ * @brief Get the largest delay of an instance's timer expiry caused by sharing the timer
+ * 
+ * @param mux Pointer to the timer multiplexer
+ * 
+ * @return Largest time in system time units between a deadline and the call of
+ *          gttcan_transmit_next_frame() for it, 0 without GTTCAN_ENABLE_TIMER_MUX
+ * 
+ * @note Includes the compare interrupt latency, which a dedicated timer has too
+ */
+uint32_t gttcan_timer_mux_get_max_lateness(gttcan_timer_mux_t *mux)
+{
+#if GTTCAN_ENABLE_TIMER_MUX
+    return mux->max_lateness;
+#else
+    (void)mux;
+    return 0;
+#endif
+}
+
+#if GTTCAN_ENABLE_TIMER_MUX
+/**
+ * @brief Replace the deadline of an instance in the multiplexer's queue
+ * 
+ * As with a dedicated timer, a load replaces the instance's earlier deadline.
+ * 
+ * @param mux Pointer to the timer multiplexer
+ * @param index Instance within the multiplexer
+ * @param time Time in system time units from now until the deadline
+ * 
+ * @note Linear in the number of attached instances
+ */
+static void gttcan_timer_mux_schedule(gttcan_timer_mux_t *mux, uint8_t index, uint32_t time)
+{
+    uint32_t due_time = mux->get_time_fp() + time;
+
+    uint8_t queue_length = 0;
+    for (int i = 0; i < mux->queue_length; i++)
+    {
+        if (mux->queue[i] != index)
+        {
+            mux->queue[queue_length++] = mux->queue[i];
+        }
+    }
+
+    // Insertion, behind deadlines at the same time
+    int position = queue_length;
+    while (position > 0 && (int32_t)(due_time - mux->due_times[mux->queue[position - 1]]) < 0)
+    {
+        mux->queue[position] = mux->queue[position - 1];
+        position--;
+    }
+    mux->queue[position] = index;
+    mux->due_times[index] = due_time;
+    mux->queue_length = queue_length + 1;
+
+    if (position == 0 && !mux->is_dispatching)
+    {
+        mux->set_compare_fp(due_time);
+    }
+}
+#endif
+
+/**
+ * @brief Set up a gateway between two instances on this node
+ * 
+ * @param gateway Pointer to the gttcan_gateway_t structure to set up
+ * @param source Instance on the network the routed data is received from
+ * @param target Instance on the network it is sent on, its slot_duration is taken as nominal
+ * @param routes Array of routes, used in place
+ * @param route_count Number of routes, routes beyond GTTCAN_GATEWAY_MAX_ROUTES are ignored
+ * @param forwarding_time Time in system time units from the end of a source slot until its
+ *          value is ready to be sent, covering frame processing and any wait for the CPU
+ * 
+ * @note Call after gttcan_init() of both instances
+ * @note Does nothing without GTTCAN_ENABLE_GATEWAY
+ */
+void gttcan_gateway_init(gttcan_gateway_t *gateway, gttcan_t *source, gttcan_t *target, const gttcan_gateway_route_t *routes, uint8_t route_count, uint32_t forwarding_time)
+{
+#if GTTCAN_ENABLE_GATEWAY
+    if (routes == NULL || route_count > GTTCAN_GATEWAY_MAX_ROUTES)
+    {
+        route_count = (routes == NULL) ? 0 : GTTCAN_GATEWAY_MAX_ROUTES;
+    }
+    gateway->source = source;
+    gateway->target = target;
+    gateway->routes = routes;
+    gateway->route_count = route_count;
+    gateway->forwarding_time = forwarding_time;
+    gateway->nominal_slot_duration = target->slot_duration;
+    for (int i = 0; i < route_count; i++)
+    {
+        gateway->values[i] = 0;
+        gateway->has_value[i] = false;
+    }
+#else
+    (void)gateway;
+    (void)source;
+    (void)target;
+    (void)routes;
+    (void)route_count;
+    (void)forwarding_time;
+#endif
+}
+
+/**
+ * @brief Hand a value received on the source network to the routes that forward it
+ * 
+ * @param gateway Pointer to the gateway
+ * @param source_data_id Data identifier the value was received with
+ * @param value Received value
+ * 
+ * @return true if a route forwards source_data_id
+ * 
+ * @note Intended to be called from the source's write_value_fp
+ */
+bool gttcan_gateway_forward(gttcan_gateway_t *gateway, uint16_t source_data_id, uint64_t value)
+{
+    bool is_routed = false;
+#if GTTCAN_ENABLE_GATEWAY
+    for (int i = 0; i < gateway->route_count; i++)
+    {
+        if (gateway->routes[i].source_data_id == source_data_id)
+        {
+            gateway->values[i] = value;
+            gateway->has_value[i] = true;
+            is_routed = true;
+        }
+    }
+#else
+    (void)gateway;
+    (void)source_data_id;
+    (void)value;
+#endif
+    return is_routed;
+}
+
+/**
+ * @brief Get the latest forwarded value to send on the target network
+ * 
+ * @param gateway Pointer to the gateway
+ * @param target_data_id Data identifier about to be sent
+ * @param value Set to the latest value received for the route, left alone if none has been
+ * 
+ * @return true if a route sends target_data_id and has received a value
+ * 
+ * @note Intended to be called from the target's read_value_fp
+ */
+bool gttcan_gateway_read(gttcan_gateway_t *gateway, uint16_t target_data_id, uint64_t *value)
+{
+#if GTTCAN_ENABLE_GATEWAY
+    for (int i = 0; i < gateway->route_count; i++)
+    {
+        if (gateway->routes[i].target_data_id == target_data_id && gateway->has_value[i])
+        {
+            *value = gateway->values[i];
+            return true;
+        }
+    }
+#else
+    (void)gateway;
+    (void)target_data_id;
+    (void)value;
+#endif
+    return false;
+}
+
+/**
+ * @brief Work out the worst-case forwarding latency of a route
+ * 
+ * The latency of a value runs from the end of the source slot it arrives in to the start of
+ * the first of this node's target slots for the route that it can be sent in, at least
+ * forwarding_time later.
+ * 
+ * @param gateway Pointer to the gateway
+ * @param route_index Route in the table given to gttcan_gateway_init()
+ * @param phase Time in system time units from the start of a source round to the start of a
+ *          target round, ignored if the rounds take different times
+ * @param latency Set to the worst-case latency in system time units
+ * 
+ * @return false if no other node sends the route's data on the source network, this node has
+ *          no slot for it on the target network, or GTTCAN_ENABLE_GATEWAY is not set
+ * 
+ * @note If the rounds take different times, the phase keeps changing, and the worst case is
+ *          the longest gap between the route's target slots plus forwarding_time
+ * @note Call outside interrupt context, the work is the product of the source and target slot counts
+ */
+bool gttcan_gateway_get_latency(gttcan_gateway_t *gateway, uint8_t route_index, uint32_t phase, uint32_t *latency)
+{
+#if GTTCAN_ENABLE_GATEWAY
+    if (route_index >= gateway->route_count)
+    {
+        return false;
+    }
+    return gttcan_gateway_get_route_latency(gateway, &gateway->routes[route_index], phase, latency);
+#else
+    (void)gateway;
+    (void)route_index;
+    (void)phase;
+    (void)latency;
+    return false;
+#endif
+}
+
+/**
+ * @brief Propose the phase between the networks with the lowest worst-case forwarding latency
+ * 
+ * Tries each phase that has a target slot of some route start just as a value of the route
+ * becomes ready, and keeps the one whose worst latency over all routes is lowest.
+ * 
+ * @param gateway Pointer to the gateway
+ * @param phase Set to the proposed time from the start of a source round to the start of a target round
+ * @param latency Set to the worst-case latency over all routes at that phase
+ * 
+ * @return false if the rounds of the two networks take different times, so no phase can be
+ *          held, a route cannot be forwarded (see gttcan_gateway_get_latency()), or
+ *          GTTCAN_ENABLE_GATEWAY is not set
+ * 
+ * @note Call outside interrupt context, the work grows with the square of the slot counts
+ */
+bool gttcan_gateway_find_phase(gttcan_gateway_t *gateway, uint32_t *phase, uint32_t *latency)
+{
+#if GTTCAN_ENABLE_GATEWAY
+    gttcan_t *source = gateway->source;
+    gttcan_t *target = gateway->target;
+    uint32_t round = gttcan_get_slot_start(target, target->global_schedule_length);
+    if (gateway->route_count == 0 || round != gttcan_get_slot_start(source, source->global_schedule_length))
+    {
+        return false;
+    }
+
+    bool has_phase = false;
+    for (int r = 0; r < gateway->route_count; r++)
+    {
+        const gttcan_gateway_route_t *route = &gateway->routes[r];
+        for (int i = 0; i < source->global_schedule_length; i++)
+        {
+            global_schedule_entry_t arrival;
+            if (!gttcan_get_global_entry(source, (uint16_t)i, &arrival) ||
+                arrival.data_id != route->source_data_id || arrival.node_id == source->node_id)
+            {
+                continue;
+            }
+            uint32_t ready_time = gttcan_get_slot_start(source, arrival.slot_id + 1) + gateway->forwarding_time;
+            for (int j = 0; j < target->global_schedule_length; j++)
+            {
+                global_schedule_entry_t departure;
+                if (!gttcan_get_global_entry(target, (uint16_t)j, &departure) ||
+                    departure.data_id != route->target_data_id || departure.node_id != target->node_id)
+                {
+                    continue;
+                }
+
+                // The phase that has this slot start just as the value is ready
+                uint32_t candidate = (uint32_t)(((uint64_t)ready_time + round - gttcan_get_slot_start(target, departure.slot_id) % round) % round);
+                uint32_t worst_latency = 0;
+                bool is_valid = true;
+                for (int k = 0; k < gateway->route_count && is_valid; k++)
+                {
+                    uint32_t route_latency;
+                    is_valid = gttcan_gateway_get_route_latency(gateway, &gateway->routes[k], candidate, &route_latency);
+                    worst_latency = (route_latency > worst_latency) ? route_latency : worst_latency;
+                }
+                if (is_valid && (!has_phase || worst_latency < *latency))
+                {
+                    *phase = candidate;
+                    *latency = worst_latency;
+                    has_phase = true;
+                }
+            }
+        }
+    }
+    return has_phase;
+#else
+    (void)gateway;
+    (void)phase;
+    (void)latency;
+    return false;
+#endif
+}
+
+/**
+ * @brief Measure the phase between the networks
+ * 
+ * @param gateway Pointer to the gateway
+ * @param phase Set to the time from the start of the latest source round to the start of the
+ *          latest target round, modulo the target round
+ * 
+ * @return false until both instances have started a round with a local time callback set,
+ *          or without GTTCAN_ENABLE_GATEWAY
+ * 
+ * @note Rounds start at the timer expiry for slot 0, interrupt_timing_offset before the slot
+ *          starts, so the instances should have the same interrupt_timing_offset
+ */
+bool gttcan_gateway_get_phase(gttcan_gateway_t *gateway, uint32_t *phase)
+{
+#if GTTCAN_ENABLE_GATEWAY
+    gttcan_t *target = gateway->target;
+    if (!gateway->source->has_round_start || !target->has_round_start)
+    {
+        return false;
+    }
+    uint32_t round = gttcan_scale_slots(target, 0, 0, gateway->nominal_slot_duration);
+    int32_t difference = (int32_t)(target->round_start_local_time - gateway->source->round_start_local_time);
+    int32_t wrapped = difference % (int32_t)round;
+    *phase = (uint32_t)((wrapped < 0) ? wrapped + (int32_t)round : wrapped);
+    return true;
+#else
+    (void)gateway;
+    (void)phase;
+    return false;
+#endif
+}
+
+/**
+ * @brief Hold the phase between the networks by pacing the target network
+ * 
+ * While this node is time master of the target network and the measured phase is off by more
+ * than one system time unit per slot of the target round, the target's slots are run one
+ * system time unit short (if its rounds start late) or long, and at the nominal slot_duration
+ * otherwise. The target's other nodes follow through the reference frames.
+ * 
+ * @param gateway Pointer to the gateway
+ * @param phase Time from the start of a source round to the start of a target round to hold,
+ *          e.g. from gttcan_gateway_find_phase()
+ * 
+ * @return Measured phase minus phase, within half a target round, or 0 if the phase cannot be
+ *          measured yet (see gttcan_gateway_get_phase())
+ * 
+ * @note Call from the main loop at least once per target round
+ * @note Leaves slot_duration alone while another node is time master of the target network
+ */
+int32_t gttcan_gateway_track_phase(gttcan_gateway_t *gateway, uint32_t phase)
+{
+#if GTTCAN_ENABLE_GATEWAY
+    gttcan_t *target = gateway->target;
+    uint32_t measured_phase;
+    if (!gttcan_gateway_get_phase(gateway, &measured_phase))
+    {
+        return 0;
+    }
+    int32_t round = (int32_t)gttcan_scale_slots(target, 0, 0, gateway->nominal_slot_duration);
+    int32_t error = (int32_t)(measured_phase - phase) % round;
+    if (error > round / 2)
+    {
+        error -= round;
+    }
+    else if (error < -round / 2)
+    {
+        error += round;
+    }
+
+    if (target->is_time_master)
+    {
+        int32_t dead_band = target->global_schedule_length; // What one round at a step from nominal moves it
+        uint32_t slot_duration = gateway->nominal_slot_duration;
+        if (error > dead_band)
+        {
+            slot_duration--;
+        }
+        else if (error < -dead_band)
+        {
+            slot_duration++;
+        }
+        target->slot_duration = slot_duration;
+    }
+    return error;
+#else
+    (void)gateway;
+    (void)phase;
+    return 0;
+#endif
+}
+
+#if GTTCAN_ENABLE_GATEWAY
+/**
+ * @brief Get the time from the start of a round to the start of a slot
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param slot_id Slot position, global_schedule_length for the end of the round
+ * 
+ * @return Time in system time units at the current slot_duration
+ */
+static uint32_t gttcan_get_slot_start(gttcan_t *gttcan, uint16_t slot_id)
+{
+    if (slot_id == 0)
+    {
+        return 0;
+    }
+    return gttcan_get_time_between_slots(gttcan, 0, (slot_id >= gttcan->global_schedule_length) ? 0 : slot_id);
+}
+
+/**
+ * @brief Work out the worst-case forwarding latency of a route, see gttcan_gateway_get_latency()
+ */
+static bool gttcan_gateway_get_route_latency(gttcan_gateway_t *gateway, const gttcan_gateway_route_t *route, uint32_t phase, uint32_t *latency)
+{
+    gttcan_t *source = gateway->source;
+    gttcan_t *target = gateway->target;
+    uint32_t round = gttcan_get_slot_start(target, target->global_schedule_length);
+    bool is_phase_held = round == gttcan_get_slot_start(source, source->global_schedule_length);
+
+    // Longest gap between the route's target slots, for when the phase is not held
+    uint32_t first_departure = 0;
+    uint32_t last_departure = 0;
+    uint32_t longest_gap = 0;
+    bool has_departure = false;
+    for (int j = 0; j < target->global_schedule_length; j++)
+    {
+        global_schedule_entry_t departure;
+        if (!gttcan_get_global_entry(target, (uint16_t)j, &departure) ||
+            departure.data_id != route->target_data_id || departure.node_id != target->node_id)
+        {
+            continue;
+        }
+        uint32_t departure_time = gttcan_get_slot_start(target, departure.slot_id);
+        if (!has_departure)
+        {
+            first_departure = departure_time;
+        }
+        else if (departure_time - last_departure > longest_gap)
+        {
+            longest_gap = departure_time - last_departure;
+        }
+        last_departure = departure_time;
+        has_departure = true;
+    }
+    if (!has_departure)
+    {
+        return false;
+    }
+    if (round - last_departure + first_departure > longest_gap)
+    {
+        longest_gap = round - last_departure + first_departure; // Into the next round
+    }
+
+    uint32_t worst_latency = 0;
+    bool has_arrival = false;
+    for (int i = 0; i < source->global_schedule_length; i++)
+    {
+        global_schedule_entry_t arrival;
+        if (!gttcan_get_global_entry(source, (uint16_t)i, &arrival) ||
+            arrival.data_id != route->source_data_id || arrival.node_id == source->node_id)
+        {
+            continue;
+        }
+        has_arrival = true;
+        if (!is_phase_held)
+        {
+            break;
+        }
+
+        // Wait from the value being ready to the first target slot that starts after it
+        uint32_t ready_time = gttcan_get_slot_start(source, arrival.slot_id + 1) + gateway->forwarding_time;
+        uint32_t shortest_wait = UINT32_MAX;
+        for (int j = 0; j < target->global_schedule_length; j++)
+        {
+            global_schedule_entry_t departure;
+            if (!gttcan_get_global_entry(target, (uint16_t)j, &departure) ||
+                departure.data_id != route->target_data_id || departure.node_id != target->node_id)
+            {
+                continue;
+            }
+            uint64_t departure_time = (uint64_t)gttcan_get_slot_start(target, departure.slot_id) + phase % round;
+            uint32_t wait = (uint32_t)((departure_time + 2 * (uint64_t)round - ready_time % round) % round);
+            shortest_wait = (wait < shortest_wait) ? wait : shortest_wait;
+        }
+        uint32_t arrival_latency = shortest_wait + gateway->forwarding_time;
+        worst_latency = (arrival_latency > worst_latency) ? arrival_latency : worst_latency;
+    }
+    if (!has_arrival)
+    {
+        return false;
+    }
+    *latency = is_phase_held ? worst_latency : longest_gap + gateway->forwarding_time;
+    return true;
+}
+#endif
+
+/**
+ * @brief Copy the trace ring buffer, oldest event first
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param records Array to copy the trace records into
+ * @param max_records Number of entries in records
+ * 
+ * @return Number of records copied, 0 if GTTCAN_ENABLE_TRACE is not set
+ * 
+ * @note Should not be called while G-TTCAN interrupts may add events, or the oldest records may be inconsistent
+ */
+uint16_t gttcan_trace_read(gttcan_t *gttcan, gttcan_trace_record_t *records, uint16_t max_records)
+{
+#if GTTCAN_ENABLE_TRACE
+    uint32_t count = gttcan->trace_count;
+    uint32_t available = (count < GTTCAN_TRACE_LENGTH) ? count : GTTCAN_TRACE_LENGTH;
+    if (available > max_records)
+    {
+        available = max_records;
+    }
+
+    uint32_t first = count - available;
+    for (uint32_t i = 0; i < available; i++)
+    {
+        records[i] = gttcan->trace[(first + i) & (GTTCAN_TRACE_LENGTH - 1)];
+    }
+    return (uint16_t)available;
+#else
+    (void)gttcan;
+    (void)records;
+    (void)max_records;
+    return 0;
+#endif
+}
+
+/**
+ * @brief Write the trace ring buffer out in the binary trace file format
+ * 
+ * Writes a header describing this node's configuration, followed by the traced events
+ * oldest first, in the little-endian format described in gttcan.h. The output can be saved
+ * as a file and replayed on a host with tools/gttcan_replay.c.
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param trace_write_fp Function pointer called with consecutive chunks of the trace file
+ * 
+ * @note Does nothing if GTTCAN_ENABLE_TRACE is not set
+ * @note Should not be called while G-TTCAN interrupts may add events
+ * @note A trace that has not wrapped (see GTTCAN_TRACE_FLAG_WRAPPED) starts at gttcan_start()
+ *          and replays exactly
+ */
+void gttcan_trace_dump(gttcan_t *gttcan, trace_write_fp_t trace_write_fp)
+{
+#if GTTCAN_ENABLE_TRACE
+    uint32_t count = gttcan->trace_count;
+    uint32_t available = (count < GTTCAN_TRACE_LENGTH) ? count : GTTCAN_TRACE_LENGTH;
+    uint32_t flags = 0;
+    if (gttcan->dynamic_slot_duration_correction)
+    {
+        flags |= GTTCAN_TRACE_FLAG_DYNAMIC_SLOT_DURATION_CORRECTION;
+    }
+    if (count > GTTCAN_TRACE_LENGTH)
+    {
+        flags |= GTTCAN_TRACE_FLAG_WRAPPED;
+    }
+
+    uint8_t header[GTTCAN_TRACE_HEADER_SIZE] = GTTCAN_TRACE_MAGIC;
+    uint32_t header_fields[4] = {gttcan->slot_duration, gttcan->interrupt_timing_offset, flags, available};
+    header[4] = GTTCAN_TRACE_FORMAT_VERSION;
+    header[5] = gttcan->node_id;
+    header[6] = (uint8_t)gttcan->global_schedule_length;
+    header[7] = (uint8_t)(gttcan->global_schedule_length >> 8);
+    for (int field = 0; field < 4; field++)
+    {
+        for (int byte = 0; byte < 4; byte++)
+        {
+            header[8 + field * 4 + byte] = (uint8_t)(header_fields[field] >> (8 * byte));
+        }
     }
-}
\ No newline at end of file
+    trace_write_fp(header, GTTCAN_TRACE_HEADER_SIZE);
+
+    uint32_t first = count - available;
+    for (uint32_t i = 0; i < available; i++)
+    {
+        const gttcan_trace_record_t *record = &gttcan->trace[(first + i) & (GTTCAN_TRACE_LENGTH - 1)];
+        uint8_t bytes[GTTCAN_TRACE_RECORD_SIZE];
+        for (int byte = 0; byte < 4; byte++)
+        {
+            bytes[byte] = (uint8_t)(record->timestamp >> (8 * byte));
+            bytes[5 + byte] = (uint8_t)(record->arg >> (8 * byte));
+        }
+        bytes[4] = record->type;
+        for (int byte = 0; byte < 8; byte++)
+        {
+            bytes[9 + byte] = (uint8_t)(record->data >> (8 * byte));
+        }
+        trace_write_fp(bytes, GTTCAN_TRACE_RECORD_SIZE);
+    }
+#else
+    (void)gttcan;
+    (void)trace_write_fp;
+#endif
+}
+
+#if GTTCAN_ENABLE_TRACE
+/**
+ * @brief Append an event to the trace ring buffer
+ * 
+ * @param gttcan Pointer to gttcan_t structure
+ * @param type Type of event (see gttcan_trace_type_t)
+ * @param arg Event argument
+ * @param data Event data
+ * 
+ * @note Overwrites the oldest event once the ring buffer is full
+ */
+static void gttcan_trace(gttcan_t *gttcan, gttcan_trace_type_t type, uint32_t arg, uint64_t data)
+{
+    gttcan_trace_record_t *record = &gttcan->trace[gttcan->trace_count & (GTTCAN_TRACE_LENGTH - 1)];
+    record->timestamp = gttcan->event_local_time;
+    record->type = (uint8_t)type;
+    record->arg = arg;
+    record->data = data;
+    gttcan->trace_count++;
+}
+#endif
@@ -5,6 +5,10 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 /**
  * @brief Maximum number of entries in a node's local transmission schedule
  * 
@@ -70,6 +74,49 @@
 #define GTTCAN_NUM_DATA_ID_BITS 16
 #endif
 
+/**
+ * @brief Use standard (11-bit) CAN identifiers that carry only the slot ID
+ * 
+ * When set to 1, frames are sent with an 11-bit standard identifier equal to the slot_id,
+ * and receivers take the data_id from the global schedule entry for that slot. Standard
+ * frames are about 25 bits shorter than extended frames (worst case, including bit stuffing),
+ * which allows a shorter slot_duration.
+ * 
+ * CONSTRAINT: the global schedule must not exceed 2048 slots
+ * @note All nodes in the network must use the same identifier mode
+ * @note Frames whose slot_id is not in the global schedule are ignored, as their data_id is unknown
+ */
+#ifndef GTTCAN_USE_STANDARD_FRAME_ID
+#define GTTCAN_USE_STANDARD_FRAME_ID 0
+#endif
+
+#define GTTCAN_STANDARD_FRAME_ID_MASK 0x7FFUL
+#define GTTCAN_DATA_ID_MASK ((1UL << GTTCAN_NUM_DATA_ID_BITS) - 1)
+
+// All identifier bits used by G-TTCAN frames in the selected identifier mode
+#if GTTCAN_USE_STANDARD_FRAME_ID
+#define GTTCAN_FRAME_ID_MASK GTTCAN_STANDARD_FRAME_ID_MASK
+#else
+#define GTTCAN_FRAME_ID_MASK ((1UL << (GTTCAN_NUM_SLOT_ID_BITS + GTTCAN_NUM_DATA_ID_BITS)) - 1)
+#endif
+
+#if GTTCAN_USE_STANDARD_FRAME_ID && (MAX_GLOBAL_SCHEDULE_LENGTH > GTTCAN_STANDARD_FRAME_ID_MASK + 1)
+#error "GTTCAN_USE_STANDARD_FRAME_ID supports global schedules of up to 2048 slots"
+#endif
+
+/**
+ * @brief Worst-case length of an 8-byte G-TTCAN frame in bits
+ * 
+ * Includes worst-case bit stuffing and the 3-bit interframe space, for the identifier
+ * mode in use. Multiply by the bit time to get the minimum time a slot must cover.
+ * See gttcan_get_frame_bits() for other payload lengths.
+ */
+#if GTTCAN_USE_STANDARD_FRAME_ID
+#define GTTCAN_WORST_CASE_FRAME_BITS 135
+#else
+#define GTTCAN_WORST_CASE_FRAME_BITS 160
+#endif
+
 
 /**
  * @brief Data ID reserved for reference/synchronization frames
@@ -134,10 +181,705 @@
 #define NUM_ROUNDS_BEFORE_SWITCHING_TO_ALL_NODE_ADJUST 2
 #endif
 
+/**
+ * @brief Synchronise slot durations to a fault-tolerant average of all nodes
+ * 
+ * When set to 1 (and a local time callback is set, see gttcan_set_local_time_callback()), the
+ * all-node adjustment no longer lets every shuffled frame nudge slot_duration_offset. Instead,
+ * each round, every node measures how long the slots of each sender are against its own clock,
+ * from successive frames of that sender with no reference frame in between. At the start of
+ * the next round it sorts the per-sender deviations together with its own (zero), discards the
+ * GTTCAN_FTA_DISCARD largest and smallest, and corrects slot_duration by one step towards the
+ * mean of the rest. A single node with a bad crystal can then no longer drag the others off
+ * through its shuffled frames. The time master keeps its own slot_duration as the reference
+ * rate, as letting it follow the average makes the whole network drift together; phase is
+ * still taken from the reference frames as before.
+ * 
+ * @note Needs at least 2 * GTTCAN_FTA_DISCARD other senders heard in a round, otherwise that
+ *          round makes no correction
+ * @note Adds about 16 bytes per tracked sender to gttcan_t
+ */
+#ifndef GTTCAN_ENABLE_FTA_SYNC
+#define GTTCAN_ENABLE_FTA_SYNC 0
+#endif
+
+/**
+ * @brief Number of largest and of smallest deviations discarded by the fault-tolerant average
+ * 
+ * Tolerates this many faulty clocks, given at least 2 * GTTCAN_FTA_DISCARD + 1 nodes in total.
+ */
+#ifndef GTTCAN_FTA_DISCARD
+#define GTTCAN_FTA_DISCARD 1
+#endif
+
+/**
+ * @brief Maximum number of senders tracked by the fault-tolerant average, further senders are ignored
+ */
+#ifndef GTTCAN_FTA_MAX_SENDERS
+#define GTTCAN_FTA_MAX_SENDERS 16
+#endif
+
+/**
+ * @brief Averaged deviation below which slot_duration is left alone
+ * 
+ * In 1 / 2^GTTCAN_FTA_FRACTIONAL_BITS system time units per slot.
+ */
+#ifndef GTTCAN_FTA_DEADBAND
+#define GTTCAN_FTA_DEADBAND 32
+#endif
+
+#define GTTCAN_FTA_FRACTIONAL_BITS 8
+
+#if GTTCAN_ENABLE_FTA_SYNC
+/**
+ * @brief Slot length measurements of one sender for the fault-tolerant average
+ */
+typedef struct gttcan_fta_sender_tag
+{
+    uint8_t node_id;
+    uint8_t last_epoch;         // Reference frame count at the sender's last frame
+    uint16_t last_slot_id;
+    uint32_t last_local_time;
+    int32_t deviation_sum;      // Sum of (sender slot length - own slot length), fractional per slot
+    uint16_t deviation_count;
+} gttcan_fta_sender_t;
+#endif
+
+/**
+ * @brief Delay between a frame being handed to the transmit callback and it being processed by receivers
+ * 
+ * Covers the CAN frame transmission time plus the receiving node's interrupt latency, in
+ * system time units. It is added to the master timestamp carried in reference frames so that
+ * the network time seen by receiving nodes matches the network time of the master.
+ * 
+ * @note Leave at 0 if a constant offset of about one frame time in the global time base is acceptable
+ */
+#ifndef GTTCAN_FRAME_LATENCY
+#define GTTCAN_FRAME_LATENCY 0
+#endif
+
+/**
+ * @brief Number of fractional bits in the global time rate correction factor
+ * 
+ * The rate at which network time advances relative to the local timer is held as a fixed point
+ * value, where (1 << GTTCAN_RATE_FRACTIONAL_BITS) means both run at exactly the same rate.
+ */
+#ifndef GTTCAN_RATE_FRACTIONAL_BITS
+#define GTTCAN_RATE_FRACTIONAL_BITS 24
+#endif
+
+/**
+ * @brief Largest accepted difference between the local and network clock rates, in parts per million
+ * 
+ * Rate corrections learned from successive reference frames beyond this limit are discarded,
+ * for example after a change of time master or after reference frames have been missed.
+ */
+#ifndef GTTCAN_MAX_RATE_CORRECTION_PPM
+#define GTTCAN_MAX_RATE_CORRECTION_PPM 2000
+#endif
+
+/**
+ * @brief Smoothing applied to the global time rate correction factor
+ * 
+ * Each newly measured rate moves the correction factor by 1 / 2^GTTCAN_RATE_FILTER_SHIFT of the
+ * difference, filtering out reception jitter of individual reference frames. 0 disables smoothing.
+ */
+#ifndef GTTCAN_RATE_FILTER_SHIFT
+#define GTTCAN_RATE_FILTER_SHIFT 2
+#endif
+
+/*
+ Reference frame payload, built by G-TTCAN on the time master:
+ bits 0-31:  network time (master timestamp) in system time units when the frame was sent
+ bits 32-63: cycle counter, incremented at the start of every schedule round
+*/
+#define GTTCAN_REFERENCE_FRAME_TIME_MASK 0xFFFFFFFFULL
+#define GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT 32
+
+/**
+ * @brief Give each slot a length derived from the payload length (DLC) of its schedule entry
+ * 
+ * When set to 1, slot_duration is the length of a slot carrying a full 8-byte frame, and every
+ * other slot is shortened by the bus time its frame saves against a full one (see
+ * gttcan_get_frame_bits()), so every slot keeps the same guard time after its frame. Slots are
+ * only shortened once the bit time is known, from gttcan_set_bit_rate() or gttcan_configure_timing().
+ * Cumulative slot start offsets are precomputed in gttcan_init(), so finding the time to the next
+ * transmission stays constant time.
+ * 
+ * @note Adds (MAX_GLOBAL_SCHEDULE_LENGTH + 1) * 4 bytes to gttcan_t
+ * @note All nodes in the network must use the same setting and the same schedule DLCs
+ */
+#ifndef GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+#define GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS 0
+#endif
+
+/**
+ * @brief Resolution of variable slot lengths
+ * 
+ * The bit time is held in units of 1 / 2^GTTCAN_SLOT_LENGTH_FRACTIONAL_BITS of a system time unit.
+ */
+#ifndef GTTCAN_SLOT_LENGTH_FRACTIONAL_BITS
+#define GTTCAN_SLOT_LENGTH_FRACTIONAL_BITS 8
+#endif
+
+#define GTTCAN_MAX_DLC 8
+
+/**
+ * @brief Record protocol events in a binary trace ring buffer
+ * 
+ * When set to 1, gttcan_t holds the last GTTCAN_TRACE_LENGTH protocol events (timer expiries,
+ * frames sent and received, timer re-arm values, slot_duration changes and master decisions),
+ * timestamped with the local time source if one is set. The trace can be written out with
+ * gttcan_trace_dump() and fed back through tools/gttcan_replay.c on a host.
+ * 
+ * @note Adds GTTCAN_TRACE_LENGTH * 24 bytes to gttcan_t, and a few instructions to every event
+ */
+#ifndef GTTCAN_ENABLE_TRACE
+#define GTTCAN_ENABLE_TRACE 0
+#endif
+
+/**
+ * @brief Number of events kept in the trace ring buffer
+ * 
+ * @note Must be a power of two
+ */
+#ifndef GTTCAN_TRACE_LENGTH
+#define GTTCAN_TRACE_LENGTH 128
+#endif
+
+#if GTTCAN_ENABLE_TRACE && (GTTCAN_TRACE_LENGTH & (GTTCAN_TRACE_LENGTH - 1))
+#error "GTTCAN_TRACE_LENGTH must be a power of two"
+#endif
+
+/*
+ Trace file format written by gttcan_trace_dump(), all fields little-endian:
+ header (24 bytes): magic "GTTR", format version (1 byte), node_id (1 byte), global_schedule_length (2 bytes),
+                    slot_duration (4 bytes), interrupt_timing_offset (4 bytes), flags (4 bytes), record count (4 bytes)
+ records (17 bytes each, oldest first): timestamp (4 bytes), type (1 byte), arg (4 bytes), data (8 bytes)
+*/
+#define GTTCAN_TRACE_MAGIC "GTTR"
+#define GTTCAN_TRACE_FORMAT_VERSION 1
+#define GTTCAN_TRACE_HEADER_SIZE 24
+#define GTTCAN_TRACE_RECORD_SIZE 17
+#define GTTCAN_TRACE_FLAG_DYNAMIC_SLOT_DURATION_CORRECTION 0x01
+#define GTTCAN_TRACE_FLAG_WRAPPED 0x02
+
+typedef enum gttcan_trace_type_tag
+{
+    GTTCAN_TRACE_START = 1,          // arg: 1 if started with gttcan_join(), data: slot_duration
+    GTTCAN_TRACE_TIMER_EXPIRED,      // arg: local_schedule_index, data: slot_id
+    GTTCAN_TRACE_FRAME_SENT,         // arg: can_frame_id, data: payload
+    GTTCAN_TRACE_FRAME_RECEIVED,     // arg: can_frame_id, data: payload
+    GTTCAN_TRACE_TIMER_SET,          // arg: time passed to set_timer_int_callback_fp
+    GTTCAN_TRACE_SLOT_DURATION,      // arg: new slot_duration
+    GTTCAN_TRACE_MASTER_DECISION,    // arg: is_time_master, data: last_lowest_seen_node_id
+    GTTCAN_TRACE_PRE_SLOT,           // arg: local_schedule_index, data: pre_slot_lead_time
+    GTTCAN_TRACE_ERROR               // arg: gttcan_error_t, data: local_schedule_index
+} gttcan_trace_type_t;
+
+typedef struct gttcan_trace_record_tag
+{
+    uint32_t timestamp;
+    uint32_t arg;
+    uint64_t data;
+    uint8_t type;
+} gttcan_trace_record_t;
+
+/**
+ * @brief Callback function pointer for writing out a binary trace
+ * 
+ * @param bytes Bytes of the trace file to write
+ * @param length Number of bytes
+ */
+typedef void (*trace_write_fp_t)(const uint8_t *, uint16_t);
+
+/**
+ * @brief Measure data age, jitter and missed updates of subscribed data
+ * 
+ * When set to 1, every received frame carrying one of the first GTTCAN_MAX_DATA_METRICS
+ * subscribed data_ids (see gttcan_set_subscriptions()) is timestamped on receipt and compared
+ * against the start of its slot, computed from the last reference frame and the schedule.
+ * Results are read with gttcan_get_data_metrics().
+ * 
+ * @note Latency and jitter need the global time base (gttcan_set_local_time_callback()), and
+ *          only include the frame time if GTTCAN_FRAME_LATENCY is set
+ * @note Adds about 60 bytes per tracked data_id to gttcan_t, and a few additions and
+ *          comparisons to gttcan_process_frame()
+ */
+#ifndef GTTCAN_ENABLE_DATA_METRICS
+#define GTTCAN_ENABLE_DATA_METRICS 0
+#endif
+
+/**
+ * @brief Number of subscribed data_ids tracked by GTTCAN_ENABLE_DATA_METRICS
+ */
+#ifndef GTTCAN_MAX_DATA_METRICS
+#define GTTCAN_MAX_DATA_METRICS 16
+#endif
+
+/**
+ * @brief End-to-end statistics of one subscribed data_id, as returned by gttcan_get_data_metrics()
+ * 
+ * Latency is the time from the start of the slot the value was sent in (when the sender read
+ * it) to its receipt here, in global time units. Jitter is the change in latency between
+ * consecutive receipts. Updates are missed when a round passes with fewer frames of the
+ * data_id than the schedule holds.
+ */
+typedef struct gttcan_data_metrics_tag
+{
+    uint32_t received_count;
+    uint32_t missed_count;
+    uint32_t latency_min;
+    uint32_t latency_max;
+    uint32_t latency_mean;
+    uint32_t jitter_min;
+    uint32_t jitter_max;
+    uint32_t jitter_mean;
+} gttcan_data_metrics_t;
+
+#if GTTCAN_ENABLE_DATA_METRICS
+// Running state behind gttcan_data_metrics_t
+typedef struct gttcan_data_metrics_state_tag
+{
+    uint16_t frames_per_round;  // Schedule entries carrying the data_id
+    uint16_t round_received_count;
+    uint32_t round_cycle_count;
+    uint32_t received_count;
+    uint32_t missed_count;
+    uint32_t latency_min;
+    uint32_t latency_max;
+    uint64_t latency_sum;
+    uint32_t latency_count;
+    uint32_t last_latency;
+    uint32_t jitter_min;
+    uint32_t jitter_max;
+    uint64_t jitter_sum;
+    uint32_t jitter_count;
+} gttcan_data_metrics_state_t;
+#endif
+
+/**
+ * @brief Bus errors reported by the CAN driver with gttcan_report_error()
+ */
+typedef enum gttcan_error_tag
+{
+    GTTCAN_ERROR_BUS_OFF,       // The controller went bus-off, and heard nothing until it recovered
+    GTTCAN_ERROR_TX,            // A transmission failed or was aborted
+    GTTCAN_ERROR_RX_OVERRUN     // Received frames were lost, e.g. the receive FIFO overflowed
+} gttcan_error_t;
+
+/**
+ * @brief Error and recovery counts, as returned by gttcan_get_error_counters()
+ */
+typedef struct gttcan_error_counters_tag
+{
+    uint32_t bus_off_count;
+    uint32_t tx_error_count;
+    uint32_t rx_overrun_count;
+    uint32_t resync_count;          // Recoveries, and resumes after sleep, ended by a scheduled frame
+    uint32_t timeout_count;         // Recoveries that heard nothing for a round and went on with the node's own timing
+    uint32_t suspended_slot_count;  // Slots of this node left silent while recovering or resuming
+} gttcan_error_counters_t;
+
+/**
+ * @brief What a node does next, as returned by gttcan_get_time_to_next_activity()
+ */
+typedef enum gttcan_activity_tag
+{
+    GTTCAN_ACTIVITY_LISTEN,     // Not placed in the round, so every frame matters
+    GTTCAN_ACTIVITY_TRANSMIT,   // One of the node's own slots
+    GTTCAN_ACTIVITY_REFERENCE,  // A reference frame, sent by the time master
+    GTTCAN_ACTIVITY_RECEIVE     // A frame of another node with a subscribed data_id
+} gttcan_activity_t;
+
+/**
+ * @brief Let backup nodes use the slots of nodes that have gone silent
+ * 
+ * When set to 1, a table of slot backups (see gttcan_set_slot_backups()) names, for an owner
+ * node, a backup node and the data_id the backup sends in the owner's slots. Once the owner
+ * has not been heard for GTTCAN_RECLAIM_AFTER_SILENT_ROUNDS rounds, the backup transmits in
+ * its slots. The backup's data_id must be higher than the owner's, so if the owner comes back
+ * it wins arbitration in its very next slot, the backup sees the owner's frame and stops.
+ * 
+ * CONSTRAINT: needs extended identifiers, as receivers tell the owner and the backup apart by the data_id
+ * @note Backups should transmit in one-shot mode (no automatic retransmission), so a frame
+ *          that loses arbitration to the returning owner is not resent into the next slot
+ * @note Adds one byte per local schedule entry and per backup to gttcan_t
+ */
+#ifndef GTTCAN_ENABLE_SLOT_RECLAMATION
+#define GTTCAN_ENABLE_SLOT_RECLAMATION 0
+#endif
+
+/**
+ * @brief Rounds an owner must be silent before its backup uses its slots
+ */
+#ifndef GTTCAN_RECLAIM_AFTER_SILENT_ROUNDS
+#define GTTCAN_RECLAIM_AFTER_SILENT_ROUNDS 3
+#endif
+
+/**
+ * @brief Maximum number of entries in the slot backup table
+ */
+#ifndef GTTCAN_MAX_SLOT_BACKUPS
+#define GTTCAN_MAX_SLOT_BACKUPS 8
+#endif
+
+#define GTTCAN_NO_SLOT_BACKUP 0xFF
+
+#if GTTCAN_ENABLE_SLOT_RECLAMATION && GTTCAN_USE_STANDARD_FRAME_ID
+#error "GTTCAN_ENABLE_SLOT_RECLAMATION needs extended identifiers"
+#endif
+
+/**
+ * @brief One entry of the slot backup table
+ * 
+ * While owner_node_id is silent, backup_node_id sends data_id in the owner's slots.
+ * 
+ * @note data_id must be higher than the data_ids of the owner's slots, slots where it is not are never reclaimed
+ */
+typedef struct gttcan_slot_backup_tag
+{
+    uint8_t owner_node_id;
+    uint8_t backup_node_id;
+    uint16_t data_id;
+} gttcan_slot_backup_t;
+
+/**
+ * @brief Let the time master distribute a new schedule over the bus while the network runs
+ * 
+ * When set to 1, schedule entries with data_id GTTCAN_SCHEDULE_UPDATE_DATA_ID are reserved
+ * slots, sent by the time master like reference frames. Once a node is given a new schedule
+ * (see gttcan_update_schedule()) and is time master, it streams the schedule in these slots:
+ * a header frame with version, length and CRC-16, a frame with the cycle count to switch at,
+ * then one frame per entry, repeated. Every node collects the entries into a spare buffer
+ * (see gttcan_set_schedule_update_buffers()), checks the CRC, builds the new local schedule
+ * into a second local schedule buffer, and all nodes switch at the start of the given round.
+ * A node that knows of an update but has not got all of it by then stops sending data until
+ * it has, rather than sending in slots that may now belong to other nodes.
+ * 
+ * The entries are streamed in blocks of GTTCAN_SCHEDULE_UPDATE_BLOCK_LENGTH, each preceded by
+ * the header and switch frames, so a node that joins mid-stream soon knows an update is on.
+ * 
+ * Update frame payloads, bits 0-15 holding the entry index or one of the markers below:
+ * header: bits 16-23 version, bits 24-39 number of entries, bits 40-55 CRC-16 of the entries
+ * switch: bits 16-23 version, bits 24-55 cycle count of the first round on the new schedule
+ * entry:  bits 16-23 node_id, bits 24-39 slot_id, bits 40-55 data_id, bits 56-63 dlc
+ * 
+ * CONSTRAINT: every schedule must start with a reference frame in slot 0, the switch happens there
+ * @note Adds a second local schedule (and slot start offsets, with variable slot lengths) to gttcan_t
+ * @note The update slots cost bandwidth whether or not an update is in progress
+ */
+#ifndef GTTCAN_ENABLE_SCHEDULE_UPDATE
+#define GTTCAN_ENABLE_SCHEDULE_UPDATE 0
+#endif
+
+#ifndef GTTCAN_SCHEDULE_UPDATE_DATA_ID
+#define GTTCAN_SCHEDULE_UPDATE_DATA_ID GTTCAN_DATA_ID_MASK
+#endif
+
+/**
+ * @brief Number of schedule entries streamed between repetitions of the header and switch frames
+ */
+#ifndef GTTCAN_SCHEDULE_UPDATE_BLOCK_LENGTH
+#define GTTCAN_SCHEDULE_UPDATE_BLOCK_LENGTH 32
+#endif
+
+#define GTTCAN_SCHEDULE_UPDATE_HEADER 0xFFFF
+#define GTTCAN_SCHEDULE_UPDATE_SWITCH 0xFFFE
+
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE && MAX_GLOBAL_SCHEDULE_LENGTH >= GTTCAN_SCHEDULE_UPDATE_SWITCH
+#error "MAX_GLOBAL_SCHEDULE_LENGTH is too large for the schedule update entry index"
+#endif
+
+/**
+ * @brief Let the timer interrupt preempt gttcan_process_frame()
+ *
+ * By default gttcan_transmit_next_frame() and gttcan_process_frame() must not interrupt each
+ * other, so both interrupts have to run at the same priority. When set to 1, the timer
+ * interrupt may be given a higher priority than the CAN receive interrupt (or run on another
+ * core), so a long receive does not delay a transmission:
+ * - The schedule position, the timer and slot_duration are only written by the timer
+ *      interrupt. gttcan_process_frame() reads them, but posts a resynchronisation to a
+ *      reference frame (or to the first frame heard while joining) instead of acting on it,
+ *      then calls set_timer_int_callback_fp(1) so the timer interrupt takes it up at once.
+ * - The timer interrupt remembers the local time every timer expiry is due at, and re-arms
+ *      instead of transmitting when it runs early, so an expiry left over from before a
+ *      resynchronisation (or the kick itself) cannot send a frame in the wrong slot.
+ * - State written by both, such as the lowest node ID seen this round, uses C11 atomics.
+ *
+ * CONSTRAINT: needs a local time callback (see gttcan_set_local_time_callback()), set before
+ *          gttcan_start(), and a C11 compiler with <stdatomic.h>. Without the local time, early
+ *          expiries cannot be told apart.
+ * @note set_timer_int_callback_fp is then called from both interrupts, so it must arm the
+ *          timer with a single register write, or mask the timer interrupt while it does
+ * @note Not available with GTTCAN_ENABLE_SCHEDULE_UPDATE, GTTCAN_ENABLE_FTA_SYNC or
+ *          GTTCAN_ENABLE_TRACE, which share more state between the two interrupts
+ * @note tools/gttcan_preempt.c runs a simulated network with the timer interrupt preempting
+ *          frame processing at each callback it makes
+ */
+#ifndef GTTCAN_ENABLE_PREEMPTIVE_TIMER
+#define GTTCAN_ENABLE_PREEMPTIVE_TIMER 0
+#endif
+
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+#if !defined(__STDC_VERSION__) || __STDC_VERSION__ < 201112L || defined(__STDC_NO_ATOMICS__)
+#error "GTTCAN_ENABLE_PREEMPTIVE_TIMER needs C11 atomics"
+#endif
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE || GTTCAN_ENABLE_FTA_SYNC || GTTCAN_ENABLE_TRACE
+#error "GTTCAN_ENABLE_PREEMPTIVE_TIMER cannot be combined with schedule updates, FTA sync or the trace"
+#endif
+#include <stdatomic.h>
+#define GTTCAN_SHARED _Atomic // Written by one interrupt, read or written by the other
+#else
+#define GTTCAN_SHARED
+#endif
+
+/**
+ * @brief Describe the global schedule as runs of repeating node patterns
+ *
+ * When set to 1, gttcan_init() takes an array of gttcan_schedule_run_t instead of
+ * global_schedule_entry_t, and global_schedule_length is the number of runs. A run covers
+ * slot_count consecutive slots from first_slot_id, all carrying data_id, with slot
+ * first_slot_id + k sent by node_ids[k % pattern_length]. A 512 slot round of a reference
+ * frame followed by nodes 1, 2, 3 in turn is then two runs:
+ *
+ * @code
+ * const gttcan_schedule_run_t global_schedule[] = {
+ *     // {first_slot_id, slot_count, data_id, pattern_length, node_ids}
+ *     {0, 1, REFERENCE_FRAME_DATA_ID, 1, {1}},
+ *     {1, 511, GENERIC_DATA_ID, 3, {2, 3, 1}},
+ * };
+ * @endcode
+ *
+ * The runs are used as they are: the local schedule is not stored, only the number of local
+ * entries before each run, and the sender of a received slot is worked out by a binary
+ * search over the runs and arithmetic within one. The run and the position in it of
+ * local_schedule_index are kept alongside it and stepped on as it is, so the slot of a local
+ * entry is only searched for when the node resyncs or joins.
+ *
+ * CONSTRAINT: runs must be sorted by first_slot_id and must not overlap, and the round ends
+ *          with the last run. Slots between runs are unused. pattern_length must be 1 to
+ *          GTTCAN_MAX_RUN_PATTERN_LENGTH
+ * @note Runs beyond GTTCAN_MAX_SCHEDULE_RUNS are ignored
+ * @note Removes the local schedule from gttcan_t, adding GTTCAN_MAX_RUN_PATTERN_LENGTH + 3 bytes
+ *          per run instead
+ * @note Not available with GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS, GTTCAN_ENABLE_SLOT_RECLAMATION
+ *          or GTTCAN_ENABLE_SCHEDULE_UPDATE, which keep tables per slot or per local entry
+ */
+#ifndef GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+#define GTTCAN_ENABLE_COMPRESSED_SCHEDULE 0
+#endif
+
+/**
+ * @brief Maximum number of runs in a compressed schedule
+ */
+#ifndef GTTCAN_MAX_SCHEDULE_RUNS
+#define GTTCAN_MAX_SCHEDULE_RUNS 32
+#endif
+
+/**
+ * @brief Maximum number of node IDs in the pattern of one run
+ */
+#ifndef GTTCAN_MAX_RUN_PATTERN_LENGTH
+#define GTTCAN_MAX_RUN_PATTERN_LENGTH 8
+#endif
+
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE && (GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS || GTTCAN_ENABLE_SLOT_RECLAMATION || GTTCAN_ENABLE_SCHEDULE_UPDATE)
+#error "GTTCAN_ENABLE_COMPRESSED_SCHEDULE cannot be combined with variable slot lengths, slot reclamation or schedule updates"
+#endif
+
+/**
+ * @brief Let a node send queued on-demand messages in its own slots
+ *
+ * When set to 1, global schedule entries carry a policy (gttcan_slot_policy_t) and each node
+ * keeps a queue of on-demand messages (see gttcan_queue_on_demand()). When one of the node's
+ * GTTCAN_SLOT_PREEMPTIBLE slots comes up and a message is queued, the most urgent message is
+ * sent in place of the scheduled data. GTTCAN_SLOT_POOL slots carry only on-demand messages and
+ * stay silent when none is queued. The message's data_id goes in the identifier as usual, so
+ * receivers that subscribe to it take it in like any other data, whichever slot it came in.
+ *
+ * Sporadic traffic, such as diagnostic responses, then waits at most until the node's next
+ * preemptible or pool slot, without a slot reserved for every data_id it might send.
+ *
+ * CONSTRAINT: needs extended identifiers, as receivers tell on-demand messages apart by the data_id
+ * @note With schedule updates, the policy is carried in bits 4-5 of the dlc byte of entry frames
+ * @note With variable slot lengths, on-demand payloads are cut to the dlc of the slot they are sent in
+ * @note Not available with GTTCAN_ENABLE_SLOT_RECLAMATION, which takes a slot with another
+ *          data_id than the scheduled one for its owner's absence, or with
+ *          GTTCAN_ENABLE_COMPRESSED_SCHEDULE, whose runs have no policy
+ */
+#ifndef GTTCAN_ENABLE_ON_DEMAND
+#define GTTCAN_ENABLE_ON_DEMAND 0
+#endif
+
+/**
+ * @brief Maximum number of on-demand messages queued at a node
+ */
+#ifndef GTTCAN_ON_DEMAND_QUEUE_LENGTH
+#define GTTCAN_ON_DEMAND_QUEUE_LENGTH 8
+#endif
+
+#if GTTCAN_ENABLE_ON_DEMAND && GTTCAN_USE_STANDARD_FRAME_ID
+#error "GTTCAN_ENABLE_ON_DEMAND needs extended identifiers"
+#endif
+
+#if GTTCAN_ENABLE_ON_DEMAND && (GTTCAN_ENABLE_SLOT_RECLAMATION || GTTCAN_ENABLE_COMPRESSED_SCHEDULE)
+#error "GTTCAN_ENABLE_ON_DEMAND cannot be combined with slot reclamation or compressed schedules"
+#endif
+
+/**
+ * @brief What a node may send in one of its slots
+ */
+typedef enum
+{
+    GTTCAN_SLOT_FIXED = 0,      // Always the scheduled data_id
+    GTTCAN_SLOT_PREEMPTIBLE,    // A queued on-demand message if there is one, the scheduled data_id otherwise
+    GTTCAN_SLOT_POOL            // A queued on-demand message if there is one, nothing otherwise
+} gttcan_slot_policy_t;
+
+#if GTTCAN_ENABLE_ON_DEMAND
+typedef struct gttcan_on_demand_message_tag
+{
+    uint64_t data;
+    uint16_t data_id;
+    uint16_t sequence;  // Queueing order, for first in first out among equal priorities
+    uint8_t priority;   // Lower values are sent first
+    bool is_queued;     // Set last by gttcan_queue_on_demand(), cleared once sent
+} gttcan_on_demand_message_t;
+#endif
+
+/**
+ * @brief Drive a second CAN bus from the same timeline
+ *
+ * When set to 1, each slot has a frame on channel A, the bus of the transmit callback given to
+ * gttcan_init(), and one on channel B, whose transmit callback is set with
+ * gttcan_set_channel_b_callback(). Global schedule entries name the sender and data of the
+ * channel B frame in node_id_b and data_id_b, so the schedule can be striped across the buses
+ * (another sender or data_id on each) or mirror selected slots (the same on both). node_id_b 0
+ * leaves channel B idle in the slot. The time master sends reference frames on both buses, and
+ * a node with a frame on both channels in a slot sends them from the same timer interrupt, so
+ * the bandwidth doubles without more timer interrupts or synchronisation.
+ *
+ * Frames received on channel B are passed to gttcan_process_frame_on_channel(). Receivers
+ * synchronise to the first copy of each reference frame, so either bus keeps the network in step.
+ *
+ * @note Both receive interrupts must have the same priority, so one never preempts frame processing of the other
+ * @note Mirrored data is passed to write_value_fp once per copy received
+ * @note The fault-tolerant average is measured on channel A frames only
+ * @note Not available with GTTCAN_ENABLE_SLOT_RECLAMATION, GTTCAN_ENABLE_SCHEDULE_UPDATE or
+ *          GTTCAN_ENABLE_COMPRESSED_SCHEDULE, which describe one frame per slot
+ */
+#ifndef GTTCAN_ENABLE_DUAL_CHANNEL
+#define GTTCAN_ENABLE_DUAL_CHANNEL 0
+#endif
+
+#if GTTCAN_ENABLE_DUAL_CHANNEL && (GTTCAN_ENABLE_SLOT_RECLAMATION || GTTCAN_ENABLE_SCHEDULE_UPDATE || GTTCAN_ENABLE_COMPRESSED_SCHEDULE)
+#error "GTTCAN_ENABLE_DUAL_CHANNEL cannot be combined with slot reclamation, schedule updates or compressed schedules"
+#endif
+
+typedef enum
+{
+    GTTCAN_CHANNEL_A = 0,
+    GTTCAN_CHANNEL_B
+} gttcan_channel_t;
+
+/**
+ * @brief Share one free-running hardware timer between several gttcan_t instances
+ *
+ * When set to 1, instances attached to a gttcan_timer_mux_t (see gttcan_timer_mux_attach())
+ * hand their timer loads to the multiplexer instead of set_timer_int_callback_fp. It keeps
+ * one deadline per instance in a queue sorted by due time, and loads the earliest into a
+ * compare channel of a free-running timer. The compare interrupt calls
+ * gttcan_timer_mux_handle_interrupt(), which calls gttcan_transmit_next_frame() of every
+ * instance that is due, earliest first, then loads the next deadline. A gateway on two or
+ * three buses then needs one timer rather than one per bus.
+ *
+ * An instance that falls due while others are served is late by at most the time they take
+ * in gttcan_transmit_next_frame(), and the largest lateness seen is recorded (see
+ * gttcan_timer_mux_get_max_lateness()), so interrupt_timing_offset and slot_duration can
+ * allow for it.
+ *
+ * CONSTRAINT: the compare interrupt and the receive interrupts of all attached instances must
+ *          have the same priority, so none of them preempts another while it updates the queue
+ * @note Not available with GTTCAN_ENABLE_PREEMPTIVE_TIMER, whose timer interrupt preempts frame processing
+ */
+#ifndef GTTCAN_ENABLE_TIMER_MUX
+#define GTTCAN_ENABLE_TIMER_MUX 0
+#endif
+
+/**
+ * @brief Maximum number of gttcan_t instances sharing a timer
+ */
+#ifndef GTTCAN_TIMER_MUX_MAX_INSTANCES
+#define GTTCAN_TIMER_MUX_MAX_INSTANCES 4
+#endif
+
+#if GTTCAN_ENABLE_TIMER_MUX && GTTCAN_ENABLE_PREEMPTIVE_TIMER
+#error "GTTCAN_ENABLE_TIMER_MUX cannot be combined with GTTCAN_ENABLE_PREEMPTIVE_TIMER"
+#endif
+
+/**
+ * @brief Forward data between two G-TTCAN networks in step with both schedules
+ *
+ * When set to 1, a gttcan_gateway_t joins a source and a target instance on the same node
+ * through a table of routes, each taking a data_id received on the source network and
+ * sending it as a data_id of this node's slots on the target network. The source's
+ * write_value_fp hands received values to gttcan_gateway_forward() and the target's
+ * read_value_fp takes them with gttcan_gateway_read(), so forwarded data goes out in the
+ * first of this node's target slots after it arrives.
+ *
+ * How long that takes depends on the phase between the two rounds, the time from the start
+ * of a source round to the start of a target round. gttcan_gateway_get_latency() works out
+ * the worst-case forwarding latency of a route for a phase from both schedules, and
+ * gttcan_gateway_find_phase() proposes the phase with the lowest worst case over all routes.
+ * When this node is time master of the target network, gttcan_gateway_track_phase() holds
+ * that phase by running the target's slots one system time unit short or long until the
+ * measured phase is back on it, so the target network follows the source's clock.
+ *
+ * CONSTRAINT: both instances need a local time callback on the same clock, and their receive
+ *          and timer interrupts must not preempt one another
+ * @note A phase is only held when a round takes as long on both networks, otherwise the
+ *          latency bounds allow for every phase
+ * @note Adds a round start timestamp to gttcan_t
+ */
+#ifndef GTTCAN_ENABLE_GATEWAY
+#define GTTCAN_ENABLE_GATEWAY 0
+#endif
+
+/**
+ * @brief Maximum number of routes of a gateway
+ */
+#ifndef GTTCAN_GATEWAY_MAX_ROUTES
+#define GTTCAN_GATEWAY_MAX_ROUTES 16
+#endif
+
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+typedef struct gttcan_resync_request_tag
+{
+    uint16_t slot_id;       // Slot of the frame to synchronise to
+    uint32_t local_time;    // Local time it was received at
+    bool has_cycle_count;   // Set for reference frames
+    uint32_t cycle_count;
+} gttcan_resync_request_t;
+#endif
+
 typedef struct local_schedule_entry_tag
 {
     uint16_t slot_id;
     uint16_t data_id;
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+    uint8_t dlc;
+#endif
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    uint8_t backup_index; // Entry in the slot backup table for slots of another node, or GTTCAN_NO_SLOT_BACKUP
+#endif
+#if GTTCAN_ENABLE_ON_DEMAND
+    uint8_t policy; // gttcan_slot_policy_t
+#endif
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+    uint8_t channels;   // Bit (1 << gttcan_channel_t) set for each channel the node sends on, data_id is for the first
+    uint16_t data_id_b; // Data sent on channel B when the node sends on both
+#endif
 } local_schedule_entry_t;
 
 typedef struct global_schedule_entry
@@ -145,9 +887,109 @@ typedef struct global_schedule_entry
     uint8_t node_id;
     uint16_t slot_id;
     uint16_t data_id;
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS || GTTCAN_ENABLE_SCHEDULE_UPDATE
+    uint8_t dlc; // Payload length in bytes (1-8), 0 is treated as 8
+#endif
+#if GTTCAN_ENABLE_ON_DEMAND
+    uint8_t policy; // gttcan_slot_policy_t, GTTCAN_SLOT_FIXED if left out
+#endif
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+    uint8_t node_id_b;  // Sender on channel B, 0 if channel B is idle in this slot
+    uint16_t data_id_b; // Data sent on channel B
+#endif
 } global_schedule_entry_t;
 
+typedef struct gttcan_schedule_run_tag
+{
+    uint16_t first_slot_id;
+    uint16_t slot_count;
+    uint16_t data_id;
+    uint8_t pattern_length;
+    uint8_t node_ids[GTTCAN_MAX_RUN_PATTERN_LENGTH]; // Sender of slot first_slot_id + k is node_ids[k % pattern_length]
+} gttcan_schedule_run_t;
+
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+typedef const gttcan_schedule_run_t *global_schedule_ptr_t;
+#else
 typedef global_schedule_entry_t *global_schedule_ptr_t;
+#endif
+
+/**
+ * @brief One signal packed into the payload of a frame
+ * 
+ * A signal occupies bit_width bits of the 64-bit payload starting at bit_offset (bit 0 being
+ * the least significant bit of the payload value). Signal values are read and written through
+ * read_value_fp and write_value_fp using the signal's own data_id, with
+ * value = raw * scale_factor + scale_offset. Signed signals hold raw in two's complement.
+ */
+typedef struct gttcan_signal_tag
+{
+    uint16_t data_id;
+    uint8_t bit_offset;   // 0-63
+    uint8_t bit_width;    // 1-64, and bit_offset + bit_width <= 64
+    int32_t scale_factor; // 0 is treated as 1
+    int32_t scale_offset;
+    bool is_signed;       // Sign-extend raw from bit_width bits when unpacking
+    uint64_t mask;        // Filled in by gttcan_set_frame_layouts()
+} gttcan_signal_t;
+
+/**
+ * @brief Layout of the frames sent with a given data_id
+ * 
+ * Schedule entries with this data_id carry the listed signals instead of a single value.
+ */
+typedef struct gttcan_frame_layout_tag
+{
+    uint16_t data_id;
+    uint8_t signal_count;
+    gttcan_signal_t *signals;
+} gttcan_frame_layout_t;
+
+/**
+ * @brief One CAN acceptance filter in identifier/mask form
+ * 
+ * A frame is accepted when (can_frame_id & mask) == (id & mask). Bits are numbered as in the
+ * can_frame_id passed to gttcan_process_frame(), so the filter is in extended (29-bit) or
+ * standard (11-bit) form according to GTTCAN_USE_STANDARD_FRAME_ID.
+ */
+typedef struct gttcan_filter_tag
+{
+    uint32_t id;
+    uint32_t mask;
+} gttcan_filter_t;
+
+/**
+ * @brief Bus and node timing measured on the target, for gttcan_configure_timing()
+ *
+ * Latencies are in system time units, measured as minimum and maximum over many events
+ * under worst-case load, and include one unit for the resolution of the timer.
+ */
+typedef struct gttcan_timing_params_tag
+{
+    uint32_t bit_rate;              // CAN bit rate in bits per second
+    uint32_t timer_frequency;       // System time units per second
+    uint32_t clock_tolerance_ppm;   // Largest deviation of any node's clock from nominal, in parts per million
+    uint32_t transmit_latency_min;  // From the timer interrupt to the start of the frame on the bus
+    uint32_t transmit_latency_max;
+    uint32_t receive_latency_min;   // From the end of a frame on the bus to the call of gttcan_process_frame()
+    uint32_t receive_latency_max;
+    uint32_t timer_set_latency_min; // From gttcan_process_frame() or the timer interrupt to the timer being loaded
+    uint32_t timer_set_latency_max;
+} gttcan_timing_params_t;
+
+/**
+ * @brief Timing derived by gttcan_configure_timing(), all in system time units
+ */
+typedef struct gttcan_timing_tag
+{
+    uint32_t slot_duration;             // Shortest safe slot_duration
+    uint32_t interrupt_timing_offset;
+    uint32_t longest_frame_time;        // Longest frame in the schedule, with worst-case bit stuffing
+    uint32_t synchronisation_error;     // Largest spread between the slot starts of two nodes, without drift
+    uint32_t drift;                     // Largest drift between two nodes between reference frames
+    uint16_t reference_interval;        // Most slots from one reference frame to the next
+    uint16_t timer_loads;               // Most timer loads of one node from one reference frame to the next
+} gttcan_timing_t;
 
 /**
  * @brief Callback function pointer for transmitting CAN frames
@@ -157,12 +999,14 @@ typedef global_schedule_entry_t *global_schedule_ptr_t;
  * 
  * @param can_frame_id 29-bit extended CAN frame identifier to be transmitted
  *                     Format: [slot_id (GTTCAN_NUM_SLOT_ID_BITS bits) | data_id (GTTCAN_NUM_DATA_ID_BITS bits)]
+ *                     or, with GTTCAN_USE_STANDARD_FRAME_ID, the 11-bit standard identifier equal to slot_id
  * @param data 64-bit data payload to be transmitted in the CAN frame
  * 
  * @note Must be non-blocking or have minimal execution time to avoid timing issues
  * @note Should handle transmission errors gracefully (e.g., bus-off conditions)
  * @note Called from interrupt context in gttcan_transmit_next_frame()
- * @note Frame format must be extended (29-bit identifier) CAN frame
+ * @note Frame format must be extended (29-bit identifier) CAN frame, or standard (11-bit identifier)
+ *          CAN frame if GTTCAN_USE_STANDARD_FRAME_ID is set
  * @note Implementation should not modify the parameters
  * 
  * Example implementation:
@@ -294,21 +1138,144 @@ typedef uint64_t (*read_value_fp_t)(uint16_t);
  */
 typedef void (*write_value_fp_t)(uint16_t, uint64_t);
 
+/**
+ * @brief Callback function pointer for reading the local time
+ * 
+ * Optional callback used by G-TTCAN to timestamp reference frames and to convert local time
+ * into network time (see gttcan_get_global_time()).
+ * 
+ * @return Free-running local time in system time units, wrapping at 2^32
+ * 
+ * @note Must use the same system time units as set_timer_int_callback_fp
+ * @note Must not be reset when the G-TTCAN timer is re-armed
+ * @note Called from interrupt context in gttcan_transmit_next_frame() and gttcan_process_frame()
+ */
+typedef uint32_t (*get_local_time_fp_t)(void);
+
+/**
+ * @brief Callback function pointer for slot hooks
+ * 
+ * Optional callbacks that let the application run work in step with the schedule (see
+ * gttcan_set_slot_hooks()). The pre-slot hook runs a fixed lead time before each of the
+ * node's own data slots, so fresh data can be produced just in time for read_value_fp.
+ * The post-slot hook runs after a subscribed data frame has been passed to write_value_fp.
+ * 
+ * @param slot_id Slot position of the frame in the global schedule
+ * @param data_id Data identifier of the frame
+ * 
+ * @note Called from interrupt context, so it should only release a task or set a flag
+ */
+typedef void (*slot_hook_fp_t)(uint16_t, uint16_t);
+
+/**
+ * @brief Callback function pointer for loading the compare channel of a shared timer
+ * 
+ * Used by the timer multiplexer (see GTTCAN_ENABLE_TIMER_MUX) to ask for an interrupt when
+ * the free-running timer reaches the given time.
+ * 
+ * @param time Time of the free-running timer to interrupt at, in system time units, wrapping at 2^32
+ * 
+ * @note Replaces any earlier compare value
+ * @note If time has already passed, the interrupt must still be raised (e.g. by pending it),
+ *          as the compare match would otherwise only come after the timer wraps
+ * 
+ * Example implementation:
+ * @code
+ * void my_set_compare(uint32_t time) {
+ *     TIM5->CCR1 = time;
+ *     if ((int32_t)(TIM5->CNT - time) >= 0) {
+ *         NVIC_SetPendingIRQ(TIM5_IRQn);
+ *     }
+ * }
+ * @endcode
+ */
+typedef void (*set_timer_compare_fp_t)(uint32_t);
+
+#if GTTCAN_ENABLE_TIMER_MUX
+typedef struct gttcan_timer_mux_tag
+{
+    get_local_time_fp_t get_time_fp;        // The free-running timer
+    set_timer_compare_fp_t set_compare_fp;
+    struct gttcan_tag *instances[GTTCAN_TIMER_MUX_MAX_INSTANCES];
+    uint8_t instance_count;
+    uint32_t due_times[GTTCAN_TIMER_MUX_MAX_INSTANCES];     // By instance
+    uint8_t queue[GTTCAN_TIMER_MUX_MAX_INSTANCES];          // Instances with a deadline, earliest first
+    uint8_t queue_length;
+    bool is_dispatching;                    // Deadlines are loaded once all due instances are served
+    uint32_t max_lateness;
+} gttcan_timer_mux_t;
+#else
+typedef struct gttcan_timer_mux_tag gttcan_timer_mux_t;
+#endif
+
 typedef struct gttcan_tag
 {
     // Node related
     uint8_t node_id;
-    bool is_active;
+    GTTCAN_SHARED bool is_active;
     bool is_initialised;
-    uint32_t slot_duration;
+    GTTCAN_SHARED bool is_joining;
+    GTTCAN_SHARED bool is_recovering;       // Off the bus after an error until a scheduled frame places us again
+    GTTCAN_SHARED bool is_waiting_for_reference; // Recovering, but only a reference frame places us, see gttcan_resume_after_sleep()
+    uint16_t recovery_slot_count;           // Own slots left silent in the current recovery
+    gttcan_error_counters_t error_counters;
+    GTTCAN_SHARED uint32_t slot_duration;
     uint32_t interrupt_timing_offset;
 
     // Schedule related
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    local_schedule_entry_t *local_schedule; // The active one of local_schedule_buffers
+    local_schedule_entry_t local_schedule_buffers[2][GTTCAN_MAX_LOCAL_SCHEDULE_LENGTH];
+#elif GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    uint16_t schedule_run_count;
+    uint16_t run_local_start[GTTCAN_MAX_SCHEDULE_RUNS + 1]; // Local entries before each run, and in total
+    uint8_t run_local_count[GTTCAN_MAX_SCHEDULE_RUNS];      // Local slots in one repeat of each run's pattern
+    uint8_t run_local_offsets[GTTCAN_MAX_SCHEDULE_RUNS][GTTCAN_MAX_RUN_PATTERN_LENGTH]; // Their positions in the pattern
+#else
     local_schedule_entry_t local_schedule[GTTCAN_MAX_LOCAL_SCHEDULE_LENGTH];
+#endif
     global_schedule_ptr_t global_schedule_ptr;
-    uint16_t global_schedule_length;
+    uint16_t global_schedule_length; // Number of slots in a round
     uint16_t local_schedule_length;
-    uint16_t local_schedule_index;
+    GTTCAN_SHARED uint16_t local_schedule_index;
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    // Where local_schedule_index is in the runs, moved on with it
+    GTTCAN_SHARED uint16_t local_schedule_run; // Run of the entry, also a search hint for the other contexts
+    uint16_t local_run_base;                   // Slot of the pattern repeat the entry is in, from the start of the run
+    uint8_t local_run_offset;                  // Which of the run's local slots in that repeat it is
+#endif
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    uint32_t *slot_start_offset; // The active one of slot_start_offset_buffers
+    uint32_t slot_start_offset_buffers[2][MAX_GLOBAL_SCHEDULE_LENGTH + 1];
+#else
+    uint32_t slot_start_offset[MAX_GLOBAL_SCHEDULE_LENGTH + 1];
+#endif
+    uint32_t bit_time; // System time units per bit, in 1 / 2^GTTCAN_SLOT_LENGTH_FRACTIONAL_BITS, 0 until known
+    uint8_t transmit_dlc;
+#endif
+
+#if GTTCAN_ENABLE_SCHEDULE_UPDATE
+    // Schedule update
+    uint8_t schedule_version;                   // 0 for the schedule given to gttcan_init()
+    uint32_t schedule_switch_cycle_count;       // Round the active schedule took effect
+    global_schedule_entry_t *schedule_update_buffers[2];
+    uint16_t schedule_update_capacity;
+    global_schedule_ptr_t pending_schedule_ptr; // Complete schedule waiting for its round, or NULL
+    uint16_t pending_local_schedule_length;
+    bool has_update_header;
+    bool has_update_switch_cycle;
+    bool is_schedule_stale;                     // Switch round passed without a complete schedule
+    uint8_t update_version;
+    uint16_t update_length;
+    uint16_t update_crc;
+    uint32_t update_switch_cycle_count;
+    uint16_t update_received_count;
+    uint8_t update_received[(MAX_GLOBAL_SCHEDULE_LENGTH + 7) / 8];
+    uint16_t update_stream_position;            // Next frame to stream while time master
+    volatile uint8_t update_generation;         // Bumped whenever the update being collected is dropped
+    volatile bool is_preparing_update;          // gttcan_poll_schedule_update() is reading the update buffer
+#endif
 
     // Callback functions
     transmit_frame_callback_fp_t transmit_frame_callback_fp;
@@ -316,19 +1283,135 @@ typedef struct gttcan_tag
     read_value_fp_t read_value_fp;
     write_value_fp_t write_value_fp;
 
+    // Signal packing
+    gttcan_frame_layout_t *frame_layouts;
+    uint8_t frame_layout_count;
+
+    // Subscriptions
+    const uint16_t *subscribed_data_ids;
+    uint16_t subscription_count;
+
+#if GTTCAN_ENABLE_DATA_METRICS
+    // Data metrics
+    gttcan_data_metrics_state_t data_metrics[GTTCAN_MAX_DATA_METRICS];
+    uint16_t reference_slot_id;
+    uint32_t reference_slot_start;  // Global time at the start of the last reference frame slot
+    uint32_t reference_cycle_count;
+    bool has_reference_slot;
+    uint32_t nominal_slot_duration;
+#endif
+
+#if GTTCAN_ENABLE_SLOT_RECLAMATION
+    // Slot reclamation
+    const gttcan_slot_backup_t *slot_backups;
+    uint8_t slot_backup_count;
+    GTTCAN_SHARED uint8_t owner_silent_rounds[GTTCAN_MAX_SLOT_BACKUPS];
+#endif
+
+    // Slot hooks
+    slot_hook_fp_t pre_slot_hook_fp;
+    slot_hook_fp_t post_slot_hook_fp;
+    uint32_t pre_slot_lead_time;
+    bool is_pre_slot_pending;
+
+#if GTTCAN_ENABLE_FTA_SYNC
+    // Fault-tolerant average
+    gttcan_fta_sender_t fta_senders[GTTCAN_FTA_MAX_SENDERS];
+    uint8_t fta_sender_count;
+    uint8_t fta_epoch;
+#endif
+
     // Shuffle correction
     bool dynamic_slot_duration_correction;
-    bool reached_end_of_my_schedule_prematurely;
+    GTTCAN_SHARED bool reached_end_of_my_schedule_prematurely;
     int slot_duration_offset;
     int rounds_without_shuffling_against_master;
 
     // Cascading master
-    uint8_t last_lowest_seen_node_id;
-    uint8_t current_lowest_seen_node_id;
-    bool is_time_master;
+    GTTCAN_SHARED uint8_t last_lowest_seen_node_id;
+    GTTCAN_SHARED uint8_t current_lowest_seen_node_id;
+    GTTCAN_SHARED bool is_time_master;
+
+#if GTTCAN_ENABLE_PREEMPTIVE_TIMER
+    // Preemptive timer
+    gttcan_resync_request_t resync_requests[2];  // Written by gttcan_process_frame(), alternately
+    atomic_uint resync_sequences[2];             // Odd while the matching request is being written
+    atomic_uint resync_request_count;
+    uint32_t resync_applied_count;
+    atomic_int slot_duration_step;               // Correction for the timer interrupt to apply
+    uint32_t rx_event_local_time;                // event_local_time of gttcan_process_frame()
+#endif
+
+    // Global time base
+    get_local_time_fp_t get_local_time_fp;
+    GTTCAN_SHARED uint32_t cycle_count;
+    uint32_t global_time_reference;
+    uint32_t local_time_reference;
+    uint32_t global_time_rate;
+    bool has_global_time_reference;
+    uint32_t event_local_time;
+    uint32_t timer_due_local_time;      // Local time the armed timer expiry is due at
+    uint32_t reference_local_time;      // event_local_time of the last reference frame received
+
+#if GTTCAN_ENABLE_GATEWAY
+    // Gateway phase
+    uint32_t round_start_local_time;    // Local time the current round started at
+    bool has_round_start;
+#endif
+
+#if GTTCAN_ENABLE_TIMER_MUX
+    // Shared timer
+    gttcan_timer_mux_t *timer_mux;
+    uint8_t timer_mux_index;
+#endif
+
+#if GTTCAN_ENABLE_DUAL_CHANNEL
+    // Second bus
+    transmit_frame_callback_fp_t transmit_frame_b_callback_fp;
+    bool has_last_reference;        // A reference frame was taken, from either channel
+    uint16_t last_reference_slot_id;
+    uint64_t last_reference_payload;
+#endif
+
+#if GTTCAN_ENABLE_ON_DEMAND
+    // On-demand messages, queued by the application and taken by the timer interrupt
+    volatile gttcan_on_demand_message_t on_demand_queue[GTTCAN_ON_DEMAND_QUEUE_LENGTH];
+    uint16_t on_demand_sequence;
+#endif
+
+#if GTTCAN_ENABLE_TRACE
+    // Protocol trace
+    gttcan_trace_record_t trace[GTTCAN_TRACE_LENGTH];
+    uint32_t trace_count;
+#endif
 
 } gttcan_t;
 
+/**
+ * @brief One route of a gateway
+ */
+typedef struct gttcan_gateway_route_tag
+{
+    uint16_t source_data_id;    // Received on the source network
+    uint16_t target_data_id;    // Sent by this node on the target network
+} gttcan_gateway_route_t;
+
+#if GTTCAN_ENABLE_GATEWAY
+typedef struct gttcan_gateway_tag
+{
+    gttcan_t *source;
+    gttcan_t *target;
+    const gttcan_gateway_route_t *routes;
+    uint8_t route_count;
+    uint32_t forwarding_time;               // From the end of a source slot until the value can be sent
+    uint32_t nominal_slot_duration;         // Of the target, as given to gttcan_gateway_init()
+    uint64_t values[GTTCAN_GATEWAY_MAX_ROUTES];
+    bool has_value[GTTCAN_GATEWAY_MAX_ROUTES];
+} gttcan_gateway_t;
+#else
+typedef struct gttcan_gateway_tag gttcan_gateway_t;
+#endif
+
 void gttcan_init(
     gttcan_t *gttcan,
     uint8_t node_id,
@@ -345,14 +1428,120 @@ void gttcan_init(
 
 void gttcan_start(gttcan_t *gttcan);
 
+void gttcan_join(gttcan_t *gttcan);
+
+void gttcan_report_error(gttcan_t *gttcan, gttcan_error_t error);
+
+void gttcan_get_error_counters(gttcan_t *gttcan, gttcan_error_counters_t *counters);
+
+uint32_t gttcan_get_time_to_next_activity(gttcan_t *gttcan, gttcan_activity_t *activity);
+
+void gttcan_resume_after_sleep(gttcan_t *gttcan);
+
 void gttcan_transmit_next_frame(gttcan_t *gttcan);
 
 void gttcan_get_local_schedule(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr);
 
+uint32_t gttcan_build_frame_id(uint16_t slot_id, uint16_t data_id);
+
+uint16_t gttcan_get_next_local_schedule_index(gttcan_t *gttcan, uint16_t slot_id);
+
+uint16_t gttcan_get_frame_bits(uint8_t dlc);
+
+bool gttcan_configure_timing(gttcan_t *gttcan, const gttcan_timing_params_t *params, gttcan_timing_t *timing);
+
+uint32_t gttcan_get_time_between_slots(gttcan_t *gttcan, uint16_t from_slot_id, uint16_t to_slot_id);
+
+void gttcan_get_slot_start_offsets(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr);
+
+void gttcan_set_bit_rate(gttcan_t *gttcan, uint32_t bit_rate, uint32_t timer_frequency);
+
+uint8_t gttcan_get_transmit_dlc(gttcan_t *gttcan);
+
 uint16_t gttcan_get_number_of_slots_to_next(uint16_t current_slot_id, uint16_t next_slot_id, uint16_t global_schedule_length);
 
 uint32_t gttcan_get_time_to_next_transmission(uint16_t current_slot_id, gttcan_t *gttcan);
 
 void gttcan_process_frame(gttcan_t *gttcan, uint32_t can_frame_id, uint64_t data);
 
+void gttcan_process_frame_on_channel(gttcan_t *gttcan, gttcan_channel_t channel, uint32_t can_frame_id, uint64_t data);
+
+void gttcan_set_channel_b_callback(gttcan_t *gttcan, transmit_frame_callback_fp_t transmit_frame_b_callback_fp);
+
+bool gttcan_set_frame_layouts(gttcan_t *gttcan, gttcan_frame_layout_t *frame_layouts, uint8_t frame_layout_count);
+
+gttcan_frame_layout_t *gttcan_get_frame_layout(gttcan_t *gttcan, uint16_t data_id);
+
+uint64_t gttcan_pack_frame(gttcan_t *gttcan, const gttcan_frame_layout_t *frame_layout);
+
+void gttcan_unpack_frame(gttcan_t *gttcan, const gttcan_frame_layout_t *frame_layout, uint64_t data);
+
+bool gttcan_set_subscriptions(gttcan_t *gttcan, const uint16_t *data_ids, uint16_t data_id_count);
+
+bool gttcan_is_subscribed(gttcan_t *gttcan, uint16_t data_id);
+
+uint8_t gttcan_get_acceptance_filters(gttcan_t *gttcan, gttcan_filter_t *filters, uint8_t max_filters);
+
+bool gttcan_get_data_metrics(gttcan_t *gttcan, uint16_t data_id, gttcan_data_metrics_t *metrics);
+
+void gttcan_reset_data_metrics(gttcan_t *gttcan);
+
+void gttcan_set_slot_backups(gttcan_t *gttcan, const gttcan_slot_backup_t *slot_backups, uint8_t slot_backup_count);
+
+bool gttcan_is_node_silent(gttcan_t *gttcan, uint8_t node_id);
+
+void gttcan_set_schedule_update_buffers(gttcan_t *gttcan, global_schedule_entry_t *buffer_a, global_schedule_entry_t *buffer_b, uint16_t capacity);
+
+bool gttcan_update_schedule(gttcan_t *gttcan, global_schedule_ptr_t global_schedule_ptr, uint16_t global_schedule_length, uint8_t version, uint32_t switch_cycle_count);
+
+void gttcan_poll_schedule_update(gttcan_t *gttcan);
+
+uint8_t gttcan_get_schedule_version(gttcan_t *gttcan);
+
+uint16_t gttcan_get_schedule_crc(const global_schedule_entry_t *global_schedule_ptr, uint16_t global_schedule_length);
+
+bool gttcan_queue_on_demand(gttcan_t *gttcan, uint16_t data_id, uint64_t data, uint8_t priority);
+
+uint8_t gttcan_get_on_demand_count(gttcan_t *gttcan);
+
+void gttcan_set_slot_hooks(gttcan_t *gttcan, slot_hook_fp_t pre_slot_hook_fp, uint32_t pre_slot_lead_time, slot_hook_fp_t post_slot_hook_fp);
+
+void gttcan_set_local_time_callback(gttcan_t *gttcan, get_local_time_fp_t get_local_time_fp);
+
+uint32_t gttcan_get_global_time(gttcan_t *gttcan);
+
+uint32_t gttcan_get_cycle_count(gttcan_t *gttcan);
+
+uint32_t gttcan_local_to_global_time(gttcan_t *gttcan, uint32_t local_time);
+
+void gttcan_timer_mux_init(gttcan_timer_mux_t *mux, get_local_time_fp_t get_time_fp, set_timer_compare_fp_t set_compare_fp);
+
+bool gttcan_timer_mux_attach(gttcan_timer_mux_t *mux, gttcan_t *gttcan);
+
+void gttcan_timer_mux_handle_interrupt(gttcan_timer_mux_t *mux);
+
+uint32_t gttcan_timer_mux_get_max_lateness(gttcan_timer_mux_t *mux);
+
+void gttcan_gateway_init(gttcan_gateway_t *gateway, gttcan_t *source, gttcan_t *target, const gttcan_gateway_route_t *routes, uint8_t route_count, uint32_t forwarding_time);
+
+bool gttcan_gateway_forward(gttcan_gateway_t *gateway, uint16_t source_data_id, uint64_t value);
+
+bool gttcan_gateway_read(gttcan_gateway_t *gateway, uint16_t target_data_id, uint64_t *value);
+
+bool gttcan_gateway_get_latency(gttcan_gateway_t *gateway, uint8_t route_index, uint32_t phase, uint32_t *latency);
+
+bool gttcan_gateway_find_phase(gttcan_gateway_t *gateway, uint32_t *phase, uint32_t *latency);
+
+bool gttcan_gateway_get_phase(gttcan_gateway_t *gateway, uint32_t *phase);
+
+int32_t gttcan_gateway_track_phase(gttcan_gateway_t *gateway, uint32_t phase);
+
+uint16_t gttcan_trace_read(gttcan_t *gttcan, gttcan_trace_record_t *records, uint16_t max_records);
+
+void gttcan_trace_dump(gttcan_t *gttcan, trace_write_fp_t trace_write_fp);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif
@@ -0,0 +1,523 @@
+
+#ifndef GTTCAN_HPP
+#define GTTCAN_HPP
+
+/**
+ * @file gttcan.hpp
+ * @brief Header-only C++17 front end to G-TTCAN with a compile-time schedule
+ *
+ * gttcan::node runs the same protocol as gttcan_transmit_next_frame() and
+ * gttcan_process_frame() in gttcan.c, and interoperates on the bus with nodes using the C
+ * core built with the same configuration macros. The global schedule is a template argument,
+ * so the local schedule, the frame identifiers and the per-slot lookup tables (sending node,
+ * next local entry, slots to wait) are built by the compiler, and the callbacks are static
+ * members of a policy type, so they can be inlined into the interrupt handlers.
+ *
+ * @code
+ * constexpr global_schedule_entry_t schedule[] = {
+ *     // {node_id, slot_id, data_id},
+ *     {1, 0, REFERENCE_FRAME_DATA_ID},
+ *     {2, 1, TEMP_DATA},
+ *     {3, 2, PRESSURE_DATA},
+ * };
+ *
+ * struct can_policy
+ * {
+ *     static void transmit(uint32_t can_frame_id, uint64_t data) { ... }
+ *     static void set_timer(uint32_t time_in_stu) { ... }
+ *     static uint64_t read(uint16_t data_id) { ... }
+ *     static void write(uint16_t data_id, uint64_t data) { ... }
+ * };
+ *
+ * gttcan::node<schedule, 2, can_policy> node(300, 7);
+ * @endcode
+ *
+ * @note The callbacks have the same meaning as transmit_frame_callback_fp_t,
+ *          set_timer_int_callback_fp_t, read_value_fp_t and write_value_fp_t
+ * @note Covers the core protocol only: reference frames carry the cycle count with a network
+ *          time of 0 (as a C node without a local time callback), every data frame is passed
+ *          to write, and signal packing, subscriptions, slot hooks, data metrics, the time to
+ *          the next activity and the trace stay with the C API
+ * @note The schedule must be a constexpr array (or std::array) with static storage duration, and its slot_ids
+ *          must be below its length, as for gttcan_init()
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include "gttcan.h"
+
+#if GTTCAN_ENABLE_VARIABLE_SLOT_LENGTHS || GTTCAN_ENABLE_SLOT_RECLAMATION || GTTCAN_ENABLE_SCHEDULE_UPDATE || GTTCAN_ENABLE_FTA_SYNC
+#error "gttcan.hpp implements the core protocol, build without the options that change it on the bus"
+#endif
+
+namespace gttcan
+{
+
+/**
+ * @brief Number of local schedule entries of a node, i.e. its own slots plus reference slots
+ */
+template <class Schedule>
+constexpr std::size_t count_local_entries(const Schedule &schedule, uint8_t node_id)
+{
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < std::size(schedule); i++)
+    {
+        if (schedule[i].node_id == node_id || schedule[i].data_id == REFERENCE_FRAME_DATA_ID)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Same as gttcan_build_frame_id(), for use in constant expressions
+ */
+constexpr uint32_t build_frame_id(uint16_t slot_id, uint16_t data_id)
+{
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    (void)data_id;
+    return slot_id & GTTCAN_STANDARD_FRAME_ID_MASK;
+#else
+    return (static_cast<uint32_t>(slot_id) << GTTCAN_NUM_DATA_ID_BITS) | (data_id & GTTCAN_DATA_ID_MASK);
+#endif
+}
+
+/**
+ * @brief Same as gttcan_get_number_of_slots_to_next(), for use in constant expressions
+ */
+constexpr uint16_t slots_to_next(uint16_t current_slot_id, uint16_t next_slot_id, uint16_t global_schedule_length)
+{
+    return (current_slot_id < next_slot_id) ? next_slot_id - current_slot_id : global_schedule_length - current_slot_id + next_slot_id;
+}
+
+/**
+ * @brief G-TTCAN node with a compile-time schedule and inlined callbacks
+ *
+ * @tparam Schedule Global schedule, a constexpr array (or std::array) of global_schedule_entry_t
+ * @tparam NodeId Node identifier of this node (1-255)
+ * @tparam Policy Type with static members transmit(uint32_t, uint64_t), set_timer(uint32_t),
+ *          read(uint16_t) returning uint64_t and write(uint16_t, uint64_t)
+ */
+template <const auto &Schedule, uint8_t NodeId, class Policy>
+class node
+{
+public:
+    static constexpr uint16_t global_schedule_length = static_cast<uint16_t>(std::size(Schedule));
+    static constexpr uint16_t local_schedule_length = static_cast<uint16_t>(count_local_entries(Schedule, NodeId));
+
+    static_assert(NodeId != 0, "Node ID cannot be 0");
+    static_assert(global_schedule_length <= MAX_GLOBAL_SCHEDULE_LENGTH, "Global schedule is longer than MAX_GLOBAL_SCHEDULE_LENGTH");
+    static_assert(local_schedule_length > 0, "The node has no slots and the schedule no reference frames");
+
+    /**
+     * @brief Same as gttcan_init() with the schedule and callbacks of the template
+     *
+     * @param slot_duration Duration of each time slot in system time units
+     * @param interrupt_timing_offset See gttcan_init()
+     * @param dynamic_slot_duration_correction Enable automatic slot duration adjustment
+     */
+    node(uint32_t slot_duration, uint32_t interrupt_timing_offset, bool dynamic_slot_duration_correction = true)
+        : slot_duration(slot_duration),
+          interrupt_timing_offset(interrupt_timing_offset),
+          dynamic_slot_duration_correction(dynamic_slot_duration_correction)
+    {
+    }
+
+    /**
+     * @brief Same as gttcan_start()
+     */
+    void start()
+    {
+        begin(false);
+    }
+
+    /**
+     * @brief Same as gttcan_join()
+     */
+    void join()
+    {
+        begin(true);
+    }
+
+    /**
+     * @brief Same as gttcan_report_error(), to be called from the CAN error interrupt
+     *
+     * @param error What the driver saw
+     */
+    void report_error(gttcan_error_t error)
+    {
+        switch (error)
+        {
+            case GTTCAN_ERROR_BUS_OFF:
+                counters.bus_off_count++;
+                break;
+            case GTTCAN_ERROR_TX:
+                counters.tx_error_count++;
+                break;
+            case GTTCAN_ERROR_RX_OVERRUN:
+                counters.rx_overrun_count++;
+                break;
+        }
+
+        if (is_active)
+        {
+            recovery_slot_count = 0;
+            is_recovering = true;
+        }
+    }
+
+    /**
+     * @brief Same as gttcan_resume_after_sleep(), to be called on waking from a sleep that may have lost frames
+     */
+    void resume_after_sleep()
+    {
+        if (is_active)
+        {
+            recovery_slot_count = 0;
+            is_waiting_for_reference = true;
+            is_recovering = true;
+        }
+    }
+
+    /**
+     * @brief Same as gttcan_get_error_counters()
+     */
+    const gttcan_error_counters_t &error_counters() const
+    {
+        return counters;
+    }
+
+    /**
+     * @brief Same as gttcan_transmit_next_frame(), to be called from the timer interrupt
+     */
+    void transmit_next_frame()
+    {
+        if (!is_active)
+        {
+            return;
+        }
+
+        // Nothing was heard while joining, so the bus is silent and we cold-start
+        is_joining = false;
+
+        // Keep time through a recovery, but stay off the bus until a scheduled frame places us again
+        bool is_suspended = is_recovering;
+        if (is_suspended)
+        {
+            counters.suspended_slot_count++;
+            if (++recovery_slot_count >= local_schedule_length)
+            {
+                is_recovering = false; // A round without a scheduled frame, so the bus is silent
+                is_waiting_for_reference = false;
+                counters.timeout_count++;
+            }
+        }
+
+        const local_entry &entry = local_schedule[local_schedule_index];
+
+        if (local_schedule_index == 0)
+        {
+            cycle_count++;
+            is_time_master = (last_lowest_seen_node_id == current_lowest_seen_node_id) && (current_lowest_seen_node_id == NodeId);
+            last_lowest_seen_node_id = current_lowest_seen_node_id;
+            current_lowest_seen_node_id = 0;
+        }
+
+        local_schedule_index++;
+        if (local_schedule_index >= local_schedule_length)
+        {
+            local_schedule_index = 0;
+
+            if (!is_time_master)
+            {
+                reached_end_of_my_schedule_prematurely = true;
+            }
+        }
+
+        Policy::set_timer(time_after_slots(entry.slots_to_next));
+
+        if (is_suspended)
+        {
+            return; // Nothing sent, so not seen on the bus either
+        }
+
+        if (entry.data_id == REFERENCE_FRAME_DATA_ID)
+        {
+            if (is_time_master)
+            {
+                Policy::transmit(entry.frame_id, static_cast<uint64_t>(cycle_count) << GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT);
+            }
+        }
+        else
+        {
+            Policy::transmit(entry.frame_id, Policy::read(entry.data_id));
+        }
+
+        record_lowest_seen_node_id(NodeId);
+    }
+
+    /**
+     * @brief Same as gttcan_process_frame(), to be called for every received frame
+     *
+     * @param can_frame_id Identifier of the received frame
+     * @param data 64-bit data payload of the received frame
+     */
+    void process_frame(uint32_t can_frame_id, uint64_t data)
+    {
+#if GTTCAN_USE_STANDARD_FRAME_ID
+        uint16_t slot_id = can_frame_id & GTTCAN_STANDARD_FRAME_ID_MASK;
+#else
+        uint16_t slot_id = static_cast<uint16_t>(can_frame_id >> GTTCAN_NUM_DATA_ID_BITS);
+        uint16_t data_id = can_frame_id & GTTCAN_DATA_ID_MASK;
+#endif
+
+        bool is_scheduled_slot = slot_id < global_schedule_length;
+        uint8_t rx_node_id = is_scheduled_slot ? slots[slot_id].node_id : 0;
+#if GTTCAN_USE_STANDARD_FRAME_ID
+        if (rx_node_id == 0)
+        {
+            return; // Not a slot in our schedule, so the data_id is unknown
+        }
+        uint16_t data_id = slots[slot_id].data_id;
+#endif
+
+        // Until a frame places us, our position says nothing about our timing
+        bool is_unplaced = is_joining || is_recovering;
+        bool is_placing = is_joining || (is_recovering && (!is_waiting_for_reference || data_id == REFERENCE_FRAME_DATA_ID));
+        if (is_placing && rx_node_id != 0)
+        {
+            if (is_recovering)
+            {
+                is_recovering = false;
+                is_waiting_for_reference = false;
+                counters.resync_count++;
+            }
+            is_joining = false;
+
+            // Reference frames are synchronised to below, any other scheduled frame places us here
+            if (data_id != REFERENCE_FRAME_DATA_ID)
+            {
+                local_schedule_index = slots[slot_id].next_local_index;
+                Policy::set_timer(time_after_slots(slots[slot_id].slots_to_next_local));
+            }
+        }
+
+        bool is_from_master = (rx_node_id == last_lowest_seen_node_id) && (rx_node_id == current_lowest_seen_node_id) && (last_lowest_seen_node_id != 0);
+        bool is_adjusting = !is_unplaced && (is_from_master || (rounds_without_shuffling_against_master >= NUM_ROUNDS_BEFORE_SWITCHING_TO_ALL_NODE_ADJUST));
+
+        uint16_t next_slot_id = local_schedule[local_schedule_index].slot_id;
+        uint16_t previous_slot_id = (local_schedule_index > 0) ? local_schedule[local_schedule_index - 1].slot_id : 0;
+        bool has_transmitted = local_schedule_index > 0 && !reached_end_of_my_schedule_prematurely;
+
+        if (is_adjusting && slot_id > next_slot_id && has_transmitted)
+        {
+            shuffled(-1, is_from_master); // I am slow, speed up
+        }
+
+        if (is_adjusting && slot_id < previous_slot_id && has_transmitted && slot_id != 0)
+        {
+            shuffled(1, is_from_master); // I am fast, slow down
+        }
+
+        if (!is_active && slot_id == 0)
+        {
+            is_active = true;
+        }
+
+        if (data_id == REFERENCE_FRAME_DATA_ID)
+        {
+            cycle_count = static_cast<uint32_t>(data >> GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT);
+
+            if (slot_id == 0 && !is_time_master)
+            {
+                if (dynamic_slot_duration_correction && slot_duration_offset > 0)
+                {
+                    slot_duration++;
+                }
+                if (dynamic_slot_duration_correction && slot_duration_offset < 0)
+                {
+                    slot_duration--;
+                }
+                if (slot_duration_offset == 0 && rounds_without_shuffling_against_master < NUM_ROUNDS_BEFORE_SWITCHING_TO_ALL_NODE_ADJUST)
+                {
+                    rounds_without_shuffling_against_master++;
+                }
+                slot_duration_offset = 0;
+                reached_end_of_my_schedule_prematurely = false;
+            }
+
+            // A slot outside the schedule leaves us at the start of it, like gttcan_get_next_local_schedule_index()
+            uint16_t next_index = is_scheduled_slot ? slots[slot_id].next_local_index : 0;
+            if (is_adjusting &&
+                !reached_end_of_my_schedule_prematurely &&
+                ((local_schedule_index < next_index) || (next_index == 0 && local_schedule_index != 0)))
+            {
+                shuffled(-1, is_from_master); // Behind schedule, or I didn't complete my schedule
+            }
+            local_schedule_index = next_index;
+
+            uint16_t slots_to_wait = is_scheduled_slot ? slots[slot_id].slots_to_next_local
+                                                       : slots_to_next(slot_id, local_schedule[0].slot_id, global_schedule_length);
+            Policy::set_timer(time_after_slots(slots_to_wait));
+        }
+        else
+        {
+            Policy::write(data_id, data);
+        }
+
+        record_lowest_seen_node_id(rx_node_id);
+    }
+
+    uint32_t get_cycle_count() const
+    {
+        return cycle_count;
+    }
+
+    uint32_t get_slot_duration() const
+    {
+        return slot_duration;
+    }
+
+    bool get_is_time_master() const
+    {
+        return is_time_master;
+    }
+
+private:
+    struct local_entry
+    {
+        uint16_t slot_id;
+        uint16_t data_id;
+        uint32_t frame_id;
+        uint16_t slots_to_next;     // Slots from this entry to the next local entry
+    };
+
+    struct slot_entry
+    {
+        uint8_t node_id;            // Sender of the slot, 0 if unused
+        uint16_t data_id;
+        uint16_t next_local_index;  // First local entry after the slot, wrapping to 0
+        uint16_t slots_to_next_local;
+    };
+
+    static constexpr std::array<local_entry, local_schedule_length> build_local_schedule()
+    {
+        std::array<local_entry, local_schedule_length> local{};
+        std::size_t index = 0;
+        for (std::size_t i = 0; i < global_schedule_length; i++)
+        {
+            if (Schedule[i].node_id == NodeId || Schedule[i].data_id == REFERENCE_FRAME_DATA_ID)
+            {
+                local[index].slot_id = Schedule[i].slot_id;
+                local[index].data_id = Schedule[i].data_id;
+                local[index].frame_id = build_frame_id(Schedule[i].slot_id, Schedule[i].data_id);
+                index++;
+            }
+        }
+        for (std::size_t i = 0; i < local_schedule_length; i++)
+        {
+            local[i].slots_to_next = slots_to_next(local[i].slot_id, local[(i + 1) % local_schedule_length].slot_id, global_schedule_length);
+        }
+        return local;
+    }
+
+    static constexpr std::array<slot_entry, global_schedule_length> build_slots()
+    {
+        std::array<local_entry, local_schedule_length> local = build_local_schedule();
+        std::array<slot_entry, global_schedule_length> table{};
+        for (std::size_t i = 0; i < global_schedule_length; i++)
+        {
+            if (Schedule[i].slot_id < global_schedule_length && table[Schedule[i].slot_id].node_id == 0)
+            {
+                table[Schedule[i].slot_id].node_id = Schedule[i].node_id;
+                table[Schedule[i].slot_id].data_id = Schedule[i].data_id;
+            }
+        }
+        for (std::size_t slot = 0; slot < global_schedule_length; slot++)
+        {
+            uint16_t next_index = 0;
+            for (std::size_t i = 0; i < local_schedule_length; i++)
+            {
+                if (local[i].slot_id > slot)
+                {
+                    next_index = static_cast<uint16_t>(i);
+                    break;
+                }
+            }
+            table[slot].next_local_index = next_index;
+            table[slot].slots_to_next_local = slots_to_next(static_cast<uint16_t>(slot), local[next_index].slot_id, global_schedule_length);
+        }
+        return table;
+    }
+
+    static constexpr std::array<local_entry, local_schedule_length> local_schedule = build_local_schedule();
+    static constexpr std::array<slot_entry, global_schedule_length> slots = build_slots();
+
+    void begin(bool joining)
+    {
+        is_active = true;
+        is_joining = joining;
+        is_recovering = false;
+        is_waiting_for_reference = false;
+        local_schedule_index = 0;
+        is_time_master = false;
+        last_lowest_seen_node_id = NodeId;
+        Policy::set_timer((global_schedule_length + (NodeId * DEFAULT_STARTUP_PAUSE_SLOTS)) * slot_duration);
+    }
+
+    // Same as gttcan_get_time_to_next_transmission()
+    uint32_t time_after_slots(uint16_t slots_to_wait) const
+    {
+        uint32_t time = static_cast<uint32_t>(slots_to_wait) * slot_duration;
+        return (time > interrupt_timing_offset) ? time - interrupt_timing_offset : 1;
+    }
+
+    void shuffled(int step, bool is_from_master)
+    {
+        slot_duration_offset += step;
+        if (is_from_master)
+        {
+            rounds_without_shuffling_against_master = 0;
+        }
+    }
+
+    void record_lowest_seen_node_id(uint8_t node_id)
+    {
+        if (node_id < current_lowest_seen_node_id || current_lowest_seen_node_id == 0)
+        {
+            current_lowest_seen_node_id = node_id;
+        }
+    }
+
+    uint32_t slot_duration;
+    uint32_t interrupt_timing_offset;
+    bool dynamic_slot_duration_correction;
+
+    bool is_active = false;
+    bool is_joining = false;
+    uint16_t local_schedule_index = 0;
+    uint32_t cycle_count = 0;
+
+    // Shuffle correction
+    bool reached_end_of_my_schedule_prematurely = false;
+    int slot_duration_offset = 0;
+    int rounds_without_shuffling_against_master = 0;
+
+    // Cascading master
+    uint8_t last_lowest_seen_node_id = 0;
+    uint8_t current_lowest_seen_node_id = 0;
+    bool is_time_master = false;
+
+    // Error recovery
+    bool is_recovering = false;
+    bool is_waiting_for_reference = false;
+    uint16_t recovery_slot_count = 0;
+    gttcan_error_counters_t counters = {};
+};
+
+} // namespace gttcan
+
+#endif
@@ -0,0 +1,497 @@
+/*
+ * gttcan_bench.c
+ *
+ *  Host microbenchmark of the G-TTCAN entry points that run in interrupt context
+ *  (gttcan_transmit_next_frame(), gttcan_process_frame(), gttcan_get_time_to_next_transmission())
+ *  and of gttcan_get_local_schedule(), across schedule lengths, node counts and frame mixes.
+ *
+ *  Build (from the repository root):
+ *      cc -O2 -DMAX_GLOBAL_SCHEDULE_LENGTH=8192 -DGTTCAN_MAX_LOCAL_SCHEDULE_LENGTH=8192 -Isrc/include \
+ *          -o gttcan_bench tools/gttcan_bench.c src/gttcan.c
+ *  Use the same G-TTCAN configuration macros and optimisation level as the target. Schedule
+ *  lengths above MAX_GLOBAL_SCHEDULE_LENGTH are skipped. With GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+ *  the same schedules are given as runs, skipping those that need more than
+ *  GTTCAN_MAX_SCHEDULE_RUNS runs or more than GTTCAN_MAX_RUN_PATTERN_LENGTH nodes.
+ *
+ *  Usage:
+ *      gttcan_bench [-r repeats] [-w baseline.txt] [-b baseline.txt] [-t tolerance_percent]
+ *          -r  Run every configuration this many times (default 5), keeping the lowest median
+ *          -w  Save the results as a baseline
+ *          -b  Compare against a saved baseline, flagging any median that grew by more than the
+ *              tolerance (default 15%), exits with 1 on regression
+ *
+ *  Each call is timed individually with the cycle counter (TSC on x86, the virtual counter on
+ *  AArch64, otherwise nanoseconds) and the counter read overhead is subtracted. Best and median
+ *  are stable across runs; worst includes host interrupts and cache misses, so treat it as an
+ *  upper bound and confirm the worst-case ISR time on the target. Baselines are machine
+ *  specific and are not committed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gttcan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles"
+static inline uint64_t bench_counter(void) { return __rdtsc(); }
+#elif defined(__aarch64__)
+#define BENCH_UNIT "ticks"
+static inline uint64_t bench_counter(void)
+{
+    uint64_t value;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+}
+#else
+#define BENCH_UNIT "ns"
+static inline uint64_t bench_counter(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+#endif
+
+#define BENCH_SAMPLES 4096          // Samples per entry point and configuration
+#define BENCH_MAX_ROUNDS 4096       // Upper bound on rounds walked to collect them
+#define BENCH_MAX_RESULTS 256
+#define BENCH_NODE_ID 2             // Node under test, not the time master
+#define BENCH_SLOT_DURATION 300
+#define BENCH_REFERENCE_INTERVAL 16 // Slots between reference frames in the dense mix
+
+typedef enum
+{
+    MIX_SPARSE, // One reference frame per round
+    MIX_DENSE,  // A reference frame every BENCH_REFERENCE_INTERVAL slots
+    MIX_PACKED, // One reference frame per round, data frames carry four packed signals
+    MIX_COUNT
+} frame_mix_t;
+
+static const char *mix_names[MIX_COUNT] = {"sparse", "dense", "packed"};
+static const uint16_t schedule_lengths[] = {8, 64, 512, 2048, 8192};
+static const uint8_t node_counts[] = {2, 8, 32};
+
+typedef struct
+{
+    char name[64];
+    uint64_t best;
+    uint64_t median;
+    uint64_t worst;
+} bench_result_t;
+
+gttcan_t gttcan;
+global_schedule_entry_t global_schedule[MAX_GLOBAL_SCHEDULE_LENGTH];
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+gttcan_schedule_run_t schedule_runs[GTTCAN_MAX_SCHEDULE_RUNS];
+uint16_t schedule_run_count;
+#endif
+uint64_t samples_tx[BENCH_SAMPLES];
+uint64_t samples_rx[BENCH_SAMPLES];
+uint64_t samples_next[BENCH_SAMPLES];
+uint64_t samples_local[BENCH_SAMPLES];
+bench_result_t results[BENCH_MAX_RESULTS];
+int result_count = 0;
+uint64_t counter_overhead = 0;
+uint64_t reference_cost = 0;
+uint32_t bench_time = 0;
+volatile uint64_t sink;
+
+gttcan_signal_t packed_signals[] = {
+    {GENERIC_DATA_ID, 0, 1, 1, 0, false, 0},
+    {GENERIC_DATA_ID, 1, 12, 1, 0, false, 0},
+    {GENERIC_DATA_ID, 13, 8, 1, -40, false, 0},
+    {GENERIC_DATA_ID, 21, 16, 10, 0, false, 0},
+};
+gttcan_frame_layout_t packed_layouts[] = {
+    {GENERIC_DATA_ID, 4, packed_signals},
+};
+
+// G-TTCAN callbacks, kept trivial so only library time is measured
+void bench_transmit_frame(uint32_t can_frame_id, uint64_t data) { sink = can_frame_id ^ data; }
+void bench_set_timer_int(uint32_t time) { sink = time; }
+uint64_t bench_read_value(uint16_t data_id) { return data_id; }
+void bench_write_value(uint16_t data_id, uint64_t value) { sink = data_id ^ value; }
+uint32_t bench_get_local_time(void) { return bench_time; }
+
+static int compare_samples(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void calibrate_counter(void)
+{
+    counter_overhead = UINT64_MAX;
+    for (int i = 0; i < 10000; i++)
+    {
+        uint64_t start = bench_counter();
+        uint64_t elapsed = bench_counter() - start;
+        if (elapsed < counter_overhead)
+        {
+            counter_overhead = elapsed;
+        }
+    }
+}
+
+// Cost of a fixed dependent arithmetic loop. The counter may not tick with the core clock, so
+// baselines are scaled by it to cancel frequency scaling between runs.
+static void calibrate_reference(void)
+{
+    reference_cost = UINT64_MAX;
+    for (int i = 0; i < 1000; i++)
+    {
+        uint64_t value = (uint64_t)i;
+        uint64_t start = bench_counter();
+        for (int k = 0; k < 1000; k++)
+        {
+            value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+        }
+        uint64_t elapsed = bench_counter() - start;
+        sink = value;
+        if (elapsed < reference_cost)
+        {
+            reference_cost = elapsed;
+        }
+    }
+}
+
+static inline uint64_t bench_elapsed(uint64_t start)
+{
+    uint64_t elapsed = bench_counter() - start;
+    return elapsed > counter_overhead ? elapsed - counter_overhead : 0;
+}
+
+static void add_result(const char *config, const char *function, uint64_t *samples, int count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+    qsort(samples, count, sizeof(uint64_t), compare_samples);
+
+    char name[sizeof(results[0].name)];
+    snprintf(name, sizeof(name), "%s/%s", config, function);
+
+    // Repeated runs keep the lowest median, host noise only ever adds time
+    bench_result_t *result = NULL;
+    for (int i = 0; i < result_count; i++)
+    {
+        if (strcmp(results[i].name, name) == 0)
+        {
+            result = &results[i];
+            break;
+        }
+    }
+    if (result == NULL)
+    {
+        if (result_count == BENCH_MAX_RESULTS)
+        {
+            return;
+        }
+        result = &results[result_count++];
+        strcpy(result->name, name);
+        result->best = UINT64_MAX;
+        result->median = UINT64_MAX;
+        result->worst = 0;
+    }
+    if (samples[0] < result->best)
+    {
+        result->best = samples[0];
+    }
+    if (samples[count / 2] < result->median)
+    {
+        result->median = samples[count / 2];
+    }
+    if (samples[count - 1] > result->worst)
+    {
+        result->worst = samples[count - 1];
+    }
+}
+
+static void print_results(int first)
+{
+    for (int i = first; i < result_count; i++)
+    {
+        printf("%-48s %8llu %8llu %8llu\n", results[i].name, (unsigned long long)results[i].best,
+               (unsigned long long)results[i].median, (unsigned long long)results[i].worst);
+    }
+}
+
+static bool build_schedule(uint16_t length, uint8_t nodes, frame_mix_t mix)
+{
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    if (nodes > GTTCAN_MAX_RUN_PATTERN_LENGTH)
+    {
+        return false;
+    }
+    schedule_run_count = 0;
+#endif
+    for (uint16_t slot = 0; slot < length; slot++)
+    {
+        bool reference = (slot == 0) || (mix == MIX_DENSE && slot % BENCH_REFERENCE_INTERVAL == 0);
+        global_schedule[slot].node_id = reference ? 1 : (uint8_t)(slot % nodes + 1);
+        global_schedule[slot].slot_id = slot;
+        global_schedule[slot].data_id = reference ? REFERENCE_FRAME_DATA_ID : GENERIC_DATA_ID;
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+        // A run for each reference frame, and one for the round robin of data frames after it
+        if (reference || slot == 1 || global_schedule[slot - 1].data_id == REFERENCE_FRAME_DATA_ID)
+        {
+            if (schedule_run_count == GTTCAN_MAX_SCHEDULE_RUNS)
+            {
+                return false;
+            }
+            gttcan_schedule_run_t *run = &schedule_runs[schedule_run_count++];
+            run->first_slot_id = slot;
+            run->slot_count = 0;
+            run->data_id = global_schedule[slot].data_id;
+            run->pattern_length = reference ? 1 : nodes;
+            for (uint8_t k = 0; k < run->pattern_length; k++)
+            {
+                run->node_ids[k] = reference ? 1 : (uint8_t)((slot + k) % nodes + 1);
+            }
+        }
+        schedule_runs[schedule_run_count - 1].slot_count++;
+#endif
+    }
+    return true;
+}
+
+static void bench_configuration(uint16_t length, uint8_t nodes, frame_mix_t mix)
+{
+    char config[48];
+    snprintf(config, sizeof(config), "len=%u,nodes=%u,%s", length, nodes, mix_names[mix]);
+
+    if (!build_schedule(length, nodes, mix))
+    {
+        return;
+    }
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+    gttcan_init(&gttcan, BENCH_NODE_ID, schedule_runs, schedule_run_count, BENCH_SLOT_DURATION, 7, bench_transmit_frame,
+                bench_set_timer_int, bench_read_value, bench_write_value, true);
+#else
+    gttcan_init(&gttcan, BENCH_NODE_ID, global_schedule, length, BENCH_SLOT_DURATION, 7, bench_transmit_frame,
+                bench_set_timer_int, bench_read_value, bench_write_value, true);
+#endif
+    gttcan_set_local_time_callback(&gttcan, bench_get_local_time);
+    if (mix == MIX_PACKED)
+    {
+        gttcan_set_frame_layouts(&gttcan, packed_layouts, 1);
+    }
+    bench_time = 0;
+    gttcan_start(&gttcan);
+
+    // Walk whole rounds in schedule order, as the node would see them on the bus
+    int tx_count = 0, rx_count = 0, next_count = 0;
+    uint32_t cycle = 0;
+    for (int round = 0; round < BENCH_MAX_ROUNDS && (tx_count < BENCH_SAMPLES || rx_count < BENCH_SAMPLES); round++)
+    {
+        for (uint16_t slot = 0; slot < length; slot++)
+        {
+            const global_schedule_entry_t *entry = &global_schedule[slot];
+            uint64_t start;
+            bench_time += BENCH_SLOT_DURATION;
+
+            if (entry->node_id == BENCH_NODE_ID)
+            {
+                start = bench_counter();
+                gttcan_transmit_next_frame(&gttcan);
+                uint64_t elapsed = bench_elapsed(start);
+                if (tx_count < BENCH_SAMPLES)
+                {
+                    samples_tx[tx_count++] = elapsed;
+                }
+            }
+            else
+            {
+                uint64_t data = 0x0123456789ABCDEFULL;
+                if (entry->data_id == REFERENCE_FRAME_DATA_ID)
+                {
+                    data = ((uint64_t)cycle << GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT) | bench_time;
+                }
+                uint32_t can_frame_id = gttcan_build_frame_id(entry->slot_id, entry->data_id);
+
+                start = bench_counter();
+                gttcan_process_frame(&gttcan, can_frame_id, data);
+                uint64_t elapsed = bench_elapsed(start);
+                if (rx_count < BENCH_SAMPLES)
+                {
+                    samples_rx[rx_count++] = elapsed;
+                }
+            }
+
+            start = bench_counter();
+            sink = gttcan_get_time_to_next_transmission(slot, &gttcan);
+            uint64_t elapsed = bench_elapsed(start);
+            if (next_count < BENCH_SAMPLES)
+            {
+                samples_next[next_count++] = elapsed;
+            }
+        }
+        cycle++;
+    }
+
+    // Rebuilding the local schedule is linear in the global schedule length, or the number of runs
+    int local_count = 0;
+    int local_target = (int)(262144 / length);
+    if (local_target < 16)
+    {
+        local_target = 16;
+    }
+    if (local_target > BENCH_SAMPLES)
+    {
+        local_target = BENCH_SAMPLES;
+    }
+    while (local_count < local_target)
+    {
+        uint64_t start = bench_counter();
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+        gttcan_get_local_schedule(&gttcan, schedule_runs);
+#else
+        gttcan_get_local_schedule(&gttcan, global_schedule);
+#endif
+        samples_local[local_count++] = bench_elapsed(start);
+    }
+
+    add_result(config, "transmit_next_frame", samples_tx, tx_count);
+    add_result(config, "process_frame", samples_rx, rx_count);
+    add_result(config, "time_to_next_transmission", samples_next, next_count);
+    add_result(config, "get_local_schedule", samples_local, local_count);
+}
+
+static int save_baseline(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+    fprintf(file, "# gttcan_bench baseline (%s): name best median worst\n", BENCH_UNIT);
+    fprintf(file, "reference %llu\n", (unsigned long long)reference_cost);
+    for (int i = 0; i < result_count; i++)
+    {
+        fprintf(file, "%s %llu %llu %llu\n", results[i].name, (unsigned long long)results[i].best,
+                (unsigned long long)results[i].median, (unsigned long long)results[i].worst);
+    }
+    fclose(file);
+    printf("baseline saved to %s\n", path);
+    return 0;
+}
+
+static int compare_baseline(const char *path, unsigned tolerance_percent)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+
+    char line[256];
+    int compared = 0, regressions = 0;
+    unsigned long long baseline_reference_cost = reference_cost;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[64];
+        unsigned long long best, median, worst;
+        if (sscanf(line, "reference %llu", &baseline_reference_cost) == 1)
+        {
+            continue;
+        }
+        if (line[0] == '#' || sscanf(line, "%63s %llu %llu %llu", name, &best, &median, &worst) != 4)
+        {
+            continue;
+        }
+        for (int i = 0; i < result_count; i++)
+        {
+            if (strcmp(results[i].name, name) != 0)
+            {
+                continue;
+            }
+            compared++;
+            // Scale to the current clock, medians of a few counts are dominated by counter resolution
+            uint64_t expected = baseline_reference_cost ? median * reference_cost / baseline_reference_cost : median;
+            uint64_t limit = expected + expected * tolerance_percent / 100 + counter_overhead;
+            if (results[i].median > limit)
+            {
+                regressions++;
+                printf("REGRESSION %-48s median %llu -> %llu (expected %llu)\n", name, median,
+                       (unsigned long long)results[i].median, (unsigned long long)expected);
+            }
+            break;
+        }
+    }
+    fclose(file);
+
+    printf("compared %d results against %s, %d regressions (tolerance %u%%)\n", compared, path, regressions,
+           tolerance_percent);
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *baseline_path = NULL;
+    const char *save_path = NULL;
+    unsigned tolerance_percent = 15;
+    int repeats = 5;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) baseline_path = argv[++i];
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) save_path = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) tolerance_percent = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) repeats = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-r repeats] [-w baseline.txt] [-b baseline.txt] [-t tolerance_percent]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    calibrate_counter();
+    calibrate_reference();
+    printf("%-48s %8s %8s %8s  (%s, counter overhead %llu, reference loop %llu)\n", "configuration/function", "best",
+           "median", "worst", BENCH_UNIT, (unsigned long long)counter_overhead, (unsigned long long)reference_cost);
+
+    for (size_t l = 0; l < sizeof(schedule_lengths) / sizeof(schedule_lengths[0]); l++)
+    {
+        if (schedule_lengths[l] > MAX_GLOBAL_SCHEDULE_LENGTH || schedule_lengths[l] > GTTCAN_MAX_LOCAL_SCHEDULE_LENGTH)
+        {
+            printf("skipping %u slot schedules, MAX_GLOBAL_SCHEDULE_LENGTH is %u\n", schedule_lengths[l],
+                   MAX_GLOBAL_SCHEDULE_LENGTH);
+            continue;
+        }
+        for (size_t n = 0; n < sizeof(node_counts) / sizeof(node_counts[0]); n++)
+        {
+            // Every node, including the one under test, needs at least one slot
+            if (node_counts[n] > schedule_lengths[l])
+            {
+                continue;
+            }
+            for (int mix = 0; mix < MIX_COUNT; mix++)
+            {
+                int first = result_count;
+                for (int repeat = 0; repeat < repeats; repeat++)
+                {
+                    bench_configuration(schedule_lengths[l], node_counts[n], (frame_mix_t)mix);
+                }
+                print_results(first);
+            }
+        }
+    }
+
+    int result = 0;
+    if (save_path != NULL)
+    {
+        result = save_baseline(save_path);
+    }
+    if (baseline_path != NULL && result == 0)
+    {
+        result = compare_baseline(baseline_path, tolerance_percent);
+    }
+    return result;
+}
@@ -0,0 +1,282 @@
+/*
+ * gttcan_bench_hpp.cpp
+ *
+ *  Host microbenchmark of the header-only C++ front end (gttcan.hpp) against the C core
+ *  (gttcan.c), for the same schedules and the same frames. Times every call of the timer and
+ *  receive entry points, as tools/gttcan_bench.c does, and first checks that both produce
+ *  exactly the same frames, timer arms and received values.
+ *
+ *  Build (from the repository root):
+ *      cc -O2 -Isrc/include -c -o gttcan.o src/gttcan.c
+ *      c++ -std=c++17 -O2 -Isrc/include -o gttcan_bench_hpp tools/gttcan_bench_hpp.cpp gttcan.o
+ *  Use the same optimisation level as the target.
+ *
+ *  Usage:
+ *      gttcan_bench_hpp [-r repeats]
+ *          -r  Run every configuration this many times (default 5), keeping the lowest median
+ *
+ *  Exits with 1 if the two implementations behave differently.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "gttcan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "cycles"
+static inline uint64_t bench_counter() { return __rdtsc(); }
+#elif defined(__aarch64__)
+#define BENCH_UNIT "ticks"
+static inline uint64_t bench_counter()
+{
+    uint64_t value;
+    __asm__ volatile("isb; mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+}
+#else
+#define BENCH_UNIT "ns"
+static inline uint64_t bench_counter()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ULL + static_cast<uint64_t>(now.tv_nsec);
+}
+#endif
+
+#define BENCH_SAMPLES 4096          // Samples per entry point and configuration
+#define BENCH_CHECK_ROUNDS 50       // Rounds compared between the two implementations
+#define BENCH_NODE_ID 2             // Node under test, not the time master
+#define BENCH_NODES 8
+#define BENCH_SLOT_DURATION 300
+#define BENCH_INTERRUPT_TIMING_OFFSET 7
+
+// One reference frame per round, the other slots shared round robin by BENCH_NODES nodes
+template <std::size_t N>
+constexpr std::array<global_schedule_entry_t, N> make_schedule()
+{
+    std::array<global_schedule_entry_t, N> schedule{};
+    for (std::size_t slot = 0; slot < N; slot++)
+    {
+        bool reference = slot == 0;
+        schedule[slot].node_id = reference ? 1 : static_cast<uint8_t>(slot % BENCH_NODES + 1);
+        schedule[slot].slot_id = static_cast<uint16_t>(slot);
+        schedule[slot].data_id = reference ? REFERENCE_FRAME_DATA_ID : static_cast<uint16_t>(GENERIC_DATA_ID + slot);
+    }
+    return schedule;
+}
+
+static constexpr auto schedule_8 = make_schedule<8>();
+static constexpr auto schedule_64 = make_schedule<64>();
+static constexpr auto schedule_512 = make_schedule<512>();
+
+static volatile uint64_t sink;
+static uint64_t counter_overhead = 0;
+
+// Trivial callbacks, so only protocol time is measured
+struct bench_policy
+{
+    static void transmit(uint32_t can_frame_id, uint64_t data) { sink = can_frame_id ^ data; }
+    static void set_timer(uint32_t time) { sink = time; }
+    static uint64_t read(uint16_t data_id) { return data_id; }
+    static void write(uint16_t data_id, uint64_t data) { sink = data_id ^ data; }
+};
+
+extern "C" void bench_transmit_frame(uint32_t can_frame_id, uint64_t data) { bench_policy::transmit(can_frame_id, data); }
+extern "C" void bench_set_timer_int(uint32_t time) { bench_policy::set_timer(time); }
+extern "C" uint64_t bench_read_value(uint16_t data_id) { return bench_policy::read(data_id); }
+extern "C" void bench_write_value(uint16_t data_id, uint64_t data) { bench_policy::write(data_id, data); }
+
+// Callbacks that record what they are called with, for the comparison
+static std::vector<uint64_t> events;
+
+struct log_policy
+{
+    static void transmit(uint32_t can_frame_id, uint64_t data) { events.push_back((1ULL << 60) | can_frame_id); events.push_back(data); }
+    static void set_timer(uint32_t time) { events.push_back((2ULL << 60) | time); }
+    static uint64_t read(uint16_t data_id) { return data_id * 0x9E3779B97F4A7C15ULL; }
+    static void write(uint16_t data_id, uint64_t data) { events.push_back((3ULL << 60) | data_id); events.push_back(data); }
+};
+
+extern "C" void log_transmit_frame(uint32_t can_frame_id, uint64_t data) { log_policy::transmit(can_frame_id, data); }
+extern "C" void log_set_timer_int(uint32_t time) { log_policy::set_timer(time); }
+extern "C" uint64_t log_read_value(uint16_t data_id) { return log_policy::read(data_id); }
+extern "C" void log_write_value(uint16_t data_id, uint64_t data) { log_policy::write(data_id, data); }
+
+static inline uint64_t bench_elapsed(uint64_t start)
+{
+    uint64_t elapsed = bench_counter() - start;
+    return elapsed > counter_overhead ? elapsed - counter_overhead : 0;
+}
+
+static void calibrate_counter()
+{
+    counter_overhead = UINT64_MAX;
+    for (int i = 0; i < 10000; i++)
+    {
+        uint64_t start = bench_counter();
+        uint64_t elapsed = bench_counter() - start;
+        counter_overhead = std::min(counter_overhead, elapsed);
+    }
+}
+
+static uint64_t median(std::vector<uint64_t> &samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples.empty() ? 0 : samples[samples.size() / 2];
+}
+
+// Adapters giving both implementations the same interface
+struct c_node
+{
+    gttcan_t gttcan;
+    global_schedule_entry_t schedule[MAX_GLOBAL_SCHEDULE_LENGTH];
+
+    template <std::size_t N>
+    c_node(const std::array<global_schedule_entry_t, N> &global_schedule, bool is_logged)
+    {
+        std::copy(global_schedule.begin(), global_schedule.end(), schedule);
+        if (is_logged)
+        {
+            gttcan_init(&gttcan, BENCH_NODE_ID, schedule, N, BENCH_SLOT_DURATION, BENCH_INTERRUPT_TIMING_OFFSET,
+                        log_transmit_frame, log_set_timer_int, log_read_value, log_write_value, true);
+        }
+        else
+        {
+            gttcan_init(&gttcan, BENCH_NODE_ID, schedule, N, BENCH_SLOT_DURATION, BENCH_INTERRUPT_TIMING_OFFSET,
+                        bench_transmit_frame, bench_set_timer_int, bench_read_value, bench_write_value, true);
+        }
+    }
+
+    c_node(const c_node &) = delete; // gttcan points into schedule
+
+    void start() { gttcan_start(&gttcan); }
+    void transmit_next_frame() { gttcan_transmit_next_frame(&gttcan); }
+    void process_frame(uint32_t can_frame_id, uint64_t data) { gttcan_process_frame(&gttcan, can_frame_id, data); }
+};
+
+/**
+ * Walk whole rounds in schedule order, as the node under test sees them on the bus. Every
+ * fourth round one slot of another node is missing and in every seventh round a reference
+ * frame arrives a slot late, so the shuffle correction paths run too.
+ */
+template <std::size_t N, class Node>
+static void walk(const std::array<global_schedule_entry_t, N> &schedule, Node &node, int rounds,
+                 std::vector<uint64_t> *tx_samples, std::vector<uint64_t> *rx_samples)
+{
+    node.start();
+    for (int round = 0; round < rounds; round++)
+    {
+        for (std::size_t slot = 0; slot < N; slot++)
+        {
+            const global_schedule_entry_t &entry = schedule[slot];
+            if (entry.node_id == BENCH_NODE_ID)
+            {
+                uint64_t start = bench_counter();
+                node.transmit_next_frame();
+                if (tx_samples != nullptr)
+                {
+                    tx_samples->push_back(bench_elapsed(start));
+                }
+                continue;
+            }
+            if (round % 4 == 3 && slot == N / 2)
+            {
+                continue;
+            }
+
+            uint16_t slot_id = entry.slot_id;
+            if (round % 7 == 6 && entry.data_id == REFERENCE_FRAME_DATA_ID && N > 2)
+            {
+                slot_id = 1; // Received at the wrong point of the schedule
+            }
+            uint64_t data = (entry.data_id == REFERENCE_FRAME_DATA_ID) ? (static_cast<uint64_t>(round) << GTTCAN_REFERENCE_FRAME_CYCLE_SHIFT) : 0x0123456789ABCDEFULL;
+            uint32_t can_frame_id = gttcan_build_frame_id(slot_id, entry.data_id);
+
+            uint64_t start = bench_counter();
+            node.process_frame(can_frame_id, data);
+            if (rx_samples != nullptr)
+            {
+                rx_samples->push_back(bench_elapsed(start));
+            }
+        }
+    }
+}
+
+template <const auto &Schedule>
+static bool bench_configuration(int repeats)
+{
+    constexpr std::size_t length = std::size(Schedule);
+
+    // Same frames in, same callbacks out
+    events.clear();
+    c_node logged_c(Schedule, true);
+    walk(Schedule, logged_c, BENCH_CHECK_ROUNDS, nullptr, nullptr);
+    std::vector<uint64_t> c_events = events;
+
+    events.clear();
+    gttcan::node<Schedule, BENCH_NODE_ID, log_policy> logged_hpp(BENCH_SLOT_DURATION, BENCH_INTERRUPT_TIMING_OFFSET);
+    walk(Schedule, logged_hpp, BENCH_CHECK_ROUNDS, nullptr, nullptr);
+    bool is_identical = (events == c_events);
+
+    uint64_t best[4] = {UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX};
+    int rounds = static_cast<int>(BENCH_SAMPLES * BENCH_NODES / length) + 2;
+    for (int repeat = 0; repeat < repeats; repeat++)
+    {
+        std::vector<uint64_t> samples[4];
+        c_node timed_c(Schedule, false);
+        walk(Schedule, timed_c, rounds, &samples[0], &samples[1]);
+
+        gttcan::node<Schedule, BENCH_NODE_ID, bench_policy> timed_hpp(BENCH_SLOT_DURATION, BENCH_INTERRUPT_TIMING_OFFSET);
+        walk(Schedule, timed_hpp, rounds, &samples[2], &samples[3]);
+
+        for (int i = 0; i < 4; i++)
+        {
+            best[i] = std::min(best[i], median(samples[i]));
+        }
+    }
+
+    const char *names[2] = {"transmit_next_frame", "process_frame"};
+    for (int i = 0; i < 2; i++)
+    {
+        double saving = best[i] ? 100.0 * (static_cast<double>(best[i]) - static_cast<double>(best[i + 2])) / static_cast<double>(best[i]) : 0.0;
+        std::printf("len=%-4zu %-20s %10llu %10llu %8.0f%%\n", length, names[i],
+                    static_cast<unsigned long long>(best[i]), static_cast<unsigned long long>(best[i + 2]), saving);
+    }
+    if (!is_identical)
+    {
+        std::printf("len=%-4zu MISMATCH: the C++ front end behaves differently from gttcan.c\n", length);
+    }
+    return is_identical;
+}
+
+int main(int argc, char **argv)
+{
+    int repeats = 5;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            repeats = std::atoi(argv[++i]);
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: %s [-r repeats]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    calibrate_counter();
+    std::printf("median %s per call, node %d of %d, lowest of %d runs\n", BENCH_UNIT, BENCH_NODE_ID, BENCH_NODES, repeats);
+    std::printf("%-29s %10s %10s %9s\n", "", "gttcan.c", "gttcan.hpp", "saving");
+
+    bool is_identical = bench_configuration<schedule_8>(repeats);
+    is_identical = bench_configuration<schedule_64>(repeats) && is_identical;
+    is_identical = bench_configuration<schedule_512>(repeats) && is_identical;
+    return is_identical ? 0 : 1;
+}
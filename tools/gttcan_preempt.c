@@ -0,0 +1,348 @@
+/*
+ * gttcan_preempt.c
+ *
+ *  Host stress test of G-TTCAN with the timer interrupt preempting frame processing, as
+ *  allowed by GTTCAN_ENABLE_PREEMPTIVE_TIMER. Simulates a small network on one bus, where
+ *  every gttcan_process_frame() call is taken to last rx_time, and delivers any timer expiry
+ *  of the receiving node that falls due meanwhile from inside the callbacks it makes
+ *  (get_local_time_fp, set_timer_int_callback_fp, write_value_fp), i.e. at the points where
+ *  it has read or half updated the shared state. Sweeps rx_time, the node clock drifts and
+ *  the interrupt timing offset, and checks that after start-up every slot of every round is
+ *  sent, once and in order.
+ *
+ *  Build (from the repository root):
+ *      cc -std=c11 -O2 -DGTTCAN_ENABLE_PREEMPTIVE_TIMER=1 -Isrc/include -o gttcan_preempt tools/gttcan_preempt.c src/gttcan.c
+ *  Built without GTTCAN_ENABLE_PREEMPTIVE_TIMER it shows the slots lost and sent twice when
+ *  the timer interrupt is given priority over the receive interrupt without it.
+ *
+ *  Usage:
+ *      gttcan_preempt [-n] [-v] [-r rounds]
+ *          -n  Timer expiries wait for frame processing to finish (both interrupts at the
+ *              same priority), instead of preempting it
+ *          -v  Print every slot error
+ *          -r  Rounds to simulate per configuration (default 200)
+ *
+ *  Exits with 1 if any configuration loses, repeats or reorders a slot.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gttcan.h"
+
+#define SIM_NODES 3
+#define SIM_SCHEDULE_LENGTH 24
+#define SIM_SLOT_DURATION 300       // System time units, taken as 1 us
+#define SIM_FRAME_TIME 100          // Bus time of every frame
+#define SIM_TRANSMIT_DELAY 5        // From the transmit callback to the start of the frame
+#define SIM_WARMUP_ROUNDS 10        // Rounds left to start-up and master election
+#define SIM_MAX_EVENTS 64
+
+static global_schedule_entry_t schedule[SIM_SCHEDULE_LENGTH];
+
+typedef struct
+{
+    gttcan_t gttcan;
+    int32_t drift_ppm;
+    bool is_timer_armed;
+    int64_t timer_due;          // Bus time
+    uint32_t frames_sent;
+} sim_node_t;
+
+typedef struct
+{
+    int64_t start;
+    int64_t end;
+    uint32_t frame_id;
+    uint64_t data;
+    int sender;
+} sim_frame_t;
+
+static sim_node_t nodes[SIM_NODES];
+static sim_frame_t bus_queue[SIM_MAX_EVENTS];
+static int bus_queue_length = 0;
+static int64_t bus_free_time = 0;
+
+// Callbacks carry no node, so the node and bus time of the running context are kept here
+static int current_node = 0;
+static int64_t current_time = 0;
+
+// Frame processing in progress, during which expiries of that node preempt it
+static bool is_in_rx = false;
+static int64_t rx_start = 0;
+static int64_t rx_time = 0;
+static bool is_preemptive = true;
+static bool is_verbose = false;
+
+// Slot checking
+static int64_t checked_from = 0;
+static int expected_slot_id = -1;
+static uint32_t slot_errors = 0;
+static uint32_t frames_checked = 0;
+
+static void deliver_due_expiries(int64_t until);
+
+static uint32_t to_local_time(int node, int64_t bus_time)
+{
+    return (uint32_t)(bus_time + (bus_time * nodes[node].drift_ppm) / 1000000);
+}
+
+static int64_t to_bus_duration(int node, uint32_t local_duration)
+{
+    return ((int64_t)local_duration * 1000000) / (1000000 + nodes[node].drift_ppm);
+}
+
+// Let the timer interrupt preempt frame processing at a callback made at bus time point
+static void preempt_at(int64_t point)
+{
+    if (is_in_rx && is_preemptive)
+    {
+        current_time = point;
+        deliver_due_expiries(point);
+    }
+}
+
+static uint32_t sim_get_local_time(void)
+{
+    if (is_in_rx)
+    {
+        preempt_at(rx_start);
+    }
+    return to_local_time(current_node, current_time);
+}
+
+static void sim_set_timer(uint32_t time)
+{
+    if (is_in_rx)
+    {
+        // interrupt_timing_offset is the time from the start of frame processing to the arm
+        preempt_at(rx_start + nodes[current_node].gttcan.interrupt_timing_offset);
+    }
+    sim_node_t *node = &nodes[current_node];
+    node->is_timer_armed = true;
+    node->timer_due = current_time + to_bus_duration(current_node, node->gttcan.interrupt_timing_offset + time);
+}
+
+static void sim_transmit(uint32_t frame_id, uint64_t data)
+{
+    if (bus_queue_length == SIM_MAX_EVENTS)
+    {
+        return;
+    }
+    int64_t start = current_time + SIM_TRANSMIT_DELAY;
+    if (start < bus_free_time)
+    {
+        start = bus_free_time;
+    }
+    bus_free_time = start + SIM_FRAME_TIME;
+    bus_queue[bus_queue_length++] = (sim_frame_t){start, bus_free_time, frame_id, data, current_node};
+    nodes[current_node].frames_sent++;
+}
+
+static uint64_t sim_read_value(uint16_t data_id)
+{
+    return data_id;
+}
+
+static void sim_write_value(uint16_t data_id, uint64_t data)
+{
+    (void)data_id;
+    (void)data;
+    preempt_at(rx_start + rx_time / 2);
+}
+
+// Run every timer expiry of the current node that is due by bus time until, in order
+static void deliver_due_expiries(int64_t until)
+{
+    sim_node_t *node = &nodes[current_node];
+    bool was_in_rx = is_in_rx;
+    int64_t rx_time_now = current_time;
+    while (node->is_timer_armed && node->timer_due <= until)
+    {
+        node->is_timer_armed = false;
+        is_in_rx = false; // The timer interrupt itself runs to completion
+        current_time = is_preemptive ? node->timer_due : until;
+        gttcan_transmit_next_frame(&node->gttcan);
+    }
+    is_in_rx = was_in_rx;
+    current_time = rx_time_now;
+}
+
+static void check_frame(const sim_frame_t *frame)
+{
+    int slot_id = (int)(frame->frame_id >> GTTCAN_NUM_DATA_ID_BITS);
+    if (frame->start < checked_from)
+    {
+        expected_slot_id = (slot_id + 1) % SIM_SCHEDULE_LENGTH;
+        return;
+    }
+
+    frames_checked++;
+    if (slot_id != expected_slot_id)
+    {
+        slot_errors++;
+        if (is_verbose)
+        {
+            printf("    t=%lld: slot %d from node %d, expected slot %d\n",
+                (long long)frame->start, slot_id, frame->sender + 1, expected_slot_id);
+        }
+    }
+    expected_slot_id = (slot_id + 1) % SIM_SCHEDULE_LENGTH;
+}
+
+static void receive_frame(int receiver, const sim_frame_t *frame)
+{
+    current_node = receiver;
+    current_time = frame->end;
+    rx_start = frame->end;
+    is_in_rx = true;
+    gttcan_process_frame(&nodes[receiver].gttcan, frame->frame_id, frame->data);
+    is_in_rx = false;
+
+    // Expiries during the rest of frame processing, or all of them if they had to wait for it
+    current_time = rx_start + rx_time;
+    deliver_due_expiries(rx_start + rx_time);
+}
+
+static void build_schedule(void)
+{
+    for (int slot = 0; slot < SIM_SCHEDULE_LENGTH; slot++)
+    {
+        bool is_reference = (slot % 8) == 0;
+        schedule[slot].slot_id = slot;
+        schedule[slot].node_id = is_reference ? 1 : 1 + (slot % SIM_NODES);
+        schedule[slot].data_id = is_reference ? REFERENCE_FRAME_DATA_ID : GENERIC_DATA_ID + slot;
+    }
+}
+
+static uint32_t run(int rounds, int64_t rx_duration, const int32_t *drifts_ppm, uint32_t interrupt_timing_offset)
+{
+    rx_time = rx_duration;
+    bus_queue_length = 0;
+    bus_free_time = 0;
+    expected_slot_id = -1;
+    slot_errors = 0;
+    frames_checked = 0;
+
+    int64_t round_time = (int64_t)SIM_SCHEDULE_LENGTH * SIM_SLOT_DURATION;
+    int64_t end_time = (SIM_WARMUP_ROUNDS + 2 + (int64_t)rounds) * round_time;
+    checked_from = (SIM_WARMUP_ROUNDS + 2) * round_time;
+
+    for (int n = 0; n < SIM_NODES; n++)
+    {
+        sim_node_t *node = &nodes[n];
+        memset(node, 0, sizeof(*node));
+        node->drift_ppm = drifts_ppm[n];
+        current_node = n;
+        current_time = (int64_t)n * 1000;
+        gttcan_init(&node->gttcan, (uint8_t)(n + 1), schedule, SIM_SCHEDULE_LENGTH, SIM_SLOT_DURATION, interrupt_timing_offset,
+            sim_transmit, sim_set_timer, sim_read_value, sim_write_value, true);
+        gttcan_set_local_time_callback(&node->gttcan, sim_get_local_time);
+        gttcan_start(&node->gttcan);
+    }
+
+    while (true)
+    {
+        int next_node = -1;
+        int64_t next_time = end_time;
+        for (int n = 0; n < SIM_NODES; n++)
+        {
+            if (nodes[n].is_timer_armed && nodes[n].timer_due < next_time)
+            {
+                next_node = n;
+                next_time = nodes[n].timer_due;
+            }
+        }
+        if (bus_queue_length > 0 && bus_queue[0].end <= next_time)
+        {
+            sim_frame_t frame = bus_queue[0];
+            memmove(&bus_queue[0], &bus_queue[1], (size_t)(--bus_queue_length) * sizeof(bus_queue[0]));
+            check_frame(&frame);
+            for (int n = 0; n < SIM_NODES; n++)
+            {
+                if (n != frame.sender)
+                {
+                    receive_frame(n, &frame);
+                }
+            }
+            continue;
+        }
+        if (next_node < 0)
+        {
+            break;
+        }
+
+        current_node = next_node;
+        current_time = next_time;
+        nodes[next_node].is_timer_armed = false;
+        gttcan_transmit_next_frame(&nodes[next_node].gttcan);
+    }
+
+    if (frames_checked < (uint32_t)rounds * SIM_SCHEDULE_LENGTH)
+    {
+        slot_errors += (uint32_t)rounds * SIM_SCHEDULE_LENGTH - frames_checked; // Slots never sent
+    }
+    return slot_errors;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = 200;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0)
+        {
+            is_preemptive = false;
+        }
+        else if (strcmp(argv[i], "-v") == 0)
+        {
+            is_verbose = true;
+        }
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+        {
+            rounds = atoi(argv[++i]);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n] [-v] [-r rounds]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    static const int32_t drift_sets[][SIM_NODES] = {
+        {0, 0, 0},
+        {0, 150, -150},
+        {-300, 200, 50},
+        {400, -400, 0},
+    };
+    static const uint32_t interrupt_timing_offsets[] = {10, 40};
+    static const int64_t rx_durations[] = {40, 120, 200, 240, 280};
+
+    build_schedule();
+    printf("timer interrupt %s frame processing, GTTCAN_ENABLE_PREEMPTIVE_TIMER=%d, %d rounds each\n",
+        is_preemptive ? "preempts" : "waits for", GTTCAN_ENABLE_PREEMPTIVE_TIMER, rounds);
+    printf("%-16s %8s %8s %12s\n", "drift (ppm)", "offset", "rx_time", "slot errors");
+
+    uint32_t total_errors = 0;
+    for (size_t d = 0; d < sizeof(drift_sets) / sizeof(drift_sets[0]); d++)
+    {
+        for (size_t o = 0; o < sizeof(interrupt_timing_offsets) / sizeof(interrupt_timing_offsets[0]); o++)
+        {
+            for (size_t r = 0; r < sizeof(rx_durations) / sizeof(rx_durations[0]); r++)
+            {
+                if (rx_durations[r] < (int64_t)interrupt_timing_offsets[o])
+                {
+                    continue; // The timer is armed within frame processing
+                }
+                uint32_t errors = run(rounds, rx_durations[r], drift_sets[d], interrupt_timing_offsets[o]);
+                char drifts[32];
+                snprintf(drifts, sizeof(drifts), "%d/%d/%d", (int)drift_sets[d][0], (int)drift_sets[d][1], (int)drift_sets[d][2]);
+                printf("%-16s %8u %8lld %12u\n", drifts, (unsigned)interrupt_timing_offsets[o], (long long)rx_durations[r], (unsigned)errors);
+                total_errors += errors;
+            }
+        }
+    }
+
+    printf("%s: %u slot errors\n", total_errors ? "FAIL" : "PASS", (unsigned)total_errors);
+    return total_errors ? 1 : 0;
+}
@@ -0,0 +1,445 @@
+/*
+ * gttcan_replay.c
+ *
+ *  Host tool that feeds a G-TTCAN binary trace (written by gttcan_trace_dump()) or a
+ *  candump log back through gttcan_transmit_next_frame() and gttcan_process_frame(),
+ *  reproducing the protocol state evolution of a node deterministically and much faster
+ *  than real time.
+ *
+ *  Build (from the repository root):
+ *      cc -DGTTCAN_ENABLE_TRACE=1 -Isrc/include -Iexamples -o gttcan_replay tools/gttcan_replay.c src/gttcan.c
+ *  Use the same G-TTCAN configuration macros (schedule size, identifier mode, slot lengths)
+ *  as the traced node, and -DGTTCAN_REPLAY_SCHEDULE='"my_schedule.h"' for another schedule.
+ *
+ *  Usage:
+ *      gttcan_replay [-v] trace.bin
+ *          Replays a binary trace and checks that every traced event (frames sent, timer
+ *          re-arms, slot_duration changes, master decisions) is reproduced exactly.
+ *      gttcan_replay -c [-v] [-n node_id] [-s slot_duration] [-o interrupt_timing_offset] [-j] [-d] candump.log
+ *          Feeds the frames of a candump log (timestamps taken as microseconds) to a simulated
+ *          node and prints the resulting protocol events.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gttcan.h"
+
+#ifndef GTTCAN_REPLAY_SCHEDULE
+#define GTTCAN_REPLAY_SCHEDULE "global_schedule.h"
+#endif
+#include GTTCAN_REPLAY_SCHEDULE
+
+#if !GTTCAN_ENABLE_TRACE
+#error "gttcan_replay must be built with GTTCAN_ENABLE_TRACE=1"
+#endif
+
+gttcan_t gttcan;              // Replayed node
+uint32_t replay_time = 0;     // Local time of the event being replayed
+bool timer_armed = false;     // Candump mode: simulated timer state
+uint32_t timer_deadline = 0;
+bool verbose = false;
+
+// G-TTCAN callbacks for the replayed node
+void replay_transmit_frame(uint32_t can_frame_id, uint64_t data) { (void)can_frame_id; (void)data; }
+void replay_set_timer_int(uint32_t time) { timer_armed = true; timer_deadline = replay_time + time; }
+uint64_t replay_read_value(uint16_t data_id) { (void)data_id; return 0; }
+void replay_write_value(uint16_t data_id, uint64_t value) { (void)data_id; (void)value; }
+uint32_t replay_get_local_time(void) { return replay_time; }
+void replay_slot_hook(uint16_t slot_id, uint16_t data_id) { (void)slot_id; (void)data_id; }
+
+static const char *trace_type_name(uint8_t type)
+{
+    switch (type)
+    {
+        case GTTCAN_TRACE_START: return "start";
+        case GTTCAN_TRACE_TIMER_EXPIRED: return "timer";
+        case GTTCAN_TRACE_FRAME_SENT: return "tx";
+        case GTTCAN_TRACE_FRAME_RECEIVED: return "rx";
+        case GTTCAN_TRACE_TIMER_SET: return "arm";
+        case GTTCAN_TRACE_SLOT_DURATION: return "slot_duration";
+        case GTTCAN_TRACE_MASTER_DECISION: return "master";
+        case GTTCAN_TRACE_PRE_SLOT: return "pre_slot";
+        case GTTCAN_TRACE_ERROR: return "error";
+        default: return "unknown";
+    }
+}
+
+static void print_record(const char *prefix, const gttcan_trace_record_t *record)
+{
+    printf("%s%10lu %-13s %08lx %016llx\n", prefix, (unsigned long)record->timestamp, trace_type_name(record->type),
+           (unsigned long)record->arg, (unsigned long long)record->data);
+}
+
+static uint32_t read_le(const uint8_t *bytes, int length)
+{
+    uint32_t value = 0;
+    for (int i = length - 1; i >= 0; i--)
+    {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+// Whether a frame identifier belongs to a reference frame slot of the replay schedule
+static bool is_reference_frame(uint32_t can_frame_id)
+{
+#if GTTCAN_USE_STANDARD_FRAME_ID
+    uint16_t slot_id = can_frame_id & GTTCAN_STANDARD_FRAME_ID_MASK;
+    for (int i = 0; i < gttcan.global_schedule_length; i++)
+    {
+        if (global_schedule[i].slot_id == slot_id)
+        {
+            return global_schedule[i].data_id == REFERENCE_FRAME_DATA_ID;
+        }
+    }
+    return false;
+#else
+    return (can_frame_id & GTTCAN_DATA_ID_MASK) == REFERENCE_FRAME_DATA_ID;
+#endif
+}
+
+// Events that are calls into G-TTCAN, everything else is recorded output
+static bool is_input_event(const gttcan_trace_record_t *record)
+{
+    return record->type == GTTCAN_TRACE_START || record->type == GTTCAN_TRACE_TIMER_EXPIRED ||
+           record->type == GTTCAN_TRACE_PRE_SLOT || record->type == GTTCAN_TRACE_FRAME_RECEIVED ||
+           record->type == GTTCAN_TRACE_ERROR;
+}
+
+static bool records_match(const gttcan_trace_record_t *recorded, const gttcan_trace_record_t *replayed)
+{
+    if (recorded->type != replayed->type || recorded->arg != replayed->arg || recorded->timestamp != replayed->timestamp)
+    {
+        return false;
+    }
+    // Data frame payloads come from the application, only compare what G-TTCAN builds itself
+    if (recorded->type == GTTCAN_TRACE_FRAME_SENT && !is_reference_frame(recorded->arg))
+    {
+        return true;
+    }
+    return recorded->data == replayed->data;
+}
+
+static int replay_trace(FILE *file)
+{
+    uint8_t header[GTTCAN_TRACE_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, GTTCAN_TRACE_MAGIC, 4) != 0)
+    {
+        fprintf(stderr, "not a G-TTCAN trace\n");
+        return 2;
+    }
+    if (header[4] != GTTCAN_TRACE_FORMAT_VERSION)
+    {
+        fprintf(stderr, "unsupported trace format version %u\n", header[4]);
+        return 2;
+    }
+
+    uint8_t node_id = header[5];
+    uint16_t global_schedule_length = (uint16_t)read_le(&header[6], 2);
+    uint32_t slot_duration = read_le(&header[8], 4);
+    uint32_t interrupt_timing_offset = read_le(&header[12], 4);
+    uint32_t flags = read_le(&header[16], 4);
+    uint32_t record_count = read_le(&header[20], 4);
+
+    if (global_schedule_length > MAX_GLOBAL_SCHEDULE_LENGTH)
+    {
+        fprintf(stderr, "trace uses a %u slot schedule, replay schedule holds %u\n", global_schedule_length, MAX_GLOBAL_SCHEDULE_LENGTH);
+        return 2;
+    }
+
+    gttcan_trace_record_t *records = calloc(record_count ? record_count : 1, sizeof(gttcan_trace_record_t));
+    for (uint32_t i = 0; i < record_count; i++)
+    {
+        uint8_t bytes[GTTCAN_TRACE_RECORD_SIZE];
+        if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes))
+        {
+            fprintf(stderr, "trace truncated after %lu records\n", (unsigned long)i);
+            record_count = i;
+            break;
+        }
+        records[i].timestamp = read_le(&bytes[0], 4);
+        records[i].type = bytes[4];
+        records[i].arg = read_le(&bytes[5], 4);
+        records[i].data = (uint64_t)read_le(&bytes[9], 4) | ((uint64_t)read_le(&bytes[13], 4) << 32);
+    }
+
+    // slot_duration in the header is the value at dump time, each start record carries the value at start
+    gttcan_init(&gttcan, node_id, global_schedule, global_schedule_length, slot_duration, interrupt_timing_offset,
+                replay_transmit_frame, replay_set_timer_int, replay_read_value, replay_write_value,
+                (flags & GTTCAN_TRACE_FLAG_DYNAMIC_SLOT_DURATION_CORRECTION) != 0);
+
+    bool has_local_time = false;
+    for (uint32_t i = 0; i < record_count && !has_local_time; i++)
+    {
+        has_local_time = records[i].timestamp != 0;
+    }
+    if (has_local_time)
+    {
+        replay_time = record_count ? records[0].timestamp : 0;
+        gttcan_set_local_time_callback(&gttcan, replay_get_local_time);
+    }
+
+    // Early timer expiries for a pre-slot hook only happen with a hook registered
+    for (uint32_t i = 0; i < record_count; i++)
+    {
+        if (records[i].type == GTTCAN_TRACE_PRE_SLOT)
+        {
+            gttcan_set_slot_hooks(&gttcan, replay_slot_hook, (uint32_t)records[i].data, NULL);
+            break;
+        }
+    }
+
+    if (flags & GTTCAN_TRACE_FLAG_WRAPPED)
+    {
+        printf("trace wrapped, replaying from a fresh state: early events may differ\n");
+    }
+
+    uint32_t position = 0;
+    uint32_t mismatches = 0;
+    uint32_t first_mismatch = 0;
+    while (position < record_count)
+    {
+        const gttcan_trace_record_t *input = &records[position];
+        uint32_t count_before = gttcan.trace_count;
+        replay_time = input->timestamp;
+
+        switch (input->type)
+        {
+            case GTTCAN_TRACE_START:
+                gttcan.slot_duration = (uint32_t)input->data;
+                if (input->arg)
+                {
+                    gttcan_join(&gttcan);
+                }
+                else
+                {
+                    gttcan_start(&gttcan);
+                }
+                break;
+            case GTTCAN_TRACE_TIMER_EXPIRED:
+            case GTTCAN_TRACE_PRE_SLOT:
+                gttcan_transmit_next_frame(&gttcan);
+                break;
+            case GTTCAN_TRACE_FRAME_RECEIVED:
+                gttcan_process_frame(&gttcan, input->arg, input->data);
+                break;
+            case GTTCAN_TRACE_ERROR:
+                gttcan_report_error(&gttcan, (gttcan_error_t)input->arg);
+                break;
+            default:
+                // An output event without its input, i.e. the start of a wrapped trace
+                if (verbose)
+                {
+                    print_record("skip ", input);
+                }
+                position++;
+                continue;
+        }
+
+        // Compare everything the replayed call produced with what the node recorded
+        for (uint32_t k = count_before; k != gttcan.trace_count; k++)
+        {
+            const gttcan_trace_record_t *replayed = &gttcan.trace[k & (GTTCAN_TRACE_LENGTH - 1)];
+            const gttcan_trace_record_t *recorded = (position < record_count) ? &records[position] : NULL;
+
+            if (recorded == NULL || !records_match(recorded, replayed))
+            {
+                if (mismatches == 0)
+                {
+                    first_mismatch = position;
+                }
+                mismatches++;
+                if (verbose)
+                {
+                    if (recorded != NULL)
+                    {
+                        print_record("want ", recorded);
+                    }
+                    print_record("got  ", replayed);
+                }
+                // Resynchronise on the next input event of the recording
+                if (k == count_before)
+                {
+                    position++;
+                }
+                while (position < record_count && !is_input_event(&records[position]))
+                {
+                    position++;
+                }
+                break;
+            }
+
+            if (verbose)
+            {
+                print_record("", replayed);
+            }
+            position++;
+        }
+
+        // Skip recorded output events the replay did not produce
+        while (position < record_count && !is_input_event(&records[position]))
+        {
+            if (mismatches == 0)
+            {
+                first_mismatch = position;
+            }
+            mismatches++;
+            position++;
+        }
+    }
+
+    printf("replayed %lu records, %lu mismatches", (unsigned long)record_count, (unsigned long)mismatches);
+    if (mismatches)
+    {
+        printf(" (first at record %lu)", (unsigned long)first_mismatch);
+    }
+    printf(", final slot_duration %lu, time master %s\n", (unsigned long)gttcan.slot_duration, gttcan.is_time_master ? "yes" : "no");
+
+    free(records);
+    return mismatches ? 1 : 0;
+}
+
+static void print_new_records(uint32_t count_before)
+{
+    for (uint32_t k = count_before; k != gttcan.trace_count; k++)
+    {
+        print_record("", &gttcan.trace[k & (GTTCAN_TRACE_LENGTH - 1)]);
+    }
+}
+
+static int replay_candump(FILE *file, uint8_t node_id, uint32_t slot_duration, uint32_t interrupt_timing_offset,
+                          bool join, bool dynamic_slot_duration_correction)
+{
+    gttcan_init(&gttcan, node_id, global_schedule, MAX_GLOBAL_SCHEDULE_LENGTH, slot_duration, interrupt_timing_offset,
+                replay_transmit_frame, replay_set_timer_int, replay_read_value, replay_write_value,
+                dynamic_slot_duration_correction);
+    gttcan_set_local_time_callback(&gttcan, replay_get_local_time);
+
+    char line[256];
+    bool started = false;
+    unsigned long long first_time_us = 0;
+    unsigned long frames = 0;
+    uint32_t count_before;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        // Format: (seconds.microseconds) interface ID#DATA
+        unsigned long seconds, microseconds;
+        char interface[32], frame[64];
+        if (sscanf(line, " (%lu.%lu) %31s %63s", &seconds, &microseconds, interface, frame) != 4)
+        {
+            continue;
+        }
+        char *separator = strchr(frame, '#');
+        if (separator == NULL)
+        {
+            continue;
+        }
+        *separator = '\0';
+        size_t id_length = strlen(frame);
+        uint32_t can_frame_id = (uint32_t)strtoul(frame, NULL, 16);
+#if GTTCAN_USE_STANDARD_FRAME_ID
+        if (id_length != 3)
+        {
+            continue;
+        }
+#else
+        if (id_length != 8)
+        {
+            continue;
+        }
+#endif
+
+        // Payload bytes in bus order, assembled as on a little-endian node
+        uint64_t data = 0;
+        const char *hex = separator + 1;
+        for (int byte = 0; byte < 8 && hex[0] && hex[1]; byte++, hex += 2)
+        {
+            char pair[3] = {hex[0], hex[1], '\0'};
+            data |= (uint64_t)strtoul(pair, NULL, 16) << (8 * byte);
+        }
+
+        unsigned long long time_us = (unsigned long long)seconds * 1000000ULL + microseconds;
+        if (!started)
+        {
+            first_time_us = time_us;
+            replay_time = 0;
+            count_before = gttcan.trace_count;
+            if (join)
+            {
+                gttcan_join(&gttcan);
+            }
+            else
+            {
+                gttcan_start(&gttcan);
+            }
+            print_new_records(count_before);
+            started = true;
+        }
+        uint32_t frame_time = (uint32_t)(time_us - first_time_us);
+
+        // Fire every timer expiry due before this frame
+        while (timer_armed && (int32_t)(timer_deadline - frame_time) <= 0)
+        {
+            timer_armed = false;
+            replay_time = timer_deadline;
+            count_before = gttcan.trace_count;
+            gttcan_transmit_next_frame(&gttcan);
+            print_new_records(count_before);
+        }
+
+        replay_time = frame_time;
+        count_before = gttcan.trace_count;
+        gttcan_process_frame(&gttcan, can_frame_id, data);
+        print_new_records(count_before);
+        frames++;
+    }
+
+    printf("replayed %lu frames, final slot_duration %lu, time master %s\n", frames, (unsigned long)gttcan.slot_duration,
+           gttcan.is_time_master ? "yes" : "no");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool candump = false;
+    bool join = false;
+    bool dynamic_slot_duration_correction = false;
+    uint8_t node_id = 1;
+    uint32_t slot_duration = 300;
+    uint32_t interrupt_timing_offset = 7;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0) candump = true;
+        else if (strcmp(argv[i], "-v") == 0) verbose = true;
+        else if (strcmp(argv[i], "-j") == 0) join = true;
+        else if (strcmp(argv[i], "-d") == 0) dynamic_slot_duration_correction = true;
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) node_id = (uint8_t)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) slot_duration = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) interrupt_timing_offset = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else path = argv[i];
+    }
+
+    if (path == NULL)
+    {
+        fprintf(stderr, "usage: %s [-v] trace.bin\n"
+                        "       %s -c [-v] [-n node_id] [-s slot_duration] [-o interrupt_timing_offset] [-j] [-d] candump.log\n",
+                argv[0], argv[0]);
+        return 2;
+    }
+
+    FILE *file = fopen(path, candump ? "r" : "rb");
+    if (file == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+
+    int result = candump ? replay_candump(file, node_id, slot_duration, interrupt_timing_offset, join, dynamic_slot_duration_correction)
+                         : replay_trace(file);
+    fclose(file);
+    return result;
+}
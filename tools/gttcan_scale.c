@@ -0,0 +1,665 @@
+/*
+ * gttcan_scale.c
+ *
+ *  Host simulation of G-TTCAN networks of 2 to 255 nodes and 16 to 8192 slots, with varied
+ *  reference frame density and crystal tolerance, that measures how the network converges
+ *  and recovers as it grows. Every scenario is fixed and seeded, so its results are the same
+ *  on every machine and every run, and only change when the protocol does.
+ *
+ *  For each scenario all nodes power up together on one bus, run for a number of rounds, and
+ *  then the time master is removed and the rest run on. It reports:
+ *      lock      Rounds from power-up until every slot is sent, in order, by its owner and
+ *                inside the slot where the last reference frame puts it, for good
+ *      error     Largest and mean distance in time units of a frame from where the last
+ *                reference frame puts it, over the second half of the rounds before the failure
+ *      idle      Fraction of the bus left idle over the same rounds
+ *  Frames take their worst-case bit time at 1 Mbit/s from gttcan_get_frame_bits(), and each
+ *  scenario sizes its slots with gttcan_configure_timing() for its clock tolerance and reference
+ *  frame density. Where clocks can drift a whole slot between reference frames no slot length
+ *  is safe, so those scenarios are sized without drift and show what the protocol does about it.
+ *      failover  Rounds from removing the time master until the network is locked again
+ *  A scenario that never locks is shown as "never".
+ *
+ *  Build (from the repository root):
+ *      cc -O2 -DMAX_GLOBAL_SCHEDULE_LENGTH=8192 -DGTTCAN_MAX_LOCAL_SCHEDULE_LENGTH=8192 -Isrc/include \
+ *          -o gttcan_scale tools/gttcan_scale.c src/gttcan.c
+ *  Schedule lengths above MAX_GLOBAL_SCHEDULE_LENGTH are skipped.
+ *
+ *  Usage:
+ *      gttcan_scale [-r rounds] [-w baseline.txt] [-b baseline.txt] [-t tolerance_percent]
+ *          -r  Rounds before the time master is removed (default 40), half as many after it
+ *          -w  Save the results as a baseline
+ *          -b  Compare against a saved baseline, flagging any result that got worse by more
+ *              than the tolerance (default 10%), exits with 1 on regression
+ *
+ *  tools/gttcan_scale_baseline.txt holds the results of the default build and rounds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gttcan.h"
+
+#if GTTCAN_ENABLE_COMPRESSED_SCHEDULE
+#error "gttcan_scale builds its global schedules slot by slot"
+#endif
+
+#define SIM_TIMER_FREQUENCY 1000000 // System time units per second, so a unit is 1 us
+#define SIM_BIT_RATE 1000000
+#define SIM_TRANSMIT_DELAY 5        // From the transmit callback to the request for the bus
+#define SIM_INTERRUPT_TIMING_OFFSET 10
+#define SIM_MAX_PENDING 512
+#define SIM_NEVER (-1)
+#define SCALE_MAX_RESULTS 64
+
+typedef struct
+{
+    uint16_t node_count;
+    uint16_t slot_count;
+    uint16_t reference_interval;    // Slots between reference frames
+    uint16_t tolerance_ppm;         // Node clocks are drawn from +-tolerance_ppm
+} scale_scenario_t;
+
+static const scale_scenario_t scenarios[] = {
+    {2, 16, 16, 50},
+    {8, 64, 64, 50},
+    {8, 64, 16, 50},
+    {8, 256, 256, 0},
+    {8, 256, 256, 200},
+    {8, 256, 256, 500},
+    {32, 256, 256, 100},
+    {32, 256, 32, 100},
+    {64, 1024, 1024, 100},
+    {64, 1024, 64, 100},
+    {128, 2048, 2048, 100},
+    {128, 2048, 128, 100},
+    {255, 512, 512, 100},
+    {255, 512, 64, 100},
+    {255, 4096, 4096, 100},
+    {255, 8192, 8192, 100},
+    {255, 8192, 256, 100},
+    {16, 8192, 8192, 200},
+    {16, 8192, 512, 200},
+};
+
+typedef enum
+{
+    METRIC_LOCK,        // Tenths of a round, or SIM_NEVER
+    METRIC_ERROR_MAX,   // Time units
+    METRIC_ERROR_MEAN,  // Tenths of a time unit
+    METRIC_IDLE,        // Tenths of a percent
+    METRIC_FAILOVER,    // Tenths of a round, or SIM_NEVER
+    METRIC_COUNT
+} scale_metric_t;
+
+static const char *metric_names[METRIC_COUNT] = {"lock", "error_max", "error_mean", "idle", "failover"};
+
+typedef struct
+{
+    char name[32];
+    int32_t metrics[METRIC_COUNT];
+} scale_result_t;
+
+typedef struct
+{
+    gttcan_t gttcan;
+    int32_t drift_ppm;
+    bool is_timer_armed;
+    bool is_failed;
+    int64_t timer_due;          // Bus time
+} sim_node_t;
+
+typedef struct
+{
+    int64_t request;
+    int64_t start;
+    int64_t end;
+    int64_t duration;           // Bus time of the frame, with worst-case bit stuffing
+    uint32_t frame_id;
+    uint64_t data;
+    int sender;
+} sim_frame_t;
+
+static global_schedule_entry_t schedule[MAX_GLOBAL_SCHEDULE_LENGTH];
+static uint16_t schedule_length = 0;
+static sim_node_t *nodes = NULL;
+static int node_count = 0;
+static scale_result_t results[SCALE_MAX_RESULTS];
+static int result_count = 0;
+
+// Timing of the running scenario, from gttcan_configure_timing()
+static uint32_t slot_duration = 0;
+static int64_t lock_error = 0;     // Largest error that keeps the longest frame in its slot
+
+// The bus: frames waiting for arbitration and the one being sent
+static sim_frame_t pending[SIM_MAX_PENDING];
+static int pending_count = 0;
+static sim_frame_t in_flight;
+static bool is_bus_busy = false;
+static int64_t bus_free_time = 0;
+
+// Callbacks carry no node, so the node and bus time of the running context are kept here
+static int current_node = 0;
+static int64_t current_time = 0;
+
+// Frame checking
+static bool has_reference = false;
+static int64_t reference_start = 0;
+static int64_t reference_end = 0;
+static uint16_t reference_slot_id = 0;
+static int reference_sender = 0;
+static int expected_slot_id = -1;
+static int64_t phase_start = 0;
+static int64_t good_since = SIM_NEVER;
+static int64_t last_frame_start = 0;
+
+// Steady state statistics
+static int64_t steady_from = 0;
+static int64_t steady_until = 0;
+static int64_t busy_time = 0;
+static int64_t error_sum = 0;
+static int64_t error_max = 0;
+static int64_t error_count = 0;
+
+static uint32_t to_local_time(int node, int64_t bus_time)
+{
+    return (uint32_t)(bus_time + (bus_time * nodes[node].drift_ppm) / 1000000);
+}
+
+static int64_t to_bus_duration(int node, uint32_t local_duration)
+{
+    return ((int64_t)local_duration * 1000000) / (1000000 + nodes[node].drift_ppm);
+}
+
+static uint32_t sim_get_local_time(void)
+{
+    return to_local_time(current_node, current_time);
+}
+
+static void sim_set_timer(uint32_t time)
+{
+    // The timer is armed interrupt_timing_offset after the event, which G-TTCAN has taken off
+    sim_node_t *node = &nodes[current_node];
+    node->is_timer_armed = true;
+    node->timer_due = current_time + to_bus_duration(current_node, node->gttcan.interrupt_timing_offset + time);
+}
+
+static void sim_transmit(uint32_t frame_id, uint64_t data)
+{
+    if (pending_count == SIM_MAX_PENDING)
+    {
+        return;
+    }
+    int64_t duration = (int64_t)gttcan_get_frame_bits(gttcan_get_transmit_dlc(&nodes[current_node].gttcan)) *
+                       SIM_TIMER_FREQUENCY / SIM_BIT_RATE;
+    pending[pending_count++] = (sim_frame_t){current_time + SIM_TRANSMIT_DELAY, 0, 0, duration, frame_id, data, current_node};
+}
+
+static uint64_t sim_read_value(uint16_t data_id)
+{
+    return data_id;
+}
+
+static void sim_write_value(uint16_t data_id, uint64_t data)
+{
+    (void)data_id;
+    (void)data;
+}
+
+static uint32_t next_random(uint32_t *state)
+{
+    // xorshift32, the same sequence on every host
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static bool build_schedule(const scale_scenario_t *scenario)
+{
+    uint16_t data_slot = 0;
+    for (uint16_t slot = 0; slot < scenario->slot_count; slot++)
+    {
+        bool is_reference = (slot % scenario->reference_interval) == 0;
+        schedule[slot].slot_id = slot;
+        schedule[slot].node_id = is_reference ? 1 : (uint8_t)(1 + (data_slot++ % scenario->node_count));
+        schedule[slot].data_id = is_reference ? REFERENCE_FRAME_DATA_ID : GENERIC_DATA_ID;
+    }
+    schedule_length = scenario->slot_count;
+    return data_slot >= scenario->node_count; // Every node needs a slot of its own
+}
+
+static uint16_t get_next_expected_slot_id(uint16_t slot_id)
+{
+    for (uint16_t i = 1; i <= schedule_length; i++)
+    {
+        const global_schedule_entry_t *entry = &schedule[(slot_id + i) % schedule_length];
+        if (entry->data_id == REFERENCE_FRAME_DATA_ID || !nodes[entry->node_id - 1].is_failed)
+        {
+            return entry->slot_id;
+        }
+    }
+    return slot_id;
+}
+
+// Judge a frame against the last reference frame, and track how long the network has been locked
+static void check_frame(const sim_frame_t *frame)
+{
+    uint16_t slot_id = (uint16_t)(frame->frame_id >> GTTCAN_NUM_DATA_ID_BITS);
+    bool is_reference = (frame->frame_id & GTTCAN_DATA_ID_MASK) == REFERENCE_FRAME_DATA_ID;
+    bool is_good = slot_id < schedule_length && slot_id == expected_slot_id &&
+                   (is_reference || schedule[slot_id].node_id == frame->sender + 1);
+
+    if (has_reference && slot_id < schedule_length)
+    {
+        // Receivers time their slots from the end of the reference frame, its sender from its own timer
+        gttcan_t *master = &nodes[reference_sender].gttcan;
+        int64_t anchor = (frame->sender == reference_sender) ? reference_start : reference_end + SIM_TRANSMIT_DELAY;
+        int64_t expected_start = anchor +
+                                 to_bus_duration(reference_sender, gttcan_get_time_between_slots(master, reference_slot_id, slot_id));
+        int64_t round_time = to_bus_duration(reference_sender, gttcan_get_time_between_slots(master, 0, 0));
+        int64_t error = (frame->start - expected_start) % round_time; // Phase within the round
+        error = error < 0 ? -error : error;
+        error = error > round_time / 2 ? round_time - error : error;
+        if (frame->start - reference_start > round_time + slot_duration)
+        {
+            is_good = false; // No reference frame for over a round, so nothing to be locked to
+        }
+        else
+        {
+            is_good = is_good && error <= lock_error;
+            if (frame->start >= steady_from && frame->start < steady_until)
+            {
+                error_sum += error;
+                error_count++;
+                error_max = error > error_max ? error : error_max;
+            }
+        }
+    }
+    else
+    {
+        is_good = false;
+    }
+
+    if (is_reference)
+    {
+        has_reference = true;
+        reference_start = frame->start;
+        reference_end = frame->end;
+        reference_slot_id = slot_id;
+        reference_sender = frame->sender;
+    }
+    expected_slot_id = slot_id < schedule_length ? get_next_expected_slot_id(slot_id) : -1;
+
+    if (frame->start >= steady_from && frame->start < steady_until)
+    {
+        busy_time += (frame->end < steady_until ? frame->end : steady_until) - frame->start;
+    }
+    if (frame->start >= phase_start)
+    {
+        last_frame_start = frame->start;
+        if (!is_good)
+        {
+            good_since = SIM_NEVER;
+        }
+        else if (good_since == SIM_NEVER)
+        {
+            good_since = frame->start;
+        }
+    }
+}
+
+// Tenths of a round from phase_start until the network locked for good, or SIM_NEVER
+static int32_t get_lock_rounds(int64_t phase_end, int64_t round_time)
+{
+    if (good_since == SIM_NEVER || phase_end - good_since < round_time || last_frame_start < phase_end - round_time)
+    {
+        return SIM_NEVER;
+    }
+    return (int32_t)(((good_since - phase_start) * 10 + round_time / 2) / round_time);
+}
+
+// When the bus next starts a frame, once it is free and a frame is waiting
+static int64_t get_next_frame_start(void)
+{
+    int64_t start = INT64_MAX;
+    for (int i = 0; i < pending_count; i++)
+    {
+        start = pending[i].request < start ? pending[i].request : start;
+    }
+    return start < bus_free_time ? bus_free_time : start;
+}
+
+static void start_next_frame(void)
+{
+    int64_t start = get_next_frame_start();
+
+    // Arbitration: the lowest identifier among the frames waiting by then wins
+    int winner = -1;
+    for (int i = 0; i < pending_count; i++)
+    {
+        if (pending[i].request <= start && (winner < 0 || pending[i].frame_id < pending[winner].frame_id))
+        {
+            winner = i;
+        }
+    }
+    in_flight = pending[winner];
+    in_flight.start = start;
+    in_flight.end = start + in_flight.duration;
+    pending[winner] = pending[--pending_count];
+    is_bus_busy = true;
+}
+
+static void finish_frame(void)
+{
+    is_bus_busy = false;
+    bus_free_time = in_flight.end;
+    check_frame(&in_flight);
+    for (int n = 0; n < node_count; n++)
+    {
+        if (n != in_flight.sender && !nodes[n].is_failed)
+        {
+            current_node = n;
+            current_time = in_flight.end;
+            gttcan_process_frame(&nodes[n].gttcan, in_flight.frame_id, in_flight.data);
+        }
+    }
+}
+
+// Remove the time master, with anything it has not yet put on the bus
+static void fail_master(void)
+{
+    int master = has_reference ? reference_sender : 0;
+    nodes[master].is_failed = true;
+    nodes[master].is_timer_armed = false;
+    for (int i = 0; i < pending_count; i++)
+    {
+        if (pending[i].sender == master)
+        {
+            pending[i--] = pending[--pending_count];
+        }
+    }
+    if (expected_slot_id >= 0 && schedule[expected_slot_id].data_id != REFERENCE_FRAME_DATA_ID &&
+        schedule[expected_slot_id].node_id == master + 1)
+    {
+        expected_slot_id = get_next_expected_slot_id((uint16_t)expected_slot_id);
+    }
+}
+
+static void run_until(int64_t end_time)
+{
+    while (true)
+    {
+        int next_node = -1;
+        int64_t next_time = end_time;
+        for (int n = 0; n < node_count; n++)
+        {
+            if (nodes[n].is_timer_armed && nodes[n].timer_due < next_time)
+            {
+                next_node = n;
+                next_time = nodes[n].timer_due;
+            }
+        }
+
+        if (is_bus_busy && in_flight.end <= next_time)
+        {
+            finish_frame();
+            continue;
+        }
+        if (!is_bus_busy && pending_count > 0)
+        {
+            if (get_next_frame_start() < next_time)
+            {
+                start_next_frame();
+                continue;
+            }
+        }
+        if (next_node < 0)
+        {
+            break;
+        }
+
+        current_node = next_node;
+        current_time = next_time;
+        nodes[next_node].is_timer_armed = false;
+        gttcan_transmit_next_frame(&nodes[next_node].gttcan);
+    }
+}
+
+static void run_scenario(const scale_scenario_t *scenario, int rounds)
+{
+    if (result_count == SCALE_MAX_RESULTS)
+    {
+        return;
+    }
+    scale_result_t *result = &results[result_count++];
+    snprintf(result->name, sizeof(result->name), "n%u_s%u_r%u_p%u", scenario->node_count, scenario->slot_count,
+             scenario->reference_interval, scenario->tolerance_ppm);
+
+    node_count = scenario->node_count;
+    nodes = calloc((size_t)node_count, sizeof(sim_node_t));
+    if (nodes == NULL)
+    {
+        perror("calloc");
+        exit(2);
+    }
+
+    pending_count = 0;
+    is_bus_busy = false;
+    bus_free_time = 0;
+    has_reference = false;
+    expected_slot_id = -1;
+    good_since = SIM_NEVER;
+    last_frame_start = 0;
+    phase_start = 0;
+    busy_time = error_sum = error_max = error_count = 0;
+
+    // Seeded from the scenario itself, so adding scenarios leaves the others unchanged
+    uint32_t seed = 0x9E3779B9u ^ ((uint32_t)scenario->node_count << 24) ^ ((uint32_t)scenario->slot_count << 8) ^
+                    ((uint32_t)scenario->reference_interval * 2654435761u) ^ scenario->tolerance_ppm;
+    // The bus as gttcan_configure_timing() sees it: frames are asked for SIM_TRANSMIT_DELAY after the
+    // timer, seen by the receivers as they end, and the timer is loaded SIM_INTERRUPT_TIMING_OFFSET later
+    gttcan_timing_params_t params = {SIM_BIT_RATE, SIM_TIMER_FREQUENCY, scenario->tolerance_ppm,
+                                     SIM_TRANSMIT_DELAY, SIM_TRANSMIT_DELAY, 0, 0,
+                                     SIM_INTERRUPT_TIMING_OFFSET, SIM_INTERRUPT_TIMING_OFFSET};
+    gttcan_timing_t timing;
+    for (int n = 0; n < node_count; n++)
+    {
+        sim_node_t *node = &nodes[n];
+        node->drift_ppm = (int32_t)(next_random(&seed) % (2u * scenario->tolerance_ppm + 1u)) - scenario->tolerance_ppm;
+        current_node = n;
+        current_time = 0;
+        gttcan_init(&node->gttcan, (uint8_t)(n + 1), schedule, schedule_length, 0, 0, sim_transmit, sim_set_timer,
+                    sim_read_value, sim_write_value, true);
+        if (!gttcan_configure_timing(&node->gttcan, &params, &timing))
+        {
+            // No slot is long enough for the drift between these reference frames, so leave it uncovered
+            params.clock_tolerance_ppm = 0;
+            gttcan_configure_timing(&node->gttcan, &params, &timing);
+        }
+        gttcan_set_local_time_callback(&node->gttcan, sim_get_local_time);
+        gttcan_start(&node->gttcan);
+    }
+    slot_duration = timing.slot_duration;
+    lock_error = (int64_t)timing.slot_duration - timing.longest_frame_time;
+
+    int64_t round_time = (int64_t)scenario->slot_count * slot_duration;
+    int64_t fail_time = (int64_t)rounds * round_time;
+    int64_t end_time = fail_time + (int64_t)(rounds / 2) * round_time;
+    steady_from = fail_time / 2;
+    steady_until = fail_time;
+
+    run_until(fail_time);
+    result->metrics[METRIC_LOCK] = get_lock_rounds(fail_time, round_time);
+    result->metrics[METRIC_ERROR_MAX] = error_count ? (int32_t)error_max : SIM_NEVER;
+    result->metrics[METRIC_ERROR_MEAN] = error_count ? (int32_t)((error_sum * 10 + error_count / 2) / error_count) : SIM_NEVER;
+    result->metrics[METRIC_IDLE] = (int32_t)(((fail_time - steady_from - busy_time) * 1000 + (fail_time - steady_from) / 2) /
+                                             (fail_time - steady_from));
+
+    fail_master();
+    phase_start = fail_time;
+    good_since = SIM_NEVER;
+    run_until(end_time);
+    result->metrics[METRIC_FAILOVER] = get_lock_rounds(end_time, round_time);
+
+    free(nodes);
+    nodes = NULL;
+}
+
+static void format_metric(char *text, size_t size, scale_metric_t metric, int32_t value)
+{
+    if (value == SIM_NEVER)
+    {
+        snprintf(text, size, "never");
+    }
+    else if (metric == METRIC_ERROR_MAX)
+    {
+        snprintf(text, size, "%d", (int)value);
+    }
+    else
+    {
+        snprintf(text, size, "%d.%d", (int)(value / 10), (int)(value % 10));
+    }
+}
+
+static void print_result(const scale_result_t *result)
+{
+    printf("%-24s", result->name);
+    for (int m = 0; m < METRIC_COUNT; m++)
+    {
+        char text[16];
+        format_metric(text, sizeof(text), (scale_metric_t)m, result->metrics[m]);
+        printf(" %10s", text);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static int save_baseline(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    if (file == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+    fprintf(file, "# gttcan_scale baseline: name lock error_max error_mean idle failover (tenths except error_max, -1 is never)\n");
+    for (int i = 0; i < result_count; i++)
+    {
+        fprintf(file, "%s", results[i].name);
+        for (int m = 0; m < METRIC_COUNT; m++)
+        {
+            fprintf(file, " %d", (int)results[i].metrics[m]);
+        }
+        fprintf(file, "\n");
+    }
+    fclose(file);
+    printf("baseline saved to %s\n", path);
+    return 0;
+}
+
+static int compare_baseline(const char *path, unsigned tolerance_percent)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        perror(path);
+        return 2;
+    }
+
+    char line[256];
+    int compared = 0, regressions = 0;
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[32];
+        int baseline[METRIC_COUNT];
+        if (line[0] == '#' || sscanf(line, "%31s %d %d %d %d %d", name, &baseline[0], &baseline[1], &baseline[2],
+                                     &baseline[3], &baseline[4]) != 1 + METRIC_COUNT)
+        {
+            continue;
+        }
+        for (int i = 0; i < result_count; i++)
+        {
+            if (strcmp(results[i].name, name) != 0)
+            {
+                continue;
+            }
+            compared++;
+            // Every metric is better lower, and never is worse than any value
+            for (int m = 0; m < METRIC_COUNT; m++)
+            {
+                int32_t value = results[i].metrics[m];
+                int32_t limit = baseline[m] + (int32_t)((int64_t)baseline[m] * tolerance_percent / 100);
+                bool is_worse = (baseline[m] != SIM_NEVER) && (value == SIM_NEVER || value > limit);
+                if (is_worse)
+                {
+                    char was[16], now[16];
+                    format_metric(was, sizeof(was), (scale_metric_t)m, baseline[m]);
+                    format_metric(now, sizeof(now), (scale_metric_t)m, value);
+                    regressions++;
+                    printf("REGRESSION %-24s %-10s %s -> %s\n", name, metric_names[m], was, now);
+                }
+            }
+            break;
+        }
+    }
+    fclose(file);
+
+    printf("compared %d scenarios against %s, %d regressions (tolerance %u%%)\n", compared, path, regressions,
+           tolerance_percent);
+    return regressions ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *baseline_path = NULL;
+    const char *save_path = NULL;
+    unsigned tolerance_percent = 10;
+    int rounds = 40;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) baseline_path = argv[++i];
+        else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) save_path = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) tolerance_percent = (unsigned)atoi(argv[++i]);
+        else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 4) rounds = atoi(argv[++i]);
+        else
+        {
+            fprintf(stderr, "usage: %s [-r rounds] [-w baseline.txt] [-b baseline.txt] [-t tolerance_percent]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    printf("%d rounds, then the time master is removed for %d more; lock and failover in rounds, error in time units\n",
+           rounds, rounds / 2);
+    printf("%-24s %10s %10s %10s %10s %10s\n", "nodes_slots_refs_ppm", "lock", "error max", "error mean", "idle %",
+           "failover");
+
+    for (size_t s = 0; s < sizeof(scenarios) / sizeof(scenarios[0]); s++)
+    {
+        const scale_scenario_t *scenario = &scenarios[s];
+        if (scenario->slot_count > MAX_GLOBAL_SCHEDULE_LENGTH || scenario->slot_count > GTTCAN_MAX_LOCAL_SCHEDULE_LENGTH)
+        {
+            printf("skipping %u slot schedules, MAX_GLOBAL_SCHEDULE_LENGTH is %u\n", scenario->slot_count,
+                   MAX_GLOBAL_SCHEDULE_LENGTH);
+            continue;
+        }
+        if (!build_schedule(scenario))
+        {
+            continue;
+        }
+        run_scenario(scenario, rounds);
+        print_result(&results[result_count - 1]);
+    }
+
+    int result = 0;
+    if (save_path != NULL)
+    {
+        result = save_baseline(save_path);
+    }
+    if (baseline_path != NULL && result == 0)
+    {
+        result = compare_baseline(baseline_path, tolerance_percent);
+    }
+    return result;
+}
@@ -0,0 +1,122 @@
+/*
+ * gttcan_timing.c
+ *
+ *  Host tool that runs gttcan_configure_timing() on a global schedule and prints the shortest
+ *  safe slot_duration, the interrupt_timing_offset and what they are made of, for latencies
+ *  measured on the target.
+ *
+ *  Build (from the repository root):
+ *      cc -Isrc/include -Iexamples -o gttcan_timing tools/gttcan_timing.c src/gttcan.c
+ *  Use the same G-TTCAN configuration macros (identifier mode, slot lengths) as the target,
+ *  and -DGTTCAN_TIMING_SCHEDULE='"my_schedule.h"' for another schedule.
+ *
+ *  Usage:
+ *      gttcan_timing [-b bit_rate] [-f timer_frequency] [-p clock_tolerance_ppm]
+ *                    [-t min,max] [-r min,max] [-a min,max]
+ *          -b  CAN bit rate in bit/s (default 1000000)
+ *          -f  System time units per second (default 1000000)
+ *          -p  Largest clock deviation of any node in ppm (default 100)
+ *          -t  Timer interrupt to start of frame on the bus (default 2,10)
+ *          -r  End of frame on the bus to gttcan_process_frame() (default 2,10)
+ *          -a  gttcan_process_frame() or timer interrupt to the timer being loaded (default 6,8)
+ *      Latencies are in system time units.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gttcan.h"
+
+#ifndef GTTCAN_TIMING_SCHEDULE
+#define GTTCAN_TIMING_SCHEDULE "global_schedule.h"
+#endif
+#include GTTCAN_TIMING_SCHEDULE
+
+gttcan_t gttcan;
+
+// G-TTCAN callbacks, never called
+void timing_transmit_frame(uint32_t can_frame_id, uint64_t data) { (void)can_frame_id; (void)data; }
+void timing_set_timer_int(uint32_t time) { (void)time; }
+uint64_t timing_read_value(uint16_t data_id) { (void)data_id; return 0; }
+void timing_write_value(uint16_t data_id, uint64_t value) { (void)data_id; (void)value; }
+
+static int parse_range(const char *text, uint32_t *min, uint32_t *max)
+{
+    char *end;
+    *min = (uint32_t)strtoul(text, &end, 0);
+    if (*end != ',')
+    {
+        return 0;
+    }
+    *max = (uint32_t)strtoul(end + 1, &end, 0);
+    return *end == '\0' && *min <= *max;
+}
+
+int main(int argc, char **argv)
+{
+    gttcan_timing_params_t params = {
+        .bit_rate = 1000000,
+        .timer_frequency = 1000000,
+        .clock_tolerance_ppm = 100,
+        .transmit_latency_min = 2,
+        .transmit_latency_max = 10,
+        .receive_latency_min = 2,
+        .receive_latency_max = 10,
+        .timer_set_latency_min = 6,
+        .timer_set_latency_max = 8,
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        int is_valid = i + 1 < argc;
+        if (is_valid && strcmp(argv[i], "-b") == 0)
+        {
+            params.bit_rate = (uint32_t)strtoul(argv[++i], NULL, 0);
+        }
+        else if (is_valid && strcmp(argv[i], "-f") == 0)
+        {
+            params.timer_frequency = (uint32_t)strtoul(argv[++i], NULL, 0);
+        }
+        else if (is_valid && strcmp(argv[i], "-p") == 0)
+        {
+            params.clock_tolerance_ppm = (uint32_t)strtoul(argv[++i], NULL, 0);
+        }
+        else if (is_valid && strcmp(argv[i], "-t") == 0 && parse_range(argv[i + 1], &params.transmit_latency_min, &params.transmit_latency_max))
+        {
+            i++;
+        }
+        else if (is_valid && strcmp(argv[i], "-r") == 0 && parse_range(argv[i + 1], &params.receive_latency_min, &params.receive_latency_max))
+        {
+            i++;
+        }
+        else if (is_valid && strcmp(argv[i], "-a") == 0 && parse_range(argv[i + 1], &params.timer_set_latency_min, &params.timer_set_latency_max))
+        {
+            i++;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-b bit_rate] [-f timer_frequency] [-p clock_tolerance_ppm] [-t min,max] [-r min,max] [-a min,max]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    gttcan_init(&gttcan, 1, global_schedule, GLOBAL_SCHEDULE_LENGTH, 0, 0,
+                timing_transmit_frame, timing_set_timer_int, timing_read_value, timing_write_value, true);
+
+    gttcan_timing_t timing;
+    if (!gttcan_configure_timing(&gttcan, &params, &timing))
+    {
+        fprintf(stderr, "no safe slot_duration: the schedule has no reference frame, the latencies are inconsistent, "
+                        "or clocks drift apart by a slot between reference frames\n");
+        return 1;
+    }
+
+    printf("slot_duration            %10u\n", timing.slot_duration);
+    printf("interrupt_timing_offset  %10u\n", timing.interrupt_timing_offset);
+    printf("  longest frame          %10u  worst-case bit stuffing and interframe space\n", timing.longest_frame_time);
+    printf("  synchronisation error  %10u  reference frame lag and jitter of %u timer loads\n", timing.synchronisation_error, timing.timer_loads);
+    printf("  drift                  %10u  over %u slots between reference frames\n", timing.drift, timing.reference_interval);
+    printf("bus load at full slots   %9.1f%%  (%.1f%% at 1.5 times the longest frame)\n",
+           100.0 * timing.longest_frame_time / timing.slot_duration, 100.0 / 1.5);
+    return 0;
+}